@@ -0,0 +1,138 @@
+// Per-step particle passes of the three versions of Application::stepSimulation's force and integration
+// work, on the same cloth from the same start:
+//   scatter: the original loop. Integrate with gravity, then Spring::update for every spring in order
+//            (serial, since two springs may write the same particle), then copy the positions for rendering.
+//   gather:  the version the fused step replaced. Integrate, compute the spring forces, each particle adds
+//            its own in spring order, then the copy.
+//   fused:   compute the spring forces, then sum, integrate and copy in one pass over the particles.
+// The traffic figures are estimates, not measurements: the bytes of every array a pass streams, counted
+// once per pass that reads it and once per pass that writes it (no cache reuse between passes, none lost
+// to the scatter's jumps).
+//
+//   FusedStepBench [columns] [rows] [steps] [threads]
+#include "Particle.h"
+#include "Spring.h"
+#include "Parallel.h"
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char** argv) {
+    const int columns = argc > 1 ? std::atoi(argv[1]) : 700;
+    const int rows = argc > 2 ? std::atoi(argv[2]) : 700;
+    const int steps = argc > 3 ? std::atoi(argv[3]) : 30;
+    if (argc > 4)
+        Parallel::setThreadCount(std::atoi(argv[4]));
+    const float dt = 1.0f / 60.0f;
+    const glm::vec3 gravity(0.0f, -0.05f, 0.0f);
+
+    std::vector<Particle> particles;
+    particles.reserve(static_cast<size_t>(columns) * rows);
+    for (int i = 0; i < columns; ++i) {
+        for (int j = 0; j < rows; ++j)
+            particles.emplace_back(glm::vec3(i * 0.05f, j * 0.05f, 0.0f), j == 0);
+    }
+    std::vector<Spring> springs;
+    for (int i = 0; i < columns; ++i) {
+        for (int j = 0; j < rows; ++j) {
+            if (i != columns - 1)
+                springs.emplace_back(100.0f, 0.05f, &particles[i * rows + j], &particles[(i + 1) * rows + j]);
+            if (j != rows - 1)
+                springs.emplace_back(100.0f, 0.05f, &particles[i * rows + j], &particles[i * rows + j + 1]);
+        }
+    }
+
+    // Same adjacency as Application::buildSpringAdjacency
+    const int particleCount = static_cast<int>(particles.size());
+    const int springCount = static_cast<int>(springs.size());
+    std::vector<int> start(particleCount + 1, 0);
+    for (const Spring& spring : springs) {
+        start[spring.getP1() - particles.data() + 1]++;
+        start[spring.getP2() - particles.data() + 1]++;
+    }
+    for (int i = 0; i < particleCount; ++i)
+        start[i + 1] += start[i];
+    std::vector<int> adjacency(start[particleCount]);
+    std::vector<int> cursor(start.begin(), start.end() - 1);
+    for (int s = 0; s < springCount; ++s) {
+        adjacency[cursor[springs[s].getP2() - particles.data()]++] = s << 1;
+        adjacency[cursor[springs[s].getP1() - particles.data()]++] = (s << 1) | 1;
+    }
+    std::vector<glm::vec3> springForces(springs.size()), vertices(particles.size());
+    const std::vector<Particle> initial = particles;
+
+    auto computeSprings = [&]() {
+        Parallel::forEach(springCount, [&](int s) { springForces[s] = springs[s].computeForce(); });
+    };
+    auto integrate = [&]() {
+        Parallel::forEach(particleCount, [&](int i) {
+            particles[i].applyForce(gravity);
+            particles[i].update(dt);
+        });
+    };
+    auto copyVertices = [&]() {
+        for (int i = 0; i < particleCount; ++i)
+            vertices[i] = particles[i].getPosition();
+    };
+    auto scatter = [&]() {
+        integrate();
+        for (Spring& spring : springs)
+            spring.update();
+        copyVertices();
+    };
+    auto gather = [&]() {
+        integrate();
+        computeSprings();
+        Parallel::forEach(particleCount, [&](int i) {
+            for (int a = start[i]; a < start[i + 1]; ++a) {
+                const int entry = adjacency[a];
+                particles[i].applyForce((entry & 1) ? -springForces[entry >> 1] : springForces[entry >> 1]);
+            }
+        });
+        copyVertices();
+    };
+    auto fused = [&]() {
+        computeSprings();
+        Parallel::forEach(particleCount, [&](int i) {
+            glm::vec3 force = gravity;
+            for (int a = start[i]; a < start[i + 1]; ++a) {
+                const int entry = adjacency[a];
+                force += (entry & 1) ? -springForces[entry >> 1] : springForces[entry >> 1];
+            }
+            particles[i].applyForce(force);
+            particles[i].update(dt);
+            vertices[i] = particles[i].getPosition();
+        });
+    };
+
+    using Clock = std::chrono::steady_clock;
+    auto perStep = [&](auto step) {
+        std::copy(initial.begin(), initial.end(), particles.begin()); // In place: the springs point into it
+        step(); // Warm up
+        const Clock::time_point begin = Clock::now();
+        for (int s = 0; s < steps; ++s)
+            step();
+        return std::chrono::duration<double, std::milli>(Clock::now() - begin).count() / steps;
+    };
+
+    // Array sizes in MB, and the estimated traffic of each version as the sum over its passes
+    const double particleMB = particleCount * sizeof(Particle) / 1e6;
+    const double vertexMB = particleCount * sizeof(glm::vec3) / 1e6;
+    const double springMB = springCount * sizeof(Spring) / 1e6;
+    const double forceMB = springCount * sizeof(glm::vec3) / 1e6;
+    const double adjacencyMB = (adjacency.size() + start.size()) * sizeof(int) / 1e6;
+    // integrate: particles read + write; Spring::update: springs, particles read + write; copy: particles, vertices
+    const double scatterMB = 2 * particleMB + (springMB + 2 * particleMB) + (particleMB + vertexMB);
+    // integrate; computeForce: springs, particles, forces written; gather: adjacency, forces, particles read + write; copy
+    const double gatherMB = 2 * particleMB + (springMB + particleMB + forceMB) + (adjacencyMB + forceMB + 2 * particleMB) + (particleMB + vertexMB);
+    // computeForce; fused pass: adjacency, forces, particles read + write, vertices
+    const double fusedMB = (springMB + particleMB + forceMB) + (adjacencyMB + forceMB + 2 * particleMB + vertexMB);
+
+    std::printf("%d particles (%zu bytes each, %.1f MB), %d springs, %d threads (scatter runs on one)\n", particleCount, sizeof(Particle), particleMB, springCount, Parallel::threadCount());
+    std::printf("scatter: %6.2f ms/step, estimated traffic %.0f MB\n", perStep(scatter), scatterMB);
+    std::printf("gather:  %6.2f ms/step, estimated traffic %.0f MB\n", perStep(gather), gatherMB);
+    std::printf("fused:   %6.2f ms/step, estimated traffic %.0f MB\n", perStep(fused), fusedMB);
+    return 0;
+}
@@ -0,0 +1,114 @@
+// The dense SignedDistanceField against the narrow-band SparseDistanceField on a UV sphere: build time,
+// memory, loading the sparse cache (mapped), and sampleBatch per query for a coherent sheet of points
+// just off the surface (what a draped cloth asks for) and for random points in the bounds. Distances are
+// compared where the dense field is within the band, signs everywhere.
+//
+//   SparseFieldBench [resolution] [queries]
+#include "SignedDistanceField.h"
+#include "SparseDistanceField.h"
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+int main(int argc, char** argv) {
+    const int resolution = argc > 1 ? std::atoi(argv[1]) : 128;
+    const int queries = argc > 2 ? std::atoi(argv[2]) : 1 << 20;
+    const char* cachePath = "SparseFieldBench.sdfs";
+    const float pi = 3.14159265f;
+
+    // Sphere of radius 0.5, rings from pole to pole
+    const int segments = 128, rings = 64;
+    const glm::vec3 center(0.1f, 0.2f, 0.3f);
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> indices;
+    for (int i = 0; i <= rings; ++i) {
+        for (int j = 0; j < segments; ++j) {
+            float theta = pi * i / rings, phi = 2.0f * pi * j / segments;
+            positions.push_back(center + 0.5f * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    }
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < segments; ++j) {
+            GLuint a = i * segments + j, b = i * segments + (j + 1) % segments;
+            GLuint c = a + segments, d = b + segments;
+            indices.insert(indices.end(), { a, c, b, b, c, d });
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto milliseconds = [](Clock::time_point begin) { return std::chrono::duration<double, std::milli>(Clock::now() - begin).count(); };
+
+    Clock::time_point begin = Clock::now();
+    SignedDistanceField dense;
+    dense.build(positions, indices, resolution);
+    const glm::ivec3 dimensions = dense.getDimensions();
+    std::printf("dense:  build %.0f ms, %.1f MB\n", milliseconds(begin), static_cast<double>(dimensions.x) * dimensions.y * dimensions.z * sizeof(float) / 1e6);
+
+    begin = Clock::now();
+    SparseDistanceField built;
+    built.build(positions, indices, resolution);
+    std::printf("sparse: build %.0f ms, %.1f MB (%.1f MB as one dense grid), %d blocks\n",
+        milliseconds(begin), built.memoryBytes() / 1e6, built.denseBytes() / 1e6, built.getBlockCount());
+    if (!built.save(cachePath)) {
+        std::printf("Could not write %s\n", cachePath);
+        return 1;
+    }
+    SparseDistanceField sparse;
+    begin = Clock::now();
+    const bool loaded = sparse.load(cachePath);
+    std::printf("sparse: load %.3f ms%s\n", milliseconds(begin), loaded ? "" : " (failed)");
+    if (!loaded)
+        return 1;
+
+    std::vector<float> x(queries), y(queries), z(queries);
+    std::vector<float> denseDistance(queries), sparseDistance(queries), gx(queries), gy(queries), gz(queries);
+    auto compare = [&](const char* name) {
+        begin = Clock::now();
+        dense.sampleBatch(x.data(), y.data(), z.data(), denseDistance.data(), gx.data(), gy.data(), gz.data(), queries);
+        const double denseTime = milliseconds(begin);
+        begin = Clock::now();
+        sparse.sampleBatch(x.data(), y.data(), z.data(), sparseDistance.data(), gx.data(), gy.data(), gz.data(), queries);
+        const double sparseTime = milliseconds(begin);
+
+        float maxDifference = 0.0f;
+        int signMismatches = 0;
+        for (int i = 0; i < queries; ++i) {
+            if (std::fabs(denseDistance[i]) < 0.9f * sparse.getBandWidth())
+                maxDifference = std::max(maxDifference, std::fabs(denseDistance[i] - sparseDistance[i]));
+            // Right on the surface either sign is fine
+            if ((denseDistance[i] < 0.0f) != (sparseDistance[i] < 0.0f) && std::fabs(denseDistance[i]) > 0.01f)
+                ++signMismatches;
+        }
+        std::printf("%s: dense %.1f ns/query, sparse %.1f ns/query, max difference in the band %.2g, sign mismatches %d\n",
+            name, denseTime * 1e6 / queries, sparseTime * 1e6 / queries, maxDifference, signMismatches);
+    };
+
+    // A rippled sheet over most of the sphere, in row order like the particles of a cloth
+    const int side = static_cast<int>(std::sqrt(static_cast<double>(queries)));
+    for (int i = 0; i < queries; ++i) {
+        const int u = i % side, v = i / side;
+        float theta = 0.3f + 1.2f * u / side, phi = 2.0f * pi * v / side;
+        float radius = 0.5f + 0.01f * std::sin(u * 0.1f);
+        x[i] = center.x + radius * std::sin(theta) * std::cos(phi);
+        y[i] = center.y + radius * std::cos(theta);
+        z[i] = center.z + radius * std::sin(theta) * std::sin(phi);
+    }
+    compare("coherent");
+    compare("coherent"); // Again with the pages of both fields resident
+
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> offset(-0.55f, 0.55f);
+    for (int i = 0; i < queries; ++i) {
+        x[i] = center.x + offset(random);
+        y[i] = center.y + offset(random);
+        z[i] = center.z + offset(random);
+    }
+    compare("random");
+
+    std::remove(cachePath);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "Aerodynamics.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+void Aerodynamics::computeFaceForces(
+    const std::vector<Particle>& particles,
+    const std::vector<GLuint>& indices,
+    const std::vector<glm::vec3>& faceNormals,
+    const std::vector<float>& faceAreas,
+    const WindField& wind,
+    const AirGrid* airGrid,
+    uint64_t step,
+    float dt,
+    std::vector<glm::vec3>& faceForces) const {
+
+    const int triangleCount = static_cast<int>(indices.size() / 3);
+    faceForces.resize(triangleCount);
+    if (dt <= 0.0f) {
+        std::fill(faceForces.begin(), faceForces.end(), glm::vec3(0.0f));
+        return;
+    }
+
+    const float invDt = 1.0f / dt;
+    const float pressure = 0.5f * airDensity;
+
+    Parallel::forBlocks(triangleCount, [&](int begin, int end) {
+        const int count = end - begin;
+        float cx[Parallel::BlockSize], cy[Parallel::BlockSize], cz[Parallel::BlockSize];
+        float vx[Parallel::BlockSize], vy[Parallel::BlockSize], vz[Parallel::BlockSize];
+        float ax[Parallel::BlockSize], ay[Parallel::BlockSize], az[Parallel::BlockSize];
+
+        // Centroids and face velocities of the block
+        for (int t = begin; t < end; ++t) {
+            const Particle& p0 = particles[indices[3 * t]];
+            const Particle& p1 = particles[indices[3 * t + 1]];
+            const Particle& p2 = particles[indices[3 * t + 2]];
+            glm::vec3 centroid = (p0.getPosition() + p1.getPosition() + p2.getPosition()) * (1.0f / 3.0f);
+            glm::vec3 previous = (p0.getPreviousPosition() + p1.getPreviousPosition() + p2.getPreviousPosition()) * (1.0f / 3.0f);
+            glm::vec3 velocity = (centroid - previous) * invDt;
+            cx[t - begin] = centroid.x; cy[t - begin] = centroid.y; cz[t - begin] = centroid.z;
+            vx[t - begin] = velocity.x; vy[t - begin] = velocity.y; vz[t - begin] = velocity.z;
+        }
+
+        // Air velocity at the centroids
+        float speedScale = airSpeed;
+        if (airGrid) {
+            airGrid->sampleBatch(cx, cy, cz, ax, ay, az, count);
+            speedScale = 1.0f;
+        }
+        else {
+            wind.sampleBatch(cx, cy, cz, ax, ay, az, count, step, begin);
+        }
+
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            const glm::vec3 n = faceNormals[begin + i];
+            const float area = faceAreas[begin + i];
+
+            // Velocity of the face relative to the air
+            float rx = vx[i] - ax[i] * speedScale;
+            float ry = vy[i] - ay[i] * speedScale;
+            float rz = vz[i] - az[i] * speedScale;
+            float speedSq = rx * rx + ry * ry + rz * rz;
+            float speed = std::sqrt(speedSq);
+            float invSpeed = speed > 1e-6f ? 1.0f / speed : 0.0f;
+
+            // cos of the angle between the flow and the face normal (sign picks the side that is hit)
+            float cosTheta = (rx * n.x + ry * n.y + rz * n.z) * invSpeed;
+            float scale = pressure * area * speedSq * cosTheta;
+
+            // Drag pushes along the normal against the relative motion,
+            // lift acts across the flow in the plane of flow and normal: n - cos * flow direction
+            float drag = -scale * dragCoefficient;
+            float lift = -scale * liftCoefficient;
+            float fx = drag * n.x + lift * (n.x - cosTheta * rx * invSpeed);
+            float fy = drag * n.y + lift * (n.y - cosTheta * ry * invSpeed);
+            float fz = drag * n.z + lift * (n.z - cosTheta * rz * invSpeed);
+            faceForces[begin + i] = glm::vec3(fx, fy, fz);
+        }
+    });
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include "Particle.h"
+#include "WindField.h"
+#include "AirGrid.h"
+
+// Per-triangle aerodynamic wind: drag and lift from the air velocity relative to each face,
+// proportional to the face area and to how squarely the face meets the flow.
+class Aerodynamics {
+public:
+    bool enabled = true;
+    float dragCoefficient = 1.2f;
+    float liftCoefficient = 0.4f;
+    float airDensity = 150.0f; // In the simulation's force units
+    float airSpeed = 10.0f;    // Wind field output is scaled by this to get an air velocity
+
+    // Force on every triangle. Normals and areas are the ones calculateNormals already produced for rendering.
+    // The air velocity comes from airGrid when given, otherwise from the wind field.
+    void computeFaceForces(
+        const std::vector<Particle>& particles,
+        const std::vector<GLuint>& indices,
+        const std::vector<glm::vec3>& faceNormals,
+        const std::vector<float>& faceAreas,
+        const WindField& wind,
+        const AirGrid* airGrid,
+        uint64_t step,
+        float dt,
+        std::vector<glm::vec3>& faceForces) const;
+
+    // A third of the force of every triangle around vertex v
+    static glm::vec3 gatherVertexForce(
+        int v,
+        const std::vector<glm::vec3>& faceForces,
+        const std::vector<int>& vertexFaceStart,
+        const std::vector<int>& vertexFaceEnd,
+        const std::vector<int>& vertexFaces) {
+        glm::vec3 force(0.0f);
+        for (int a = vertexFaceStart[v]; a < vertexFaceEnd[v]; ++a)
+            force += faceForces[vertexFaces[a]];
+        return force * (1.0f / 3.0f);
+    }
+};
@@ -0,0 +1,235 @@
+#include "AirGrid.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+void AirGrid::fit(const glm::vec3& clothMin, const glm::vec3& clothMax) {
+    glm::vec3 boxMin = clothMin - glm::vec3(padding);
+    glm::vec3 boxMax = clothMax + glm::vec3(padding);
+    glm::vec3 extent = boxMax - boxMin;
+
+    // Cubic cells, resolution cells along the longest side
+    int res = std::max(resolution, 4);
+    cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / res;
+    invCellSize = 1.0f / cellSize;
+    nx = std::max(4, static_cast<int>(std::ceil(extent.x * invCellSize)));
+    ny = std::max(4, static_cast<int>(std::ceil(extent.y * invCellSize)));
+    nz = std::max(4, static_cast<int>(std::ceil(extent.z * invCellSize)));
+    origin = (boxMin + boxMax) * 0.5f - glm::vec3(nx, ny, nz) * (0.5f * cellSize);
+
+    const int cellCount = nx * ny * nz;
+    velX.assign(cellCount, 0.0f); velY.assign(cellCount, 0.0f); velZ.assign(cellCount, 0.0f);
+    tempX.assign(cellCount, 0.0f); tempY.assign(cellCount, 0.0f); tempZ.assign(cellCount, 0.0f);
+    pressure.assign(cellCount, 0.0f);
+    pressureNext.assign(cellCount, 0.0f);
+    divergence.assign(cellCount, 0.0f);
+    splatMomentum.assign(cellCount, glm::vec3(0.0f));
+    splatWeight.assign(cellCount, 0.0f);
+}
+
+bool AirGrid::follow(const glm::vec3& clothMin, const glm::vec3& clothMax) {
+    if (!isReady())
+        return false;
+    const glm::vec3 gridMin = origin, gridMax = origin + glm::vec3(nx, ny, nz) * cellSize;
+    const glm::vec3 margin(0.5f * padding);
+    if (!glm::any(glm::lessThan(clothMin - margin, gridMin)) && !glm::any(glm::greaterThan(clothMax + margin, gridMax)))
+        return false;
+
+    // Grown out of the grid (stretched, torn apart): a new box, and the air starts still
+    if (glm::any(glm::greaterThan(clothMax - clothMin + glm::vec3(2.0f * padding), gridMax - gridMin))) {
+        fit(clothMin, clothMax);
+        return true;
+    }
+    const glm::vec3 cells = glm::round(((clothMin + clothMax) * 0.5f - (gridMin + gridMax) * 0.5f) * invCellSize);
+    shift(static_cast<int>(cells.x), static_cast<int>(cells.y), static_cast<int>(cells.z));
+    return true;
+}
+
+void AirGrid::shift(int dx, int dy, int dz) {
+    origin += glm::vec3(dx, dy, dz) * cellSize;
+    Parallel::forEach(getCellCount(), [&](int c) {
+        const int x = c % nx + dx, y = (c / nx) % ny + dy, z = c / (nx * ny) + dz;
+        const bool inside = x >= 0 && y >= 0 && z >= 0 && x < nx && y < ny && z < nz;
+        const int from = inside ? cell(x, y, z) : 0;
+        tempX[c] = inside ? velX[from] : 0.0f;
+        tempY[c] = inside ? velY[from] : 0.0f;
+        tempZ[c] = inside ? velZ[from] : 0.0f;
+    });
+    velX.swap(tempX);
+    velY.swap(tempY);
+    velZ.swap(tempZ);
+}
+
+void AirGrid::step(float dt, const std::vector<Particle>& particles, const WindField* wind) {
+    if (!isReady() || dt <= 0.0f)
+        return;
+
+    splatCloth(dt, particles);
+    applyBoundary(wind);
+    advect(dt);
+    project();
+    applyBoundary(wind);
+}
+
+// The cloth pulls the air it touches towards its own velocity
+void AirGrid::splatCloth(float dt, const std::vector<Particle>& particles) {
+    std::fill(splatMomentum.begin(), splatMomentum.end(), glm::vec3(0.0f));
+    std::fill(splatWeight.begin(), splatWeight.end(), 0.0f);
+
+    // Serial on purpose: particles scatter into shared cells, and the fixed order keeps runs reproducible
+    const float invDt = 1.0f / dt;
+    for (const auto& particle : particles) {
+        glm::vec3 g = (particle.getPosition() - origin) * invCellSize - glm::vec3(0.5f);
+        glm::vec3 base = glm::floor(g);
+        glm::vec3 t = g - base;
+        int x0 = static_cast<int>(base.x), y0 = static_cast<int>(base.y), z0 = static_cast<int>(base.z);
+        glm::vec3 velocity = (particle.getPosition() - particle.getPreviousPosition()) * invDt;
+
+        for (int corner = 0; corner < 8; ++corner) {
+            int dx = corner & 1, dy = (corner >> 1) & 1, dz = (corner >> 2) & 1;
+            int x = x0 + dx, y = y0 + dy, z = z0 + dz;
+            if (x < 0 || y < 0 || z < 0 || x >= nx || y >= ny || z >= nz)
+                continue;
+            float w = (dx ? t.x : 1.0f - t.x) * (dy ? t.y : 1.0f - t.y) * (dz ? t.z : 1.0f - t.z);
+            splatMomentum[cell(x, y, z)] += velocity * w;
+            splatWeight[cell(x, y, z)] += w;
+        }
+    }
+
+    Parallel::forEach(getCellCount(), [&](int c) {
+        if (splatWeight[c] <= 0.0f)
+            return;
+        glm::vec3 clothVelocity = splatMomentum[c] / splatWeight[c];
+        float blend = std::min(1.0f, coupling * splatWeight[c]);
+        velX[c] += (clothVelocity.x - velX[c]) * blend;
+        velY[c] += (clothVelocity.y - velY[c]) * blend;
+        velZ[c] += (clothVelocity.z - velZ[c]) * blend;
+    });
+}
+
+// Boundary cells carry the ambient wind (or still air when there is none)
+void AirGrid::applyBoundary(const WindField* wind) {
+    Parallel::forEach(getCellCount(), [&](int c) {
+        int x = c % nx, y = (c / nx) % ny, z = c / (nx * ny);
+        if (!isBoundary(x, y, z))
+            return;
+        glm::vec3 ambient(0.0f);
+        if (wind) {
+            glm::vec3 center = origin + (glm::vec3(x, y, z) + 0.5f) * cellSize;
+            ambient = (wind->getDirection() * wind->strength + wind->sampleTurbulence(center)) * airSpeed;
+        }
+        velX[c] = ambient.x;
+        velY[c] = ambient.y;
+        velZ[c] = ambient.z;
+    });
+}
+
+// Semi-Lagrangian advection: every cell traces back along the velocity and picks up what was there
+void AirGrid::advect(float dt) {
+    const float step = dt * invCellSize;
+    Parallel::forEach(getCellCount(), [&](int c) {
+        int x = c % nx, y = (c / nx) % ny, z = c / (nx * ny);
+        float gx = x - velX[c] * step;
+        float gy = y - velY[c] * step;
+        float gz = z - velZ[c] * step;
+        interpolate(velX, velY, velZ, gx, gy, gz, tempX[c], tempY[c], tempZ[c]);
+    });
+    velX.swap(tempX);
+    velY.swap(tempY);
+    velZ.swap(tempZ);
+}
+
+// Makes the interior divergence free. Jacobi iterations keep every cell independent within an iteration.
+void AirGrid::project() {
+    const float halfInvH = 0.5f * invCellSize;
+    const float h2 = cellSize * cellSize;
+
+    Parallel::forEach(getCellCount(), [&](int c) {
+        int x = c % nx, y = (c / nx) % ny, z = c / (nx * ny);
+        pressure[c] = 0.0f;
+        if (isBoundary(x, y, z)) {
+            divergence[c] = 0.0f;
+            return;
+        }
+        divergence[c] = halfInvH * (
+            velX[cell(x + 1, y, z)] - velX[cell(x - 1, y, z)] +
+            velY[cell(x, y + 1, z)] - velY[cell(x, y - 1, z)] +
+            velZ[cell(x, y, z + 1)] - velZ[cell(x, y, z - 1)]);
+    });
+
+    for (int iteration = 0; iteration < pressureIterations; ++iteration) {
+        Parallel::forEach(getCellCount(), [&](int c) {
+            int x = c % nx, y = (c / nx) % ny, z = c / (nx * ny);
+            if (isBoundary(x, y, z)) {
+                pressureNext[c] = 0.0f;
+                return;
+            }
+            float sum = pressure[cell(x + 1, y, z)] + pressure[cell(x - 1, y, z)] +
+                        pressure[cell(x, y + 1, z)] + pressure[cell(x, y - 1, z)] +
+                        pressure[cell(x, y, z + 1)] + pressure[cell(x, y, z - 1)];
+            pressureNext[c] = (sum - divergence[c] * h2) / 6.0f;
+        });
+        pressure.swap(pressureNext);
+    }
+
+    Parallel::forEach(getCellCount(), [&](int c) {
+        int x = c % nx, y = (c / nx) % ny, z = c / (nx * ny);
+        if (isBoundary(x, y, z))
+            return;
+        velX[c] -= halfInvH * (pressure[cell(x + 1, y, z)] - pressure[cell(x - 1, y, z)]);
+        velY[c] -= halfInvH * (pressure[cell(x, y + 1, z)] - pressure[cell(x, y - 1, z)]);
+        velZ[c] -= halfInvH * (pressure[cell(x, y, z + 1)] - pressure[cell(x, y, z - 1)]);
+    });
+}
+
+// Trilinear interpolation in cell-center coordinates, clamped to the grid
+void AirGrid::interpolate(const std::vector<float>& fx, const std::vector<float>& fy, const std::vector<float>& fz,
+    float gx, float gy, float gz, float& outX, float& outY, float& outZ) const {
+    gx = std::min(std::max(gx, 0.0f), nx - 1.001f);
+    gy = std::min(std::max(gy, 0.0f), ny - 1.001f);
+    gz = std::min(std::max(gz, 0.0f), nz - 1.001f);
+    int x0 = static_cast<int>(gx), y0 = static_cast<int>(gy), z0 = static_cast<int>(gz);
+    float tx = gx - x0, ty = gy - y0, tz = gz - z0;
+
+    int c000 = cell(x0, y0, z0), c100 = c000 + 1;
+    int c010 = c000 + nx, c110 = c010 + 1;
+    int c001 = c000 + nx * ny, c101 = c001 + 1;
+    int c011 = c001 + nx, c111 = c011 + 1;
+
+    float w000 = (1 - tx) * (1 - ty) * (1 - tz), w100 = tx * (1 - ty) * (1 - tz);
+    float w010 = (1 - tx) * ty * (1 - tz), w110 = tx * ty * (1 - tz);
+    float w001 = (1 - tx) * (1 - ty) * tz, w101 = tx * (1 - ty) * tz;
+    float w011 = (1 - tx) * ty * tz, w111 = tx * ty * tz;
+
+    outX = w000 * fx[c000] + w100 * fx[c100] + w010 * fx[c010] + w110 * fx[c110]
+         + w001 * fx[c001] + w101 * fx[c101] + w011 * fx[c011] + w111 * fx[c111];
+    outY = w000 * fy[c000] + w100 * fy[c100] + w010 * fy[c010] + w110 * fy[c110]
+         + w001 * fy[c001] + w101 * fy[c101] + w011 * fy[c011] + w111 * fy[c111];
+    outZ = w000 * fz[c000] + w100 * fz[c100] + w010 * fz[c010] + w110 * fz[c110]
+         + w001 * fz[c001] + w101 * fz[c101] + w011 * fz[c011] + w111 * fz[c111];
+}
+
+glm::vec3 AirGrid::sample(const glm::vec3& position) const {
+    if (!isReady())
+        return glm::vec3(0.0f);
+    glm::vec3 g = (position - origin) * invCellSize - glm::vec3(0.5f);
+    glm::vec3 velocity;
+    interpolate(velX, velY, velZ, g.x, g.y, g.z, velocity.x, velocity.y, velocity.z);
+    return velocity;
+}
+
+void AirGrid::sampleBatch(const float* px, const float* py, const float* pz,
+    float* vx, float* vy, float* vz, int count) const {
+    if (!isReady()) {
+        for (int i = 0; i < count; ++i)
+            vx[i] = vy[i] = vz[i] = 0.0f;
+        return;
+    }
+#pragma omp simd
+    for (int i = 0; i < count; ++i) {
+        float gx = (px[i] - origin.x) * invCellSize - 0.5f;
+        float gy = (py[i] - origin.y) * invCellSize - 0.5f;
+        float gz = (pz[i] - origin.z) * invCellSize - 0.5f;
+        interpolate(velX, velY, velZ, gx, gy, gz, vx[i], vy[i], vz[i]);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "Particle.h"
+#include "WindField.h"
+
+// Coarse Eulerian air around the cloth ("stable fluids": semi-Lagrangian advection + pressure projection).
+// The grid has its own resolution, so its cost does not grow with the cloth resolution.
+// The cloth drags the air along where it moves, and the aerodynamic model reads the air velocity back.
+class AirGrid {
+public:
+    bool enabled = false;
+    int resolution = 16;           // Cells along the longest side of the box
+    float padding = 0.5f;          // Room around the cloth's bounding box
+    int pressureIterations = 20;
+    float coupling = 0.5f;         // How strongly the cloth velocity is imposed on the air it touches
+    float airSpeed = 10.0f;        // Scale from wind field output to air velocity at the boundary
+
+    // Places the grid around [clothMin, clothMax] and clears it
+    void fit(const glm::vec3& clothMin, const glm::vec3& clothMax);
+    // Keeps the cloth inside the grid as it falls or drifts. Once [clothMin, clothMax] comes within half
+    // the padding of the grid's sides, the grid is moved by whole cells to be centred on it again, and the
+    // air is kept where the old and the new grid overlap. A cloth that no longer fits is fitted anew.
+    // Returns true when the grid moved.
+    bool follow(const glm::vec3& clothMin, const glm::vec3& clothMax);
+
+    // Cloth pushes the air, boundary takes the wind, then advection and projection
+    void step(float dt, const std::vector<Particle>& particles, const WindField* wind);
+
+    // Air velocity at a world position (outside the grid: the nearest boundary value)
+    glm::vec3 sample(const glm::vec3& position) const;
+    void sampleBatch(const float* px, const float* py, const float* pz,
+        float* vx, float* vy, float* vz, int count) const;
+
+    bool isReady() const { return !velX.empty(); }
+    int getCellCount() const { return nx * ny * nz; }
+
+private:
+    int nx = 0, ny = 0, nz = 0;
+    glm::vec3 origin = glm::vec3(0.0f);
+    float cellSize = 1.0f;
+    float invCellSize = 1.0f;
+
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> tempX, tempY, tempZ;
+    std::vector<float> pressure, pressureNext, divergence;
+    std::vector<glm::vec3> splatMomentum;
+    std::vector<float> splatWeight;
+
+    int cell(int x, int y, int z) const { return (z * ny + y) * nx + x; }
+    bool isBoundary(int x, int y, int z) const {
+        return x == 0 || y == 0 || z == 0 || x == nx - 1 || y == ny - 1 || z == nz - 1;
+    }
+
+    // Moves the grid by (dx, dy, dz) cells; cells with no old cell under them start still
+    void shift(int dx, int dy, int dz);
+    void splatCloth(float dt, const std::vector<Particle>& particles);
+    void applyBoundary(const WindField* wind);
+    void advect(float dt);
+    void project();
+    void interpolate(const std::vector<float>& fx, const std::vector<float>& fy, const std::vector<float>& fz,
+        float gx, float gy, float gz, float& outX, float& outY, float& outZ) const;
+};
@@ -0,0 +1,232 @@
+#include "AnalyticCollider.h"
+#include "SignedDistanceField.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+
+void AnalyticCollider::setRotation(const glm::quat& rotation) {
+    glm::mat3 m = glm::mat3_cast(glm::normalize(rotation));
+    axis[0] = m[0];
+    axis[1] = m[1];
+    axis[2] = m[2];
+}
+
+AnalyticCollider AnalyticCollider::box(const glm::vec3& center, const glm::vec3& halfExtents, const glm::quat& rotation) {
+    AnalyticCollider collider;
+    collider.shape = AnalyticShape::Box;
+    collider.center = center;
+    collider.halfExtents = halfExtents;
+    collider.setRotation(rotation);
+    return collider;
+}
+
+AnalyticCollider AnalyticCollider::sphere(const glm::vec3& center, float radius) {
+    AnalyticCollider collider;
+    collider.shape = AnalyticShape::Sphere;
+    collider.center = center;
+    collider.radius = radius;
+    return collider;
+}
+
+AnalyticCollider AnalyticCollider::capsule(const glm::vec3& center, float halfHeight, float radius, const glm::quat& rotation) {
+    AnalyticCollider collider;
+    collider.shape = AnalyticShape::Capsule;
+    collider.center = center;
+    collider.halfHeight = halfHeight;
+    collider.radius = radius;
+    collider.setRotation(rotation);
+    return collider;
+}
+
+AnalyticCollider AnalyticCollider::cylinder(const glm::vec3& center, float halfHeight, float radius, const glm::quat& rotation) {
+    AnalyticCollider collider = capsule(center, halfHeight, radius, rotation);
+    collider.shape = AnalyticShape::Cylinder;
+    return collider;
+}
+
+AnalyticCollider AnalyticCollider::plane(const glm::vec3& point, const glm::vec3& normal) {
+    AnalyticCollider collider;
+    collider.shape = AnalyticShape::Plane;
+    collider.center = point;
+    // Local y is the normal, the other two axes any perpendicular pair
+    glm::vec3 y = glm::normalize(normal);
+    glm::vec3 x = glm::normalize(glm::cross(std::abs(y.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0), y));
+    collider.axis[0] = x;
+    collider.axis[1] = y;
+    collider.axis[2] = glm::cross(x, y);
+    return collider;
+}
+
+float AnalyticCollider::sample(const glm::vec3& position, glm::vec3& normal) const {
+    float distance;
+    sampleBatch(&position.x, &position.y, &position.z, &distance, &normal.x, &normal.y, &normal.z, 1);
+    return distance;
+}
+
+void AnalyticCollider::sampleBatch(const float* px, const float* py, const float* pz,
+    float* distance, float* nx, float* ny, float* nz, int count) const {
+    // Frame as plain floats, so the loops below only see scalars and arrays
+    const float cx = center.x, cy = center.y, cz = center.z;
+    const float ax = axis[0].x, ay = axis[0].y, az = axis[0].z;
+    const float bx = axis[1].x, by = axis[1].y, bz = axis[1].z;
+    const float ex = axis[2].x, ey = axis[2].y, ez = axis[2].z;
+    const float r = radius, h = halfHeight;
+    const float hx = halfExtents.x, hy = halfExtents.y, hz = halfExtents.z;
+
+    // Every case: position into the local frame (u, v, w), distance and local normal (mu, mv, mw) there,
+    // normal back to world space
+    auto toLocal = [&](int i, float& u, float& v, float& w) {
+        const float dx = px[i] - cx, dy = py[i] - cy, dz = pz[i] - cz;
+        u = dx * ax + dy * ay + dz * az;
+        v = dx * bx + dy * by + dz * bz;
+        w = dx * ex + dy * ey + dz * ez;
+    };
+    auto toWorld = [&](int i, float mu, float mv, float mw) {
+        nx[i] = mu * ax + mv * bx + mw * ex;
+        ny[i] = mu * ay + mv * by + mw * ey;
+        nz[i] = mu * az + mv * bz + mw * ez;
+    };
+
+    switch (shape) {
+    case AnalyticShape::Sphere:
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            const float dx = px[i] - cx, dy = py[i] - cy, dz = pz[i] - cz;
+            const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+            const float inverse = 1.0f / std::max(length, 1e-12f);
+            distance[i] = length - r;
+            nx[i] = dx * inverse;
+            ny[i] = length > 1e-12f ? dy * inverse : 1.0f; // Center: straight up
+            nz[i] = dz * inverse;
+        }
+        break;
+
+    case AnalyticShape::Plane:
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            distance[i] = (px[i] - cx) * bx + (py[i] - cy) * by + (pz[i] - cz) * bz;
+            nx[i] = bx;
+            ny[i] = by;
+            nz[i] = bz;
+        }
+        break;
+
+    case AnalyticShape::Box:
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            float u, v, w;
+            toLocal(i, u, v, w);
+            const float su = u >= 0.0f ? 1.0f : -1.0f, sv = v >= 0.0f ? 1.0f : -1.0f, sw = w >= 0.0f ? 1.0f : -1.0f;
+            const float qu = std::abs(u) - hx, qv = std::abs(v) - hy, qw = std::abs(w) - hz;
+            const float ou = std::max(qu, 0.0f), ov = std::max(qv, 0.0f), ow = std::max(qw, 0.0f);
+            const float outside = std::sqrt(ou * ou + ov * ov + ow * ow);
+            const float deepest = std::max(qu, std::max(qv, qw));
+            distance[i] = outside + std::min(deepest, 0.0f);
+            // Outside: towards the closest point on the box. Inside: out through the nearest face, the
+            // first of u, v, w on a tie.
+            const float inverse = 1.0f / std::max(outside, 1e-12f);
+            const float faceU = qu == deepest ? 1.0f : 0.0f;
+            const float faceV = (1.0f - faceU) * (qv == deepest ? 1.0f : 0.0f);
+            const float faceW = 1.0f - faceU - faceV;
+            const bool out = outside > 0.0f;
+            const float mu = out ? su * ou * inverse : su * faceU;
+            const float mv = out ? sv * ov * inverse : sv * faceV;
+            const float mw = out ? sw * ow * inverse : sw * faceW;
+            toWorld(i, mu, mv, mw);
+        }
+        break;
+
+    case AnalyticShape::Capsule:
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            float u, v, w;
+            toLocal(i, u, v, w);
+            // From the closest point of the core segment
+            const float ov = v - std::min(std::max(v, -h), h);
+            const float length = std::sqrt(u * u + ov * ov + w * w);
+            const float inverse = 1.0f / std::max(length, 1e-12f);
+            distance[i] = length - r;
+            const float mu = u * inverse;
+            const float mv = length > 1e-12f ? ov * inverse : 0.0f;
+            const float mw = length > 1e-12f ? w * inverse : 1.0f; // On the core: any sideways direction
+            toWorld(i, mu, mv, mw);
+        }
+        break;
+
+    case AnalyticShape::Cylinder:
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            float u, v, w;
+            toLocal(i, u, v, w);
+            const float radial = std::sqrt(u * u + w * w);
+            const float inverseRadial = 1.0f / std::max(radial, 1e-12f);
+            const float ru = u * inverseRadial, rw = radial > 1e-12f ? w * inverseRadial : 1.0f;
+            const float sv = v >= 0.0f ? 1.0f : -1.0f;
+            const float qr = radial - r, qv = std::abs(v) - h;
+            const float radialOut = std::max(qr, 0.0f), capOut = std::max(qv, 0.0f);
+            const float outside = std::sqrt(radialOut * radialOut + capOut * capOut);
+            distance[i] = outside + std::min(std::max(qr, qv), 0.0f);
+            // Outside: towards the closest point (side, cap, or rim). Inside: through the nearer of side and cap.
+            const bool out = outside > 0.0f;
+            const float inverse = 1.0f / std::max(outside, 1e-12f);
+            const float side = out ? radialOut * inverse : (qr >= qv ? 1.0f : 0.0f);
+            const float cap = out ? capOut * inverse : (qr >= qv ? 0.0f : 1.0f);
+            const float mu = ru * side, mv = sv * cap, mw = rw * side;
+            toWorld(i, mu, mv, mw);
+        }
+        break;
+    }
+}
+
+void AnalyticCollider::resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const {
+    Parallel::forBlocks(candidateCount, [&](int begin, int end) {
+        float px[Parallel::BlockSize], py[Parallel::BlockSize], pz[Parallel::BlockSize];
+        float distance[Parallel::BlockSize], nx[Parallel::BlockSize], ny[Parallel::BlockSize], nz[Parallel::BlockSize];
+        const int count = end - begin;
+        for (int i = 0; i < count; ++i) {
+            glm::vec3 p = particles[candidates ? candidates[begin + i] : begin + i].getPosition();
+            px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+        }
+        sampleBatch(px, py, pz, distance, nx, ny, nz, count);
+        SignedDistanceField::pushOut(particles, candidates, begin, count, distance, nx, ny, nz, thickness, staticFriction, kineticFriction);
+    });
+}
+
+glm::vec3 AnalyticCollider::extent() const {
+    switch (shape) {
+    case AnalyticShape::Sphere:
+        return glm::vec3(radius);
+    case AnalyticShape::Box:
+        return glm::abs(axis[0]) * halfExtents.x + glm::abs(axis[1]) * halfExtents.y + glm::abs(axis[2]) * halfExtents.z;
+    case AnalyticShape::Capsule:
+        return glm::abs(axis[1]) * halfHeight + glm::vec3(radius);
+    case AnalyticShape::Cylinder:
+        // The cap disks reach radius * sqrt(1 - axis_i^2) along world axis i
+        return glm::abs(axis[1]) * halfHeight + radius * glm::sqrt(glm::max(glm::vec3(0.0f), 1.0f - axis[1] * axis[1]));
+    case AnalyticShape::Plane:
+        break;
+    }
+    return glm::vec3(Unbounded);
+}
+
+glm::vec3 AnalyticCollider::getBoundsMin(float reach) const {
+    glm::vec3 bounds = center - extent() - glm::vec3(reach);
+    if (shape == AnalyticShape::Plane) {
+        for (int k = 0; k < 3; ++k) {
+            if (axis[1][k] == -1.0f) // Solid above a downward normal
+                bounds[k] = center[k] - reach;
+        }
+    }
+    return bounds;
+}
+
+glm::vec3 AnalyticCollider::getBoundsMax(float reach) const {
+    glm::vec3 bounds = center + extent() + glm::vec3(reach);
+    if (shape == AnalyticShape::Plane) {
+        for (int k = 0; k < 3; ++k) {
+            if (axis[1][k] == 1.0f) // Solid below an upward normal, e.g. a floor
+                bounds[k] = center[k] + reach;
+        }
+    }
+    return bounds;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include "Particle.h"
+
+enum class AnalyticShape { Box, Sphere, Capsule, Plane, Cylinder };
+
+// Collider given by a formula instead of geometry: an oriented box, a sphere, a capsule or a capped cylinder
+// (both along their local y axis), or a plane (solid below, along its normal). Distances are exact outside
+// the shape, so the closest point, and with it the normal, is the true one. Particles are projected out
+// in batches: positions in x/y/z arrays, one SIMD loop per shape.
+class AnalyticCollider {
+public:
+    static AnalyticCollider box(const glm::vec3& center, const glm::vec3& halfExtents, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    static AnalyticCollider sphere(const glm::vec3& center, float radius);
+    static AnalyticCollider capsule(const glm::vec3& center, float halfHeight, float radius, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    static AnalyticCollider cylinder(const glm::vec3& center, float halfHeight, float radius, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    static AnalyticCollider plane(const glm::vec3& point, const glm::vec3& normal);
+
+    // Signed distance (negative inside) and outward unit normal of the closest surface point
+    float sample(const glm::vec3& position, glm::vec3& normal) const;
+    void sampleBatch(const float* px, const float* py, const float* pz,
+        float* distance, float* nx, float* ny, float* nz, int count) const;
+
+    // Pushes particles candidates[0 .. candidateCount) (all of them when null) that are closer than
+    // thickness back out along the normal, with friction
+    void resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const;
+
+    AnalyticShape getShape() const { return shape; }
+    glm::vec3 getCenter() const { return center; }
+    // Box around the part of space within reach of the surface or inside; a plane is unbounded except
+    // along its normal when that is a coordinate axis
+    glm::vec3 getBoundsMin(float reach) const;
+    glm::vec3 getBoundsMax(float reach) const;
+
+private:
+    AnalyticShape shape = AnalyticShape::Sphere;
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 axis[3] = { glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) }; // Local axes in world space
+    glm::vec3 halfExtents = glm::vec3(0.0f); // Box
+    float radius = 0.0f;                     // Sphere, capsule, cylinder
+    float halfHeight = 0.0f;                 // Capsule, cylinder: along the local y axis
+
+    static constexpr float Unbounded = 1e30f;
+
+    void setRotation(const glm::quat& rotation);
+    glm::vec3 extent() const; // Half size of the shape's box around its center, per world axis
+};
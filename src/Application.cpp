@@ -1,10 +1,17 @@
 #include "Application.h"
 #include <algorithm>
+#include <limits>
 #include <stdio.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 
+// Optional assets, offered in the UI only when their files are there
+static const char* ModelPath = "../models/backpack/backpack.obj";
+static const char* ModelFieldPath = "../models/backpack/backpack.sdf"; // Caches, written on the first build
+static const char* ModelSparseFieldPath = "../models/backpack/backpack.sdfs";
+static const char* BodyPosePath = "../models/body/walk.pose";
+
 // Error callback function
 static void glfw_error_callback(int error, const char* description)
 {
@@ -68,6 +75,15 @@ bool Application::Init()
     StaticFrictionCoefficient = 0.6f;
     KineticFrictionCoefficient = 0.4f;
 
+    DeterministicMode = false;
+    fixedTimeStep = 1.0f / 60.0f;
+    deterministicSeed = 20240601;
+    simulationStep = 0;
+    stateHash = 0;
+
+    // The turbulence grid only depends on a fixed seed, so it is built once
+    windField.build(deterministicSeed);
+
     lightPos = glm::vec3(0.0f, 1.0f, 1.0f);
     lightColor = { 1.0f, 1.0f, 1.0f };  // White light
 
@@ -102,6 +118,22 @@ bool Application::Init()
     imgui_manager.SetSphere(&SelectSphere);
 
     imgui_manager.SetTexturePath(&filename);
+    imgui_manager.SetDeterministic(&DeterministicMode, &simulationStep, &stateHash);
+    imgui_manager.SetDeterminismCheck(&determinismCheckRequested, &determinismCheck);
+    imgui_manager.SetAerodynamics(&aerodynamics.enabled, &aerodynamics.dragCoefficient, &aerodynamics.liftCoefficient);
+    imgui_manager.SetAirGrid(&airGrid.enabled, &airGrid.resolution, &airGrid.pressureIterations);
+    imgui_manager.SetContinuousCollision(&continuousCollision.enabled, &continuousCollision.thickness);
+    imgui_manager.SetImpactZones(&continuousCollision.impactZones, &continuousCollision.maxIterations,
+        &continuousCollision.zoneCount, &continuousCollision.zoneParticles, &continuousCollision.impactsLeft);
+    imgui_manager.SetBVHMonitor(&bvhRebuilder.enabled, &bvhRebuilder.costThreshold, &bvhRebuilder.quality.sahCost,
+        &bvhRebuilder.baselineCost, &bvhRebuilder.quality.overlap, &bvhRebuilder.rebuildCount);
+    imgui_manager.SetContactCache(&colliders.persistentContacts, &colliders.contactCount, &colliders.reusedCount);
+    imgui_manager.SetBroadphase(&colliders.activeColliders, &colliders.pairCount);
+    imgui_manager.SetColliderAnimation(&AnimateColliders);
+    imgui_manager.SetFloor(&SelectFloor);
+    imgui_manager.SetTearing(&tearing.enabled, &tearing.breakingStrain, &tearing.brokenSprings, &tearing.totalBrokenSprings);
+    imgui_manager.SetClothLayers(&clothLayers, &clothCollision.enabled, &clothCollision.thickness, &clothCollision.contactCount, &layerRebuildCount);
+    imgui_manager.SetPicking(&picker.enabled, &picker.stiffness, &picker.pickTime);
 
     std::cout << "GPU: " << glGetString(GL_RENDERER) << std::endl;
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
@@ -113,9 +145,14 @@ bool Application::Init()
     glEnable(GL_DEPTH_TEST);
     shader = new Shader("VertShader.vert", "FragShader.frag");
     // importedModelShader = new Shader("../shaders/modelVertex.vert", "../shaders/modelFragment.frag");
-    // std::cout << "Loading models" << std::endl;
-       // // load models
-    // ourModel = new Model("../models/backpack/backpack.obj");
+    if (std::ifstream(ModelPath).good()) {
+        std::cout << "Loading model " << ModelPath << std::endl;
+        ourModel = new Model(ModelPath);
+    }
+    if (ourModel)
+        imgui_manager.SetModelCollider(&SelectModel, &ModelColliderKind);
+    if (std::ifstream(BodyPosePath).good())
+        imgui_manager.SetBody(&SelectBody);
 
     SetupOpenGL();
 
@@ -244,22 +281,21 @@ void Application::processInput(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    /*double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
-
-    // Check if the left mouse button is pressed
-    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-        // Get window size
-        int width, height;
-        glfwGetWindowSize(window, &width, &height);
-
-        // Convert to OpenGL normalized device coordinates (NDC)
-        float xNDC = (2.0f * xpos) / width - 1.0f;
-        float yNDC = 1.0f - (2.0f * ypos) / height;
-
-        // Print the OpenGL coordinates to the console
-        std::cout << "Mouse Click at OpenGL Coordinates: (" << xNDC << ", " << yNDC << ")\n";
-    }*/
+    // Picking: a left click on the cloth with the cursor shown grabs a particle, dragging moves it. Clicks
+    // on the UI are left to ImGui.
+    const bool leftDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    glm::vec3 rayOrigin, rayDirection;
+    float rayLength;
+    if (!leftDown || !cursorVisible || !picker.enabled) {
+        picker.release();
+    }
+    else if (!mouseLeftPressed && clothBVH && !ImGui::GetIO().WantCaptureMouse && cursorRay(window, rayOrigin, rayDirection, rayLength)) {
+        picker.pick(*clothBVH, particles, indices, rayOrigin, rayDirection, rayLength, cameraFront);
+    }
+    else if (picker.isDragging() && cursorRay(window, rayOrigin, rayDirection, rayLength)) {
+        picker.drag(rayOrigin, rayDirection, cameraFront);
+    }
+    mouseLeftPressed = leftDown;
 
     //For keyboard movement
     float cameraSpeed = 2.5f * deltaTime; //speed of camera movement
@@ -337,30 +373,30 @@ void Application::processInput(GLFWwindow* window) {
     }
 }
 
-glm::vec3 getRandomWindDirection() {
-    // Creates a random number generator
-    std::random_device rd;
-    std::mt19937 gen(rd());
-
-    // Uniform distribution for azimuthal angle (0 to 2*PI)
-    std::uniform_real_distribution<> azimuthalDist(0.0, 2.0 * glm::pi<float>());
-
-    // Uniform distribution for z component of the vector (cosine of the polar angle)
-    std::uniform_real_distribution<> zDist(-1.0, 1.0);
-
-    // Generates random azimuthal angle (phi)
-    float azimuthalAngle = static_cast<float>(azimuthalDist(gen));
-
-    // Generates random z component
-    float z = static_cast<float>(zDist(gen));
-
-    // Calculates the corresponding x and y components using azimuthal angle and radius (r = sqrt(1 - z^2))
-    float radius = std::sqrt(1.0f - z * z);
-    float x = radius * std::cos(azimuthalAngle);
-    float y = radius * std::sin(azimuthalAngle);
-
-    // Returns the random normalized vector
-    return glm::vec3(x, y, z);
+// Ray from the near plane through the cursor to the far plane, with the camera MainLoop renders with
+bool Application::cursorRay(GLFWwindow* window, glm::vec3& origin, glm::vec3& direction, float& length) const {
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    int width, height, display_w, display_h;
+    glfwGetWindowSize(window, &width, &height);
+    glfwGetFramebufferSize(window, &display_w, &display_h);
+    if (width <= 0 || height <= 0 || display_w <= 0 || display_h <= 0)
+        return false; // Minimized
+
+    // Convert to OpenGL normalized device coordinates (NDC)
+    float xNDC = (2.0f * static_cast<float>(xpos)) / width - 1.0f;
+    float yNDC = 1.0f - (2.0f * static_cast<float>(ypos)) / height;
+
+    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    glm::mat4 projection = glm::perspective(glm::radians(fov), (float)display_w / (float)display_h, 0.1f, 1000.0f);
+    glm::mat4 inverse = glm::inverse(projection * view);
+    glm::vec4 nearPoint = inverse * glm::vec4(xNDC, yNDC, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(xNDC, yNDC, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+    length = glm::length(direction);
+    direction /= length;
+    return true;
 }
 
 void Application::generateFurStrands(const std::vector<Particle>& particles, int column, int row) {
@@ -449,82 +485,299 @@ void Application::setupCloth() {
     float disY = 0.05f; // Distance between particles in y direction
     float initialY = 0.3f; // Y-coordinate for the top pinned particle
     glm::vec3 Offset(-0.5f, 0.0f, 0.0f); // Offset for initial position
+    float layerSpacing = 0.02f; // Between stacked layers, across the cloth
 
     gravity = -0.05f;
 
-    // Wind parameters
-    windDirection = getRandomWindDirection(); // Initial random wind direction
-    windScale = 0.02f; // Base wind strength
-    windOffsetSpeed = 0.1f; // Variability in wind strength
-    windChangeInterval = 0.5f; // Time in seconds to change wind direction
-    windTimer = 0.0f; // Timer for wind direction change
+    // Random streams are seeded once per cloth; deterministic mode always uses the same seed
+    uint64_t seed = DeterministicMode ? deterministicSeed : (static_cast<uint64_t>(std::random_device{}()) << 32 | std::random_device{}());
+    simulationStep = 0;
+    stateHash = 0;
+    tearing.brokenSprings = 0;
+    tearing.removedTriangles = 0;
+    tearing.totalBrokenSprings = 0;
+
+    // Restarts wind direction changes and gusts
+    windField.reset(seed);
+
+    layerParticles = column * row;
+    particles.reserve(layerParticles * clothLayers); // Reserve space to avoid multiple allocations
+
+    // Every layer is the same grid, the next one layerSpacing further along the cloth's normal
+    for (int layer = 0; layer < clothLayers; ++layer) {
+        if (toggleClothOrientation) {
+            // Initialize particles as (x, y, 0)
+            for (int i = 0; i < column; ++i) {
+                for (int j = 0; j < row; ++j) {
+                    float xPos = i * disX + Offset.x;
+                    float yPos = initialY - j * disY; // Starts from initialY and moves downward
+                    bool staticParticle = j == 0; // Top row particles are static
+                    particles.emplace_back(glm::vec3(xPos, yPos, layer * layerSpacing), staticParticle);
+                }
+            }
+        }
+        else {
+            // Initialize particles as (x, 0, z)
+            for (int i = 0; i < column; ++i) {
+                for (int j = 0; j < row; ++j) {
+                    float xPos = i * disX + Offset.x;
+                    float zPos = j * disY; // Use disY for Z direction when orientation is different
+                    bool staticParticle = false; // j == 0; //First row static in this orientation
+                    particles.emplace_back(glm::vec3(xPos, 0.15f + layer * layerSpacing, zPos), staticParticle);
+                }
+            }
+        }
+    }
 
-    particles.reserve(column * row); // Reserve space to avoid multiple allocations
+    for (int layer = 0; layer < clothLayers; ++layer) {
+        Particle* grid = &particles[layer * layerParticles];
 
-    if (toggleClothOrientation) {
-        // Initialize particles as (x, y, 0)
+        // Initialize springs (same for both orientations)
         for (int i = 0; i < column; ++i) {
             for (int j = 0; j < row; ++j) {
-                float xPos = i * disX + Offset.x;
-                float yPos = initialY - j * disY; // Starts from initialY and moves downward
-                bool staticParticle = j == 0; // Top row particles are static
-                particles.emplace_back(glm::vec3(xPos, yPos, 0.0f), staticParticle);
+                // Right edge, avoiding the addition of spring to the right side
+                if (i != column - 1) {
+                    springs.emplace_back(k, disX, &grid[i * row + j], &grid[(i + 1) * row + j]);
+                }
+
+                // Bottom edge, avoiding the addition of spring to the bottom side
+                if (j != row - 1) {
+                    springs.emplace_back(k, disY, &grid[i * row + j], &grid[i * row + (j + 1)]);
+                }
+
+                // Shear springs
+                if (i != column - 1 && j != row - 1) {
+                    springs.emplace_back(shearK, sqrt(disX * disX + disY * disY), &grid[i * row + j], &grid[(i + 1) * row + (j + 1)]);
+                    springs.emplace_back(shearK, sqrt(disX * disX + disY * disY), &grid[(i + 1) * row + j], &grid[i * row + (j + 1)]);
+                }
             }
         }
-    }
-    else {
-        // Initialize particles as (x, 0, z)
+
+        // Bend springs for better cloth draping and resistance to bending
         for (int i = 0; i < column; ++i) {
             for (int j = 0; j < row; ++j) {
-                float xPos = i * disX + Offset.x;
-                float zPos = j * disY; // Use disY for Z direction when orientation is different
-                bool staticParticle = false; // j == 0; //First row static in this orientation
-                particles.emplace_back(glm::vec3(xPos, 0.15f, zPos), staticParticle);
+                // Horizontal bend springs (skip 1 particle)
+                if (i < column - 2) {
+                    springs.emplace_back(bendK, disX * 2,
+                        &grid[i * row + j],
+                        &grid[(i + 2) * row + j]);
+                }
+
+                // Vertical bend springs (skip 1 particle)
+                if (j < row - 2) {
+                    springs.emplace_back(bendK, disY * 2,
+                        &grid[i * row + j],
+                        &grid[i * row + (j + 2)]);
+                }
             }
         }
     }
 
-    // Initialize springs (same for both orientations)
-    for (int i = 0; i < column; ++i) {
-        for (int j = 0; j < row; ++j) {
-            // Right edge, avoiding the addition of spring to the right side
-            if (i != column - 1) {
-                springs.emplace_back(k, disX, &particles[i * row + j], &particles[(i + 1) * row + j]);
-            }
+    buildSpringAdjacency();
+    fitAirGrid();
 
-            // Bottom edge, avoiding the addition of spring to the bottom side
-            if (j != row - 1) {
-                springs.emplace_back(k, disY, &particles[i * row + j], &particles[i * row + (j + 1)]);
-            }
+    setupClothMesh(particles, column, row);
+}
 
-            // Shear springs
-            if (i != column - 1 && j != row - 1) {
-                springs.emplace_back(shearK, sqrt(disX * disX + disY * disY), &particles[i * row + j], &particles[(i + 1) * row + (j + 1)]);
-                springs.emplace_back(shearK, sqrt(disX * disX + disY * disY), &particles[(i + 1) * row + j], &particles[i * row + (j + 1)]);
-            }
+// One BVH per layer, over that layer's triangles only, for the collisions between layers
+void Application::buildLayerBVHs() {
+    layerBVHs.clear();
+    layerRebuilders.clear();
+    layerRebuildCount = 0;
+    layerTriangles.clear();
+    layerIndices.clear();
+    triangleInLayer.clear();
+    if (clothLayers < 2)
+        return;
+
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    layerTriangles.resize(clothLayers);
+    triangleInLayer.resize(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        std::vector<uint32_t>& members = layerTriangles[indices[3 * t] / layerParticles];
+        triangleInLayer[t] = static_cast<uint32_t>(members.size());
+        members.push_back(t);
+    }
+
+    layerIndices.resize(clothLayers);
+    layerRebuilders.resize(clothLayers);
+    for (int layer = 0; layer < clothLayers; ++layer) {
+        for (uint32_t t : layerTriangles[layer])
+            layerIndices[layer].insert(layerIndices[layer].end(), &indices[3 * t], &indices[3 * t] + 3);
+        // Queried every step and rebuilt only once refits have worn it down: the slower, better tree pays
+        // off, and its rebuilds run in the background
+        layerBVHs.emplace_back(new BVH(particles, layerIndices[layer], BVHBuilder::SAH));
+        layerRebuilders[layer].builder = BVHBuilder::SAH;
+        layerRebuilders[layer].reset(*layerBVHs[layer]);
+    }
+}
+
+// Every layer against every layer above it, on the positions the step ends with
+void Application::resolveLayerCollisions() {
+    layerRebuildCount = 0;
+    for (size_t layer = 0; layer < layerBVHs.size(); ++layer) {
+        layerBVHs[layer]->refit(simulationStep);
+        BVHRebuilder& rebuilder = layerRebuilders[layer];
+        rebuilder.enabled = bvhRebuilder.enabled;
+        rebuilder.costThreshold = bvhRebuilder.costThreshold;
+        BVH* tree = layerBVHs[layer].release();
+        rebuilder.update(tree, particles, layerIndices[layer], simulationStep, DeterministicMode);
+        layerBVHs[layer].reset(tree);
+        layerRebuildCount += rebuilder.rebuildCount;
+    }
+    int contacts = 0;
+    for (size_t a = 0; a < layerBVHs.size(); ++a) {
+        for (size_t b = a + 1; b < layerBVHs.size(); ++b)
+            contacts += clothCollision.resolve(particles, *layerBVHs[a], *layerBVHs[b]);
+    }
+    clothCollision.contactCount = contacts;
+}
+
+// Places the air grid around the cloth at the currently selected resolution
+void Application::fitAirGrid() {
+    glm::vec3 clothMin(std::numeric_limits<float>::max());
+    glm::vec3 clothMax(-std::numeric_limits<float>::max());
+    for (const auto& particle : particles) {
+        clothMin = glm::min(clothMin, particle.getPosition());
+        clothMax = glm::max(clothMax, particle.getPosition());
+    }
+    airGrid.fit(clothMin, clothMax);
+    airGridResolution = airGrid.resolution;
+}
+
+void Application::buildSpringAdjacency() {
+    const int particleCount = static_cast<int>(particles.size());
+    springForces.assign(springs.size(), glm::vec3(0.0f));
+    springAdjacencyStart.assign(particleCount + 1, 0);
+
+    // Count springs per particle, then prefix sum
+    for (const auto& spring : springs) {
+        springAdjacencyStart[spring.getP1() - particles.data() + 1]++;
+        springAdjacencyStart[spring.getP2() - particles.data() + 1]++;
+    }
+    for (int i = 0; i < particleCount; ++i)
+        springAdjacencyStart[i + 1] += springAdjacencyStart[i];
+
+    // Filled in spring order, so gathering reproduces the order of the serial spring loop
+    springAdjacency.resize(springAdjacencyStart[particleCount]);
+    std::vector<int> cursor(springAdjacencyStart.begin(), springAdjacencyStart.end() - 1);
+    for (int s = 0; s < static_cast<int>(springs.size()); ++s) {
+        springAdjacency[cursor[springs[s].getP2() - particles.data()]++] = s << 1;
+        springAdjacency[cursor[springs[s].getP1() - particles.data()]++] = (s << 1) | 1;
+    }
+    springAdjacencyEnd.assign(springAdjacencyStart.begin() + 1, springAdjacencyStart.end());
+}
+
+void Application::buildVertexFaceAdjacency() {
+    const int vertexCount = static_cast<int>(vertices.size());
+    vertexFaceStart.assign(vertexCount + 1, 0);
+    for (GLuint index : indices)
+        vertexFaceStart[index + 1]++;
+    for (int i = 0; i < vertexCount; ++i)
+        vertexFaceStart[i + 1] += vertexFaceStart[i];
+
+    vertexFaces.resize(indices.size());
+    std::vector<int> cursor(vertexFaceStart.begin(), vertexFaceStart.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        vertexFaces[cursor[indices[i]]++] = static_cast<int>(i / 3);
+    vertexFaceEnd.assign(vertexFaceStart.begin() + 1, vertexFaceStart.end());
+}
+
+// Breaks the given springs (in spring order) and removes every triangle one of them was an edge of
+void Application::tearCloth(const std::vector<int>& broken) {
+    // An edge's triangles are among the faces around either end
+    tornTriangles.clear();
+    for (int s : broken) {
+        const int a = static_cast<int>(springs[s].getP1() - particles.data());
+        const GLuint b = static_cast<GLuint>(springs[s].getP2() - particles.data());
+        for (int f = vertexFaceStart[a]; f < vertexFaceEnd[a]; ++f) {
+            const GLuint* triangle = &indices[3 * vertexFaces[f]];
+            if (triangle[0] == b || triangle[1] == b || triangle[2] == b)
+                tornTriangles.push_back(vertexFaces[f]);
         }
     }
+    std::sort(tornTriangles.begin(), tornTriangles.end());
+    tornTriangles.erase(std::unique(tornTriangles.begin(), tornTriangles.end()), tornTriangles.end());
+
+    // Highest index first, so what moves into a freed index is never something still to be removed
+    for (auto s = broken.rbegin(); s != broken.rend(); ++s)
+        removeSpring(*s);
+    for (auto t = tornTriangles.rbegin(); t != tornTriangles.rend(); ++t)
+        removeTriangle(*t);
+
+    tearing.brokenSprings = static_cast<int>(broken.size());
+    tearing.removedTriangles = static_cast<int>(tornTriangles.size());
+    tearing.totalBrokenSprings += tearing.brokenSprings;
+}
 
-    // Bend springs for better cloth draping and resistance to bending
-    for (int i = 0; i < column; ++i) {
-        for (int j = 0; j < row; ++j) {
-            // Horizontal bend springs (skip 1 particle)
-            if (i < column - 2) {
-                springs.emplace_back(bendK, disX * 2,
-                    &particles[i * row + j],
-                    &particles[(i + 2) * row + j]);
-            }
+void Application::removeSpring(int spring) {
+    const int last = static_cast<int>(springs.size()) - 1;
+    const int p1 = static_cast<int>(springs[spring].getP1() - particles.data());
+    const int p2 = static_cast<int>(springs[spring].getP2() - particles.data());
+    ClothTearing::eraseEntry(springAdjacency, springAdjacencyStart[p1], springAdjacencyEnd[p1], (spring << 1) | 1);
+    ClothTearing::eraseEntry(springAdjacency, springAdjacencyStart[p2], springAdjacencyEnd[p2], spring << 1);
+
+    if (spring != last) {
+        const int q1 = static_cast<int>(springs[last].getP1() - particles.data());
+        const int q2 = static_cast<int>(springs[last].getP2() - particles.data());
+        ClothTearing::replaceEntry(springAdjacency, springAdjacencyStart[q1], springAdjacencyEnd[q1], (last << 1) | 1, (spring << 1) | 1);
+        ClothTearing::replaceEntry(springAdjacency, springAdjacencyStart[q2], springAdjacencyEnd[q2], last << 1, spring << 1);
+        springs[spring] = springs[last];
+        springForces[spring] = springForces[last];
+    }
+    springs.pop_back();
+    springForces.pop_back();
+}
 
-            // Vertical bend springs (skip 1 particle)
-            if (j < row - 2) {
-                springs.emplace_back(bendK, disY * 2,
-                    &particles[i * row + j],
-                    &particles[i * row + (j + 2)]);
-            }
+void Application::removeTriangle(int triangle) {
+    const int last = static_cast<int>(indices.size() / 3) - 1;
+    for (int k = 0; k < 3; ++k) {
+        const GLuint v = indices[3 * triangle + k];
+        ClothTearing::eraseEntry(vertexFaces, vertexFaceStart[v], vertexFaceEnd[v], triangle);
+    }
+
+    // Per-face data follows the triangles, so this step's aerodynamic forces still land on the right faces
+    auto follow = [&](auto& faceData) {
+        if (faceData.size() != static_cast<size_t>(last + 1))
+            return;
+        faceData[triangle] = faceData[last];
+        faceData.pop_back();
+    };
+    follow(faceNormals);
+    follow(faceAreas);
+    follow(faceForces);
+
+    // The layer's BVH makes the same swap-remove over the layer's own triangles, then the triangle moving
+    // into the freed index is renumbered in its layer's list
+    if (!layerBVHs.empty()) {
+        const int layer = static_cast<int>(indices[3 * triangle]) / layerParticles;
+        std::vector<uint32_t>& members = layerTriangles[layer];
+        const uint32_t local = triangleInLayer[triangle];
+        layerBVHs[layer]->removeTriangle(local);
+        std::vector<GLuint>& localIndices = layerIndices[layer];
+        std::copy(localIndices.end() - 3, localIndices.end(), localIndices.begin() + 3 * local);
+        localIndices.resize(localIndices.size() - 3);
+        members[local] = members.back();
+        triangleInLayer[members[local]] = local;
+        members.pop_back();
+        if (triangle != last) {
+            triangleInLayer[triangle] = triangleInLayer[last];
+            layerTriangles[indices[3 * last] / layerParticles][triangleInLayer[triangle]] = triangle;
         }
+        triangleInLayer.pop_back();
     }
 
-    setupClothMesh(particles, column, row);
+    if (triangle != last) {
+        for (int k = 0; k < 3; ++k) {
+            const GLuint v = indices[3 * last + k];
+            ClothTearing::replaceEntry(vertexFaces, vertexFaceStart[v], vertexFaceEnd[v], last, triangle);
+            indices[3 * triangle + k] = v;
+        }
+        changedTriangles.push_back(triangle);
+    }
+    indices.resize(3 * last);
+    if (clothBVH)
+        clothBVH->removeTriangle(triangle);
 }
 
 
@@ -541,38 +794,47 @@ void Application::setupClothMesh(const std::vector<Particle>& particles, int col
     // Store particle positions as vertices
     vertices.reserve(particles.size());
     texCoords.reserve(particles.size()); // Reserve space for texture coordinates
-    for (int i = 0; i < column; ++i) {
-        for (int j = 0; j < row; ++j) {
-            int idx = i * row + j;
-            vertices.push_back(particles[idx].getPosition());
-
-            // Calculate texture coordinates based on grid position
-            float u = static_cast<float>(i) / (column - 1);
-            float v = static_cast<float>(j) / (row - 1);
-            texCoords.push_back(glm::vec2(u, v));
-        }
+    for (int idx = 0; idx < static_cast<int>(particles.size()); ++idx) {
+        vertices.push_back(particles[idx].getPosition());
+
+        // Calculate texture coordinates based on grid position, the same for every layer
+        int i = idx % (column * row) / row;
+        int j = idx % row;
+        float u = static_cast<float>(i) / (column - 1);
+        float v = static_cast<float>(j) / (row - 1);
+        texCoords.push_back(glm::vec2(u, v));
     }
 
-    // Generate the indices for triangles between neighboring particles
-    indices.reserve((column - 1) * (row - 1) * 6);
-    for (int i = 0; i < column - 1; ++i) {
-        for (int j = 0; j < row - 1; ++j) {
-            // Top-left triangle (CCW)
-            indices.push_back(i * row + j);
-            indices.push_back(i * row + (j + 1)); // Changed
-            indices.push_back((i + 1) * row + j); // Changed
-
-            // Bottom-right triangle (CCW)
-            indices.push_back((i + 1) * row + (j + 1));
-            indices.push_back((i + 1) * row + j); // Changed
-            indices.push_back(i * row + (j + 1)); // Changed
+    // Generate the indices for triangles between neighboring particles, layer after layer
+    const int layers = static_cast<int>(particles.size()) / (column * row);
+    indices.reserve((column - 1) * (row - 1) * 6 * layers);
+    for (int layer = 0; layer < layers; ++layer) {
+        const GLuint base = layer * column * row;
+        for (int i = 0; i < column - 1; ++i) {
+            for (int j = 0; j < row - 1; ++j) {
+                // Top-left triangle (CCW)
+                indices.push_back(base + i * row + j);
+                indices.push_back(base + i * row + (j + 1)); // Changed
+                indices.push_back(base + (i + 1) * row + j); // Changed
+
+                // Bottom-right triangle (CCW)
+                indices.push_back(base + (i + 1) * row + (j + 1));
+                indices.push_back(base + (i + 1) * row + j); // Changed
+                indices.push_back(base + i * row + (j + 1)); // Changed
+            }
         }
     }
 
+    buildVertexFaceAdjacency();
     calculateNormals();
+    changedTriangles.clear();
 
     // Generate BVH for the cloth
-    clothBVH = new BVH(particles, indices);
+    delete clothBVH;
+    clothBVH = new BVH(particles, indices, BVHBuilder::LBVH);
+    bvhRebuilder.reset(*clothBVH);
+    colliders.clearContacts();
+    buildLayerBVHs();
 
     if (ShowFur) {
         // Setup for fur
@@ -694,30 +956,36 @@ void Application::TextureSetup() {
 }
 
 void Application::calculateNormals() {
-    normals.resize(vertices.size(), glm::vec3(0.0f));
-#pragma omp parallel for
-    for (int i = 0; i < indices.size(); i += 3) {
-        glm::vec3 v0 = vertices[indices[i]];
-        glm::vec3 v1 = vertices[indices[i + 1]];
-        glm::vec3 v2 = vertices[indices[i + 2]];
+    const int triangleCount = static_cast<int>(indices.size() / 3);
+    faceNormals.resize(triangleCount);
+    faceAreas.resize(triangleCount);
+    normals.resize(vertices.size());
+
+    // Face normals and areas (reused by the aerodynamic wind), one writer per triangle
+    Parallel::forEach(triangleCount, [&](int t) {
+        glm::vec3 v0 = vertices[indices[3 * t]];
+        glm::vec3 v1 = vertices[indices[3 * t + 1]];
+        glm::vec3 v2 = vertices[indices[3 * t + 2]];
 
         glm::vec3 edge1 = v1 - v0;
         glm::vec3 edge2 = v2 - v0;
-        glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
-
-        normals[indices[i]] += normal;
-        normals[indices[i + 1]] += normal;
-        normals[indices[i + 2]] += normal;
-    }
-
-    // Normalize normals
-#pragma omp parallel for
-    for (auto& normal : normals) {
-        normal = glm::normalize(normal);
-    }
+        glm::vec3 cross = glm::cross(edge1, edge2);
+        float length = glm::length(cross);
+        faceNormals[t] = length > 0.0f ? cross / length : glm::vec3(0.0f);
+        faceAreas[t] = 0.5f * length;
+    });
+
+    // Each vertex sums its own faces in a fixed order instead of triangles scattering into shared normals
+    Parallel::forEach(static_cast<int>(normals.size()), [&](int v) {
+        glm::vec3 normal(0.0f);
+        for (int a = vertexFaceStart[v]; a < vertexFaceEnd[v]; ++a)
+            normal += faceNormals[vertexFaces[a]];
+        if (normal != glm::vec3(0.0f)) // A vertex torn free of every triangle keeps its last normal
+            normals[v] = glm::normalize(normal);
+    });
 }
 
-void Application::renderClothMesh(GLuint shaderProgram, const std::vector<Particle>& particles, const glm::mat4& view, const glm::mat4& projection) {
+void Application::renderClothMesh(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection) {
     glUseProgram(shaderProgram);
 
     // Set model, view, projection matrices
@@ -729,11 +997,8 @@ void Application::renderClothMesh(GLuint shaderProgram, const std::vector<Partic
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-    // Update particle positions in the vertex buffer
+    // Upload particle positions; stepSimulation already wrote them into vertices during integration
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    for (int i = 0; i < particles.size(); ++i) {
-        vertices[i] = particles[i].getPosition();  // Update vertex positions
-    }
     glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(glm::vec3), &vertices[0]);
 
     calculateNormals();
@@ -742,6 +1007,25 @@ void Application::renderClothMesh(GLuint shaderProgram, const std::vector<Partic
     glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
     glBufferSubData(GL_ARRAY_BUFFER, 0, normals.size() * sizeof(glm::vec3), &normals[0]);
 
+    // Triangles rewritten by tearing, one upload per run of nearby triangles. The buffer keeps its size,
+    // only the first indices.size() entries are drawn.
+    if (!changedTriangles.empty()) {
+        std::sort(changedTriangles.begin(), changedTriangles.end());
+        const GLuint triangleCount = static_cast<GLuint>(indices.size() / 3);
+        glBindVertexArray(VAO); // The element buffer binding belongs to the VAO
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        for (size_t i = 0; i < changedTriangles.size() && changedTriangles[i] < triangleCount;) {
+            const GLuint first = changedTriangles[i];
+            GLuint end = first + 1;
+            // A few unchanged triangles in between cost less than another call
+            while (++i < changedTriangles.size() && changedTriangles[i] < triangleCount && changedTriangles[i] <= end + 8)
+                end = changedTriangles[i] + 1;
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 3 * first * sizeof(GLuint), 3 * (end - first) * sizeof(GLuint), &indices[3 * first]);
+        }
+        glBindVertexArray(0);
+        changedTriangles.clear();
+    }
+
     if (ShowFur) {
         // Precompute random offsets for fur strands
         static std::vector<glm::vec3> randomOffsets;
@@ -754,18 +1038,28 @@ void Application::renderClothMesh(GLuint shaderProgram, const std::vector<Partic
             }
         }
 
-        // Generate fur vertices and indices
-        furVertices.clear();
-        furIndices.clear();
-        furTexCoords.clear();
-        furLengths.clear();
-
         float furDensity = 0.15f; // Distance between fur base points
         int furLayers = 10; // Number of layers for the fur
         float furLength = 0.025f; // Length of each fur strand
 
-#pragma omp parallel for
-        for (int i = 0; i < indices.size(); i += 3) {
+        // Barycentric coordinates of the strand bases, the same for every triangle
+        std::vector<glm::vec2> strandBases;
+        for (float u = 0.0f; u <= 1.0f; u += furDensity) {
+            for (float v = 0.0f; v <= (1.0f - u); v += furDensity)
+                strandBases.emplace_back(u, v);
+        }
+
+        // Every strand has its own slots, triangle by triangle in order, so the triangles are built in
+        // parallel and each strand's line segments join its own vertices
+        const int triangleCount = static_cast<int>(indices.size() / 3);
+        const int strands = static_cast<int>(strandBases.size());
+        furVertices.resize(static_cast<size_t>(triangleCount) * strands * furLayers);
+        furTexCoords.resize(furVertices.size());
+        furLengths.resize(furVertices.size());
+        furIndices.resize(static_cast<size_t>(triangleCount) * strands * (furLayers - 1) * 2);
+
+        Parallel::forEach(triangleCount, [&](int triangle) {
+            const int i = 3 * triangle;
             // Get the three vertices of the triangle
             glm::vec3 v0 = vertices[indices[i]];
             glm::vec3 v1 = vertices[indices[i + 1]];
@@ -780,45 +1074,39 @@ void Application::renderClothMesh(GLuint shaderProgram, const std::vector<Partic
             glm::vec3 edge2 = v2 - v0;
             glm::vec3 normal = glm::normalize(glm::cross(edge1, edge2));
 
-            // Generate interpolated points across the triangle
-            for (float u = 0.0f; u <= 1.0f; u += furDensity) {
-                for (float v = 0.0f; v <= (1.0f - u); v += furDensity) {
-                    // Barycentric coordinates
-                    const float w = 1.0f - u - v;
-
-                    // Barycentric interpolation to get the base point
-                    glm::vec3 basePoint = v0 * w + v1 * u + v2 * v;
-
-                    // Texture coordinate interpolation
-                    glm::vec2 baseTexCoord = t0 * w + t1 * u + t2 * v;
-
-                    // Generate fur strands along the normal
-                    int baseIndex = furVertices.size();
-
-                    // Generate fur strands along the normal
-                    for (int layer = 0; layer < furLayers; ++layer) {
-                        float t = static_cast<float>(layer) / furLayers;
-                        glm::vec3 furPos = basePoint + normal * furLength * t;
-
-                        // Add precomputed randomness to the fur direction
-                        furPos += randomOffsets[(i / 3) * furLayers + layer] * t;
-
-#pragma omp critical
-                        {
-                            furVertices.push_back(furPos);
-                            furTexCoords.push_back(baseTexCoord);
-                            furLengths.push_back(t);
-
-                            // Connect fur strands to the base point
-                            if (layer > 0) {
-                                furIndices.push_back(furVertices.size() - 2);
-                                furIndices.push_back(furVertices.size() - 1);
-                            }
-                        }
+            for (int strand = 0; strand < strands; ++strand) {
+                // Barycentric coordinates
+                const float u = strandBases[strand].x, v = strandBases[strand].y;
+                const float w = 1.0f - u - v;
+
+                // Barycentric interpolation to get the base point
+                glm::vec3 basePoint = v0 * w + v1 * u + v2 * v;
+
+                // Texture coordinate interpolation
+                glm::vec2 baseTexCoord = t0 * w + t1 * u + t2 * v;
+
+                // Generate fur strands along the normal
+                const size_t baseIndex = (static_cast<size_t>(triangle) * strands + strand) * furLayers;
+                GLuint* strandIndices = &furIndices[(static_cast<size_t>(triangle) * strands + strand) * (furLayers - 1) * 2];
+                for (int layer = 0; layer < furLayers; ++layer) {
+                    float t = static_cast<float>(layer) / furLayers;
+                    glm::vec3 furPos = basePoint + normal * furLength * t;
+
+                    // Add precomputed randomness to the fur direction
+                    furPos += randomOffsets[triangle * furLayers + layer] * t;
+
+                    furVertices[baseIndex + layer] = furPos;
+                    furTexCoords[baseIndex + layer] = baseTexCoord;
+                    furLengths[baseIndex + layer] = t;
+
+                    // Connect fur strands to the base point
+                    if (layer > 0) {
+                        strandIndices[2 * (layer - 1)] = static_cast<GLuint>(baseIndex + layer - 1);
+                        strandIndices[2 * (layer - 1) + 1] = static_cast<GLuint>(baseIndex + layer);
                     }
                 }
             }
-        }
+        });
 
         // Calculate fur normals (same as cloth triangle normals)
         std::vector<glm::vec3> furNormals;
@@ -979,6 +1267,97 @@ void Application::renderClothMesh(GLuint shaderProgram, const std::vector<Partic
     glUseProgram(0);
 }
 
+// Adds or removes the UI's colliders to match the checkboxes
+void Application::updateColliders()
+{
+    bool newCollider = false;
+    if (SelectCube != colliders.contains(cubeCollider)) {
+        colliders.remove(cubeCollider);
+        cubeCollider = -1;
+        if (SelectCube) {
+            auto cube = std::make_unique<Object>();
+            cube->SetupCube(0.4f, glm::vec3(0.0f, -0.2f, 0.5f));
+            cubeCollider = colliders.add(std::move(cube));
+            newCollider = true;
+        }
+    }
+    if (SelectSphere != colliders.contains(sphereCollider)) {
+        colliders.remove(sphereCollider);
+        sphereCollider = -1;
+        if (SelectSphere) {
+            auto sphere = std::make_unique<Object>();
+            sphere->SetupSphere(0.3f, glm::vec3(0.0f, -0.2f, 0.5f));
+            sphereCollider = colliders.add(std::move(sphere));
+            newCollider = true;
+        }
+    }
+    if (SelectFloor != colliders.contains(floorCollider)) {
+        colliders.remove(floorCollider);
+        floorCollider = -1;
+        if (SelectFloor) // Not drawn: an infinite plane under the colliders
+            floorCollider = colliders.add(std::make_unique<AnalyticCollider>(AnalyticCollider::plane(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f))));
+    }
+    const bool wantModel = SelectModel && ourModel;
+    if (wantModel != colliders.contains(modelCollider) || (wantModel && ModelColliderKind != modelColliderAdded)) {
+        colliders.remove(modelCollider);
+        modelCollider = -1;
+        if (wantModel) {
+            // Built here, once, and kept while the model stays selected as the same kind. The distance
+            // fields come from their cache files after the first build, and are not drawn.
+            if (ModelColliderKind == 1) {
+                modelCollider = colliders.add(ourModel->buildSignedDistanceField(ModelFieldPath, 128));
+            } else if (ModelColliderKind == 2) {
+                modelCollider = colliders.add(ourModel->buildSparseDistanceField(ModelSparseFieldPath, 1024));
+            } else {
+                std::vector<glm::vec3> meshPositions;
+                std::vector<GLuint> meshIndices;
+                ourModel->getCollisionMesh(meshPositions, meshIndices);
+                auto mesh = std::make_unique<Object>();
+                mesh->SetupMesh(meshPositions, meshIndices);
+                modelCollider = colliders.add(std::move(mesh));
+            }
+            modelColliderAdded = ModelColliderKind;
+        }
+    }
+    if (SelectBody != colliders.contains(bodyCollider)) {
+        colliders.remove(bodyCollider);
+        bodyCollider = -1;
+        if (SelectBody) {
+            // Not drawn: walks on its pose stream from the collider clock's current time. -1 (and the
+            // checkbox cleared) when the file cannot be read after all.
+            bodyCollider = colliders.add(CapsuleChain::open(BodyPosePath));
+            SelectBody = bodyCollider >= 0;
+        }
+    }
+
+    // The sphere swings through where the cloth hangs, the cube spins and pulses; both fast enough to pass
+    // through the cloth in a step or two without the continuous test
+    if (AnimateColliders != collidersAnimated || (AnimateColliders && newCollider)) {
+        ColliderAnimation swing, spin;
+        if (AnimateColliders) {
+            ColliderTransform pose;
+            swing.addKeyframe(0.0f, pose);
+            pose.translation = glm::vec3(0.4f, 0.15f, 0.0f);
+            swing.addKeyframe(0.5f, pose);
+            pose.translation = glm::vec3(0.0f);
+            swing.addKeyframe(1.0f, pose);
+            pose.translation = glm::vec3(-0.4f, 0.15f, 0.0f);
+            swing.addKeyframe(1.5f, pose);
+            pose.translation = glm::vec3(0.0f);
+            swing.addKeyframe(2.0f, pose);
+            spin.setScript([](float time) {
+                ColliderTransform pose;
+                pose.rotation = glm::angleAxis(2.0f * time, glm::normalize(glm::vec3(0.3f, 1.0f, 0.0f)));
+                pose.scale = 1.0f + 0.25f * std::sin(3.0f * time);
+                return pose;
+            });
+        }
+        colliders.setAnimation(sphereCollider, swing);
+        colliders.setAnimation(cubeCollider, spin);
+        collidersAnimated = AnimateColliders;
+    }
+}
+
 // Main rendering loop
 void Application::MainLoop()
 {
@@ -992,21 +1371,7 @@ void Application::MainLoop()
     while (!glfwWindowShouldClose(window))
     {
 
-        if (SelectCube) {
-            if (!currentObject || currentObject->objectType != ObjectType::Cube) {
-                currentObject = std::make_unique<Object>();
-                currentObject->SetupCube(0.4f, glm::vec3(0.0f, -0.2f, 0.5f));
-            }
-        }
-        else if (SelectSphere) {
-            if (!currentObject || currentObject->objectType != ObjectType::Sphere) {
-                currentObject = std::make_unique<Object>();
-                currentObject->SetupSphere(0.3f, glm::vec3(0.0f, -0.2f, 0.5f));
-            }
-        }
-        else {
-            currentObject.reset(); // Destroy if no selection
-        }
+        updateColliders();
 
         bool should_close = false;
         //for variable speed of movement
@@ -1018,11 +1383,13 @@ void Application::MainLoop()
 
         // Check if cloth needs to be reset due to orientation toggle
         if (clothNeedsReset) {
-            particles.clear();  // Clear previous particles
-            springs.clear();    // Clear previous springs
-            setupCloth();       // Re-setup the cloth with the new orientation
+            resetCloth();       // Re-setup the cloth with the new orientation
             clothNeedsReset = false;  // Reset the flag
         }
+        if (determinismCheckRequested) {
+            checkDeterminism(DeterminismCheckSteps);
+            determinismCheckRequested = false;
+        }
 
         glfwPollEvents();
         imgui_manager.BeginFrame();
@@ -1073,75 +1440,35 @@ void Application::MainLoop()
         // ourModel->Draw(*importedModelShader, imgui_manager.wireframeMode);
 
         if (StartSimulation) {
-            // Update to the wind direction periodically
-            windTimer += deltaTime;
-            if (windTimer >= windChangeInterval) {
-                windDirection = getRandomWindDirection(); //Randomizes the wind direction
-                windTimer = 0.0f; //Timer reset
-            }
-
-
-            clothBVH->refit();
-            //std::cout << " Without BVH: " << NewCollision::collisionChecks << "\n";
-            //std::cout << " - With BVH: " << NewCollision::bvhCollisionChecks << "\n";
-            if(currentObject)
-                NewCollision::resolveCollision(particles, clothBVH, indices, *currentObject, deltaTime, collidingIndices, StaticFrictionCoefficient, KineticFrictionCoefficient);
-            //NewCollision::resolveCollisionWithOutBVH(particles, indices, Sphere, deltaTime, collidingIndices);
-
-            for (auto& particle : particles) {
-                //resolveCollision(particle, Cube   );
-                //for (int i = 0; i < 20; ++i) {
-                    // Collision::resolveCollision(particle, Sphere, deltaTime);
-                //}
-
-                Collision::resolveSelfCollision(particle, particles); // Check self-collision
-
-                if (toggle_wind) {
-                    //Generates a random wind strength factor between -windOffsetSpeed and windOffsetSpeed
-                    float noise = windScale + ((static_cast<float>(rand()) / RAND_MAX) * 2.0f - 1.0f) * windOffsetSpeed;
-                    // Add turbulence and noise to wind
-                    float turbulence = sin(windTimer * 2.0f) * 0.1f;
-                    glm::vec3 windVariation = glm::vec3(
-                        turbulence * sin(particle.getPosition().x),
-                        turbulence * cos(particle.getPosition().y),
-                        turbulence * sin(particle.getPosition().z)
-                    );
-                    glm::vec3 wind = windDirection * noise + windVariation;
-                    particle.applyForce(wind);
-                }
-
-                particle.applyForce(glm::vec3(0.0f, gravity, 0.0f)); // Apply gravity
-                particle.update(deltaTime);
-                if(ShowParticle)
-                    particle.render(shader->shaderProgram, view, projection);
-            }
-
-            // Update and render springs
-            for (auto& spring : springs) {
-                spring.update();
-                if(ShowSpring)
-                    spring.render(shader->shaderProgram, model, view, projection);
+            // Deterministic runs ignore the frame time so every run takes the same steps
+            stepSimulation(DeterministicMode ? fixedTimeStep : deltaTime);
+        }
+        else {
+            // Dragging a paused cloth moves the particle and what is drawn, and nothing else
+            const int dragged = picker.place(particles);
+            if (dragged >= 0) {
+                if (vertices.size() == particles.size())
+                    vertices[dragged] = particles[dragged].getPosition();
+                for (int a = vertexFaceStart[dragged]; a < vertexFaceEnd[dragged]; ++a)
+                    picker.markMoved(static_cast<uint32_t>(vertexFaces[a]));
             }
         }
         glm::vec3 color = glm::vec3(1.0f, 0.0f, 0.0f);
 
-        if (!StartSimulation) {
-            for (auto& particle : particles) {
-                if (ShowParticle)
-                    particle.render(shader->shaderProgram, view, projection);
-            }
+        for (auto& particle : particles) {
+            if (ShowParticle)
+                particle.render(shader->shaderProgram, view, projection);
+        }
 
-            for (auto& spring : springs) {
-                if (ShowSpring)
-                    spring.render(shader->shaderProgram, model, view, projection);
-            }
+        for (auto& spring : springs) {
+            if (ShowSpring)
+                spring.render(shader->shaderProgram, model, view, projection);
         }
 
         //Cube.render(shader->shaderProgram, view, projection, lightPos, cameraPos, color);
-        if(currentObject)
-            currentObject->render(shader->shaderProgram, view, projection, lightPos, cameraPos, color);
+        colliders.render(shader->shaderProgram, view, projection, lightPos, cameraPos, color);
 
-        renderClothMesh(shader->shaderProgram, particles, view, projection);
+        renderClothMesh(shader->shaderProgram, view, projection);
         // table->Draw(shader->shaderProgram, glm::mat4(1.0f), view, projection);
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -1156,6 +1483,191 @@ void Application::MainLoop()
     }
 }
 
+void Application::stepSimulation(float dt) {
+    // Scrolls the turbulence and changes the wind direction periodically
+    windField.update(dt);
+
+    // The only plain refit of this step, shared by every query below
+    clothBVH->refit(simulationStep);
+    picker.clearMoved(); // Back in their boxes
+    // Swaps in a background rebuild once refits have worn the tree down
+    bvhRebuilder.update(clothBVH, particles, indices, simulationStep, DeterministicMode);
+    //std::cout << " Without BVH: " << NewCollision::collisionChecks << "\n";
+    //std::cout << " - With BVH: " << NewCollision::bvhCollisionChecks << "\n";
+    // Animated colliders move to this step's pose, then broadphase against the cloth BVH's subtrees over
+    // their swept boxes, and each collider's narrowphase on its overlaps only
+    colliders.advance(dt);
+    colliders.resolve(particles, *clothBVH, StaticFrictionCoefficient, KineticFrictionCoefficient);
+    //NewCollision::resolveCollisionWithOutBVH(particles, indices, Sphere, StaticFrictionCoefficient, KineticFrictionCoefficient);
+
+    // Self-collision against nearby particles only, found through the spatial hash
+    Collision::resolveSelfCollision(particles, selfCollisionGrid, springs, springAdjacencyStart, springAdjacencyEnd, springAdjacency, selfCollisionCorrections);
+
+    // Air grid: the cloth pushes the air, then the air is advected and projected
+    const bool useAirGrid = airGrid.enabled && !particles.empty();
+    if (useAirGrid) {
+        if (airGrid.resolution != airGridResolution)
+            fitAirGrid();
+        else if (!clothBVH->empty()) // The root box is this step's cloth bounds
+            airGrid.follow(clothBVH->nodes[0].min, clothBVH->nodes[0].max);
+        airGrid.step(dt, particles, toggle_wind ? &windField : nullptr);
+    }
+
+    // Aerodynamic wind: one pass over the triangles using the normals and areas from the last render
+    const uint64_t step = simulationStep;
+    const bool faceWind = (toggle_wind || useAirGrid) && aerodynamics.enabled && faceNormals.size() * 3 == indices.size();
+    if (faceWind)
+        aerodynamics.computeFaceForces(particles, indices, faceNormals, faceAreas, windField, useAirGrid ? &airGrid : nullptr, step, dt, faceForces);
+
+    // Spring forces from the current (post-collision) positions, one writer per spring. With tearing on,
+    // the same pass counts the springs stretched past the breaking strain.
+    if (tearing.enabled && !clothBVH->tracksRemovals()) {
+        // Once, when tearing is switched on, so no tear pays for it
+        clothBVH->trackRemovals();
+        for (auto& tree : layerBVHs)
+            tree->trackRemovals();
+    }
+    int* snapped = tearing.enabled ? tearing.beginCount(static_cast<int>(springs.size())) : nullptr;
+    Parallel::forBlocks(static_cast<int>(springs.size()), [&](int begin, int end) {
+        int count = 0;
+        for (int s = begin; s < end; ++s) {
+            springForces[s] = springs[s].computeForce();
+            count += snapped && tearing.snaps(springs[s]) ? 1 : 0;
+        }
+        if (snapped)
+            snapped[begin / Parallel::BlockSize] = count;
+    });
+
+    // Broken springs go before the forces are gathered, so they no longer pull, and take the triangles
+    // along them with them
+    tearing.brokenSprings = tearing.removedTriangles = 0;
+    if (snapped) {
+        const std::vector<int>& broken = tearing.collectBroken(springs);
+        if (!broken.empty())
+            tearCloth(broken);
+    }
+
+    // Fused streaming pass: each particle sums its spring, wind and gravity forces, integrates and
+    // writes its render position, so the particle array is read and written once per step
+    const bool writeVertices = vertices.size() == particles.size();
+    Parallel::forBlocks(static_cast<int>(particles.size()), [&](int begin, int end) {
+        // Point wind for the whole block at once, positions split into x/y/z arrays for the wind kernel
+        float px[Parallel::BlockSize], py[Parallel::BlockSize], pz[Parallel::BlockSize];
+        float wx[Parallel::BlockSize], wy[Parallel::BlockSize], wz[Parallel::BlockSize];
+        if (toggle_wind && !faceWind) {
+            for (int i = begin; i < end; ++i) {
+                glm::vec3 position = particles[i].getPosition();
+                px[i - begin] = position.x;
+                py[i - begin] = position.y;
+                pz[i - begin] = position.z;
+            }
+            windField.sampleBatch(px, py, pz, wx, wy, wz, end - begin, step, begin);
+        }
+
+        for (int i = begin; i < end; ++i) {
+            Particle& particle = particles[i];
+
+            // Springs in the order they were created, then wind, then gravity
+            glm::vec3 force(0.0f);
+            for (int a = springAdjacencyStart[i]; a < springAdjacencyEnd[i]; ++a) {
+                int entry = springAdjacency[a];
+                const glm::vec3& springForce = springForces[entry >> 1];
+                force += (entry & 1) ? -springForce : springForce;
+            }
+            if (faceWind)
+                force += Aerodynamics::gatherVertexForce(i, faceForces, vertexFaceStart, vertexFaceEnd, vertexFaces);
+            else if (toggle_wind)
+                force += glm::vec3(wx[i - begin], wy[i - begin], wz[i - begin]);
+            force.y += gravity; // Apply gravity
+
+            // One applyForce per particle instead of one per contribution
+            particle.applyForce(force);
+            particle.update(dt);
+
+            if (writeVertices)
+                vertices[i] = particle.getPosition();
+        }
+    });
+
+    // The dragged particle follows the cursor, before the collision passes so they still keep it out of
+    // the colliders and the rest of the cloth
+    const int dragged = picker.apply(particles);
+    if (dragged >= 0 && writeVertices)
+        vertices[dragged] = particles[dragged].getPosition();
+
+    // Layers kept thickness apart where they lie on each other
+    const bool layerCollision = clothCollision.enabled && layerBVHs.size() > 1;
+    clothCollision.contactCount = 0;
+    if (layerCollision)
+        resolveLayerCollisions();
+
+    // Continuous self-collision on the motion of this step, so folds cannot pass through each other
+    const bool continuous = continuousCollision.enabled && clothBVH;
+    if (continuous)
+        continuousCollision.resolveSelfCollision(particles, *clothBVH);
+    if ((layerCollision || continuous) && writeVertices) {
+        Parallel::forEach(static_cast<int>(particles.size()), [&](int i) {
+            vertices[i] = particles[i].getPosition();
+        });
+    }
+
+    ++simulationStep;
+    if (DeterministicMode)
+        stateHash = computeStateHash();
+}
+
+void Application::resetCloth() {
+    picker.release();   // Its particle and triangles go with the old cloth
+    picker.clearMoved();
+    particles.clear();  // Clear previous particles
+    springs.clear();    // Clear previous springs
+    // A deterministic run also starts the animated colliders from the beginning
+    if (DeterministicMode)
+        colliders.rewind();
+    setupCloth();
+}
+
+// Runs the cloth from its initial state twice for steps steps, the second time on a single thread, and
+// compares the state hashes. Each step is followed by the normals the render would compute, so the runs
+// take the same path as on screen. Leaves a freshly reset cloth.
+bool Application::checkDeterminism(int steps) {
+    const bool wasDeterministic = DeterministicMode;
+    DeterministicMode = true;
+    const int threads = Parallel::threadCount();
+    uint64_t hashes[2];
+    for (int run = 0; run < 2; ++run) {
+        Parallel::setThreadCount(run == 0 ? threads : 1);
+        resetCloth();
+        for (int s = 0; s < steps; ++s) {
+            stepSimulation(fixedTimeStep);
+            calculateNormals();
+        }
+        hashes[run] = computeStateHash();
+    }
+    Parallel::setThreadCount(threads);
+    resetCloth();
+    DeterministicMode = wasDeterministic;
+
+    determinismCheck = hashes[0] == hashes[1] ? 1 : -1;
+    std::cout << "Determinism check, " << steps << " steps on " << threads << " and 1 threads: " << std::hex
+        << hashes[0] << " / " << hashes[1] << std::dec << (determinismCheck > 0 ? " (match)" : " (MISMATCH)") << std::endl;
+    return determinismCheck > 0;
+}
+
+// FNV-1a over the raw bits of every particle position, in particle order
+uint64_t Application::computeStateHash() const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto& particle : particles) {
+        glm::vec3 position = particle.getPosition();
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&position);
+        for (size_t b = 0; b < sizeof(position); ++b) {
+            hash ^= bytes[b];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
 void Application::mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
     if (cursorVisible) {
         return;
@@ -10,6 +10,7 @@
 #include <glm/glm.hpp>
 #include <random>
 #include <cmath>
+#include <memory>
 #include "ImGuiManager.h"
 #include "Particle.h"
 #include "Spring.h"
@@ -20,6 +21,21 @@
 // #include "TableMesh.cpp"
 #include "NewCollision.h"
 #include "BVH.h"
+#include "BVHRebuilder.h"
+#include "Random.h"
+#include "Parallel.h"
+#include "WindField.h"
+#include "Aerodynamics.h"
+#include "AirGrid.h"
+#include "SpatialHash.h"
+#include "ContinuousCollision.h"
+#include "ContactCache.h"
+#include "SignedDistanceField.h"
+#include "SparseDistanceField.h"
+#include "ColliderSet.h"
+#include "ClothTearing.h"
+#include "ClothCollision.h"
+#include "ClothPicker.h"
 
 #include "stb_image.h"
 
@@ -34,8 +50,9 @@ public:
 
     Shader* shader;
     Shader* importedModelShader;
-    BVH* clothBVH;
-    Model* ourModel;
+    BVH* clothBVH = nullptr;
+    BVHRebuilder bvhRebuilder;
+    Model* ourModel = nullptr;
     // Mesh* table;
 
     void TextureSetup();
@@ -83,6 +100,11 @@ private:
     bool cursorVisible;//This is used to make sure when cursor is visible, yaw or pitch doesn't occur
     bool cKeyPressed;//Press 'C' for toggling of visibility of cursor
     void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+
+    // Left click picks a particle on the cloth and drags it while the cursor is shown
+    ClothPicker picker;
+    bool mouseLeftPressed = false;
+    bool cursorRay(GLFWwindow* window, glm::vec3& origin, glm::vec3& direction, float& length) const;
     void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
     bool toggle_wind;
@@ -95,11 +117,11 @@ private:
     bool clothNeedsReset;//for reseting cloth for new orientation
 
     //cloth parameters
-    float windTimer;
-    float windChangeInterval;
-    glm::vec3 windDirection;
-    float windScale;
-    float windOffsetSpeed;
+    WindField windField;
+    Aerodynamics aerodynamics; // Per-triangle drag and lift, replaces the point wind force when enabled
+    AirGrid airGrid;           // Optional coarse air simulation around the cloth
+    int airGridResolution;     // Resolution the grid was last fitted with
+    void fitAirGrid();
     float gravity;
 
     std::vector<Particle> particles;
@@ -111,8 +133,83 @@ private:
     std::vector<GLuint> furIndices;
     std::vector<GLuint> collidingIndices;
 
+    // Advances the cloth by one time step (collisions, forces, integration, springs)
+    void stepSimulation(float dt);
+    uint64_t computeStateHash() const;
+    // Clears the cloth and sets it up again from the current settings
+    void resetCloth();
+
+    // Deterministic mode: fixed time step and seed, thread-count independent loops
+    bool DeterministicMode;
+    float fixedTimeStep;
+    uint64_t deterministicSeed;
+    uint64_t simulationStep;
+    uint64_t stateHash;
+    // Two runs of the same steps from a reset, on all threads and on one, must end with the same hash
+    static constexpr int DeterminismCheckSteps = 300;
+    bool determinismCheckRequested = false;
+    int determinismCheck = 0; // 1 passed, -1 failed, 0 not run yet
+    bool checkDeterminism(int steps);
+
+    // Spring forces are computed per spring and gathered per particle,
+    // springAdjacency[springAdjacencyStart[i] .. springAdjacencyEnd[i]) lists particle i's springs
+    // as (springIndex << 1) | isFirstParticle. The end moves down as tearing removes springs.
+    std::vector<glm::vec3> springForces;
+    std::vector<int> springAdjacencyStart;
+    std::vector<int> springAdjacencyEnd;
+    std::vector<int> springAdjacency;
+    void buildSpringAdjacency();
+
+    // Particle self-collision broadphase, rebuilt every step
+    SpatialHash selfCollisionGrid;
+    std::vector<glm::vec3> selfCollisionCorrections;
+
+    // Triangle-level continuous self-collision, run after integration
+    ContinuousCollision continuousCollision;
+
+    // Everything the cloth collides with (primitives, model meshes, distance fields), each primitive with
+    // its own contact cache
+    ColliderSet colliders;
+
+    // Triangles around each vertex, same layout as springAdjacency
+    std::vector<glm::vec3> faceNormals;
+    std::vector<float> faceAreas;
+    std::vector<glm::vec3> faceForces;
+    std::vector<int> vertexFaceStart;
+    std::vector<int> vertexFaceEnd;
+    std::vector<int> vertexFaces;
+    void buildVertexFaceAdjacency();
+
+    // Tearing: springs and triangles are swap-removed (the last one takes the freed index), so only the
+    // entries of the removed and the moved ones change. changedTriangles are the triangles whose indices
+    // changed since the index buffer was last written.
+    ClothTearing tearing;
+    std::vector<int> tornTriangles;
+    std::vector<GLuint> changedTriangles;
+    void tearCloth(const std::vector<int>& broken);
+    void removeSpring(int spring);
+    void removeTriangle(int triangle);
+
+    // Stacked layers: separate cloth instances one after another in the particle, spring and triangle
+    // arrays, layer l's particles at [l * layerParticles, (l + 1) * layerParticles). Each layer has its own
+    // BVH for cloth-to-cloth collision: layerTriangles[l] lists the layer's triangles in the order of its
+    // BVH, layerIndices[l] their vertices in that order, and triangleInLayer is where each triangle is in
+    // its list. All follow tearing's swap-removes. Each layer's tree has its own rebuilder, set like
+    // bvhRebuilder every step.
+    int clothLayers = 1;
+    int layerParticles = 0;
+    ClothCollision clothCollision;
+    std::vector<std::unique_ptr<BVH>> layerBVHs;
+    std::vector<BVHRebuilder> layerRebuilders;
+    int layerRebuildCount = 0;
+    std::vector<std::vector<uint32_t>> layerTriangles;
+    std::vector<std::vector<GLuint>> layerIndices;
+    std::vector<uint32_t> triangleInLayer;
+    void buildLayerBVHs();
+    void resolveLayerCollisions();
+
     void setupClothMesh(const std::vector<Particle>& particles, int column, int row);
-    void renderClothMesh(GLuint shaderProgram, const std::vector<Particle>& particles, const glm::mat4& view, const glm::mat4& projection);
+    void renderClothMesh(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection);
 
     void generateFurStrands(const std::vector<Particle>& particles, int column, int row);
     //void generateFurStrands(const std::vector<Particle>& particles, const std::vector<GLuint>& indices, int furLayers, int furDensity);
@@ -138,9 +235,22 @@ private:
 
     std::string filename;
 
-    std::unique_ptr<Object> currentObject;
+    // Colliders toggled from the UI, -1 while not in the scene
+    int cubeCollider = -1;
+    int sphereCollider = -1;
+    int modelCollider = -1;
+    int floorCollider = -1;
+    int bodyCollider = -1;
     bool SelectCube = false;
     bool SelectSphere = false;
+    bool SelectModel = false; // Collide with ourModel (only offered when a model is loaded)
+    int ModelColliderKind = 0; // As 0: its mesh, 1: a dense distance field, 2: a sparse distance field
+    int modelColliderAdded = -1; // Kind modelCollider was added as
+    bool SelectFloor = false;
+    bool SelectBody = false; // Walking capsule-chain body (only offered when its pose stream is there)
+    bool AnimateColliders = false; // Demo motion for the cube and the sphere
+    bool collidersAnimated = false;
+    void updateColliders();
 };
 
 #endif // APPLICATION_H
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "BVH.h"
+#include "Parallel.h"
+#include "TraversalStack.h"
 #include <algorithm>
 #include <limits>
+#include <cmath>
 
 bool AABB::intersects(const AABB& other) const {
     return (min.x <= other.max.x && max.x >= other.min.x) &&
@@ -14,97 +17,985 @@ bool AABB::intersectsSphere(const glm::vec3& center, float radius) const {
     return distance <= radius;
 }
 
-BVHNode::~BVHNode() {
-    delete left;
-    delete right;
+BVH::BVH(const std::vector<Particle>& particles, const std::vector<GLuint>& triangleIndices, BVHBuilder builder)
+    : particles(&particles) {
+    build(triangleIndices, builder);
 }
 
-void BVHNode::refit(const std::vector<Particle>& particles) {
-    if (isLeaf()) {
-        aabb.min = glm::vec3(std::numeric_limits<float>::max());
-        aabb.max = glm::vec3(-std::numeric_limits<float>::max());
-        for (size_t i = 0; i < triangleIndices.size(); i += 3) {
-            const glm::vec3& v1 = particles[triangleIndices[i]].getPosition();
-            const glm::vec3& v2 = particles[triangleIndices[i+1]].getPosition();
-            const glm::vec3& v3 = particles[triangleIndices[i+2]].getPosition();
-            aabb.min = glm::min(aabb.min, glm::min(v1, glm::min(v2, v3)));
-            aabb.max = glm::max(aabb.max, glm::max(v1, glm::max(v2, v3)));
+BVH::BVH(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& triangleIndices, BVHBuilder builder)
+    : positions(positions) {
+    build(triangleIndices, builder);
+}
+
+void BVH::build(const std::vector<GLuint>& sourceIndices, BVHBuilder builder) {
+    cornerOwners.clear();
+    switch (builder) {
+    case BVHBuilder::LBVH: buildLBVH(sourceIndices); break;
+    case BVHBuilder::SAH: buildSAH(sourceIndices); break;
+    default: buildMidpoint(sourceIndices); break;
+    }
+}
+
+void BVH::computeCentroids(const std::vector<GLuint>& sourceIndices) {
+    const int count = static_cast<int>(sourceIndices.size() / 3);
+    triangleIds.resize(count);
+    centroids.resize(count);
+    Parallel::forEach(count, [&](int t) {
+        triangleIds[t] = t;
+        centroids[t] = (
+            vertex(sourceIndices[3 * t]) +
+            vertex(sourceIndices[3 * t + 1]) +
+            vertex(sourceIndices[3 * t + 2])
+        ) / 3.0f;
+    });
+}
+
+// Vertex indices in leaf order, so a leaf reads one contiguous range
+void BVH::permuteTriangles(const std::vector<GLuint>& sourceIndices) {
+    triangleIndices.resize(3 * triangleIds.size());
+    Parallel::forEach(static_cast<int>(triangleIds.size()), [&](int t) {
+        for (int k = 0; k < 3; ++k)
+            triangleIndices[3 * t + k] = sourceIndices[3 * triangleIds[t] + k];
+    });
+    centroids.clear();
+    centroids.shrink_to_fit();
+}
+
+void BVH::buildMidpoint(const std::vector<GLuint>& sourceIndices) {
+    const uint32_t count = static_cast<uint32_t>(sourceIndices.size() / 3);
+    nodes.clear();
+    triangleIndices.clear();
+    computeCentroids(sourceIndices);
+    if (count == 0)
+        return;
+
+    // A binary tree with at most one triangle per leaf has 2n - 1 nodes, so this never reallocates
+    nodes.reserve(2 * count);
+    nodes.push_back(BVHNode{});
+    subdivide(0, 0, count);
+
+    permuteTriangles(sourceIndices);
+    computeLevels();
+    refit();
+    wide.build(*this);
+}
+
+namespace {
+    int countLeadingZeros(uint32_t x) {
+        if (x == 0)
+            return 32;
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, x);
+        return 31 - static_cast<int>(index);
+#else
+        return __builtin_clz(x);
+#endif
+    }
+
+    // Spreads the low 10 bits of v so there are two zero bits between each
+    uint32_t expandBits(uint32_t v) {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // 30-bit Morton code of a point in the unit cube
+    uint32_t morton3D(const glm::vec3& p) {
+        glm::vec3 q = glm::clamp(p * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+        return (expandBits(static_cast<uint32_t>(q.x)) << 2) | (expandBits(static_cast<uint32_t>(q.y)) << 1) | expandBits(static_cast<uint32_t>(q.z));
+    }
+
+    // Stable LSD radix sort of (key, value) pairs, 8 bits per pass. Every block counts its digits,
+    // a serial scan over (digit, block) gives each block its output ranges, and blocks scatter in order.
+    void radixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values) {
+        const int n = static_cast<int>(keys.size());
+        const int blockSize = 4096;
+        const int blocks = Parallel::blockCount(n, blockSize);
+        std::vector<uint32_t> keysOut(n), valuesOut(n);
+        std::vector<uint32_t> histogram(static_cast<size_t>(blocks) * 256);
+
+        for (int shift = 0; shift < 32; shift += 8) {
+            std::fill(histogram.begin(), histogram.end(), 0u);
+            Parallel::forBlocks(n, [&](int begin, int end) {
+                uint32_t* h = &histogram[static_cast<size_t>(begin / blockSize) * 256];
+                for (int i = begin; i < end; ++i)
+                    h[(keys[i] >> shift) & 0xFF]++;
+            }, blockSize);
+
+            uint32_t offset = 0;
+            for (int digit = 0; digit < 256; ++digit) {
+                for (int b = 0; b < blocks; ++b) {
+                    uint32_t c = histogram[static_cast<size_t>(b) * 256 + digit];
+                    histogram[static_cast<size_t>(b) * 256 + digit] = offset;
+                    offset += c;
+                }
+            }
+
+            Parallel::forBlocks(n, [&](int begin, int end) {
+                uint32_t* h = &histogram[static_cast<size_t>(begin / blockSize) * 256];
+                for (int i = begin; i < end; ++i) {
+                    uint32_t slot = h[(keys[i] >> shift) & 0xFF]++;
+                    keysOut[slot] = keys[i];
+                    valuesOut[slot] = values[i];
+                }
+            }, blockSize);
+            keys.swap(keysOut);
+            values.swap(valuesOut);
         }
+    }
+}
+
+// Linear BVH (Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees", 2012).
+// Triangles are sorted by the Morton code of their centroid, and every internal node of the radix tree
+// over the sorted codes is found independently. Internal node i of the radix tree puts its two children
+// in slots 2i + 1 and 2i + 2, so siblings stay adjacent and every node gets its slot without a serial pass.
+void BVH::buildLBVH(const std::vector<GLuint>& sourceIndices) {
+    const int count = static_cast<int>(sourceIndices.size() / 3);
+    nodes.clear();
+    triangleIndices.clear();
+    computeCentroids(sourceIndices);
+    if (count == 0)
+        return;
+
+    struct Bounds { glm::vec3 min, max; };
+    Bounds bounds = Parallel::reduce(count, Bounds{ glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) },
+        [&](int begin, int end) {
+            Bounds b{ glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+            for (int t = begin; t < end; ++t) {
+                b.min = glm::min(b.min, centroids[t]);
+                b.max = glm::max(b.max, centroids[t]);
+            }
+            return b;
+        },
+        [](const Bounds& a, const Bounds& b) { return Bounds{ glm::min(a.min, b.min), glm::max(a.max, b.max) }; });
+    glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-12f));
+
+    std::vector<uint32_t> codes(count);
+    Parallel::forEach(count, [&](int t) {
+        codes[t] = morton3D((centroids[t] - bounds.min) / extent);
+    });
+    radixSort(codes, triangleIds);
+
+    nodes.resize(2 * count - 1);
+    if (count == 1) {
+        nodes[0].leftFirst = 0;
+        nodes[0].count = 1;
     } else {
-        left->refit(particles);
-        right->refit(particles);
-        aabb.min = glm::min(left->aabb.min, right->aabb.min);
-        aabb.max = glm::max(left->aabb.max, right->aabb.max);
+        // Length of the common prefix of sorted keys i and j, ties broken by position
+        auto delta = [&](int i, int j) {
+            if (j < 0 || j >= count)
+                return -1;
+            if (codes[i] == codes[j])
+                return 32 + countLeadingZeros(static_cast<uint32_t>(i ^ j));
+            return countLeadingZeros(codes[i] ^ codes[j]);
+        };
+
+        std::vector<uint32_t> internalSlot(count - 1), leafSlot(count);
+        std::vector<uint32_t> childrenStart(count - 1);
+        internalSlot[0] = 0;
+        Parallel::forEach(count - 1, [&](int i) {
+            // Direction of the range and its other end
+            int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+            int deltaMin = delta(i, i - d);
+            int lengthMax = 2;
+            while (delta(i, i + lengthMax * d) > deltaMin)
+                lengthMax *= 2;
+            int length = 0;
+            for (int t = lengthMax / 2; t >= 1; t /= 2) {
+                if (delta(i, i + (length + t) * d) > deltaMin)
+                    length += t;
+            }
+            int j = i + length * d;
+
+            // Split position: the last key sharing more than deltaNode bits with key i
+            int deltaNode = delta(i, j);
+            int split = 0;
+            for (int t = (length + 1) / 2; ; t = (t + 1) / 2) {
+                if (delta(i, i + (split + t) * d) > deltaNode)
+                    split += t;
+                if (t == 1)
+                    break;
+            }
+            int gamma = i + split * d + std::min(d, 0);
+
+            uint32_t left = static_cast<uint32_t>(2 * i + 1);
+            childrenStart[i] = left;
+            if (std::min(i, j) == gamma) leafSlot[gamma] = left;
+            else internalSlot[gamma] = left;
+            if (std::max(i, j) == gamma + 1) leafSlot[gamma + 1] = left + 1;
+            else internalSlot[gamma + 1] = left + 1;
+        });
+
+        Parallel::forEach(count - 1, [&](int i) {
+            nodes[internalSlot[i]].leftFirst = childrenStart[i];
+            nodes[internalSlot[i]].count = 0;
+        });
+        Parallel::forEach(count, [&](int t) {
+            nodes[leafSlot[t]].leftFirst = static_cast<uint32_t>(t);
+            nodes[leafSlot[t]].count = 1;
+        });
+    }
+
+    permuteTriangles(sourceIndices);
+    computeLevels();
+    refit();
+    wide.build(*this);
+}
+
+namespace {
+    float surfaceArea(const glm::vec3& min, const glm::vec3& max) {
+        glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
     }
 }
 
-bool BVHNode::isLeaf() const { return !left && !right; }
+// Binned SAH (Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies", 2007):
+// centroids are binned along each axis, and the cheapest of the bin boundaries is compared with a leaf
+bool BVH::splitSAH(uint32_t first, uint32_t count, uint32_t& leftCount) {
+    glm::vec3 nodeMin(std::numeric_limits<float>::max()), nodeMax(-std::numeric_limits<float>::max());
+    glm::vec3 centroidMin = nodeMin, centroidMax = nodeMax;
+    for (uint32_t t = first; t < first + count; ++t) {
+        const AABB& b = triangleBounds[triangleIds[t]];
+        nodeMin = glm::min(nodeMin, b.min);
+        nodeMax = glm::max(nodeMax, b.max);
+        centroidMin = glm::min(centroidMin, centroids[triangleIds[t]]);
+        centroidMax = glm::max(centroidMax, centroids[triangleIds[t]]);
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1, bestBin = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+            continue;
+        float scale = SAHBins / extent;
 
-BVH::BVH(const std::vector<Particle>& particles, const std::vector<GLuint>& triangleIndices)
-    : particles(particles) {
-    root = build(triangleIndices);
+        glm::vec3 binMin[SAHBins], binMax[SAHBins];
+        uint32_t binCount[SAHBins] = {};
+        for (int b = 0; b < SAHBins; ++b) {
+            binMin[b] = glm::vec3(std::numeric_limits<float>::max());
+            binMax[b] = glm::vec3(-std::numeric_limits<float>::max());
+        }
+        for (uint32_t t = first; t < first + count; ++t) {
+            uint32_t id = triangleIds[t];
+            int b = std::min(SAHBins - 1, static_cast<int>((centroids[id][axis] - centroidMin[axis]) * scale));
+            binCount[b]++;
+            binMin[b] = glm::min(binMin[b], triangleBounds[id].min);
+            binMax[b] = glm::max(binMax[b], triangleBounds[id].max);
+        }
+
+        // Sweep from the right for the right-hand areas, then from the left for the costs
+        float rightArea[SAHBins];
+        uint32_t rightCount[SAHBins];
+        glm::vec3 sweepMin(std::numeric_limits<float>::max()), sweepMax(-std::numeric_limits<float>::max());
+        uint32_t sweepCount = 0;
+        for (int b = SAHBins - 1; b > 0; --b) {
+            sweepMin = glm::min(sweepMin, binMin[b]);
+            sweepMax = glm::max(sweepMax, binMax[b]);
+            sweepCount += binCount[b];
+            rightArea[b] = surfaceArea(sweepMin, sweepMax);
+            rightCount[b] = sweepCount;
+        }
+        sweepMin = glm::vec3(std::numeric_limits<float>::max());
+        sweepMax = glm::vec3(-std::numeric_limits<float>::max());
+        sweepCount = 0;
+        for (int b = 0; b < SAHBins - 1; ++b) {
+            sweepMin = glm::min(sweepMin, binMin[b]);
+            sweepMax = glm::max(sweepMax, binMax[b]);
+            sweepCount += binCount[b];
+            if (sweepCount == 0 || rightCount[b + 1] == 0)
+                continue;
+            float cost = surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b + 1;
+            }
+        }
+    }
+
+    // Costs relative to the node's area, one unit per triangle test plus one per extra traversal step
+    float leafCost = surfaceArea(nodeMin, nodeMax) * count;
+    if (bestAxis < 0 || (count <= MaxSAHLeafTriangles && bestCost + surfaceArea(nodeMin, nodeMax) >= leafCost))
+        return false;
+
+    float scale = SAHBins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    uint32_t* begin = triangleIds.data() + first;
+    uint32_t* middle = std::stable_partition(begin, begin + count, [&](uint32_t id) {
+        return std::min(SAHBins - 1, static_cast<int>((centroids[id][bestAxis] - centroidMin[bestAxis]) * scale)) < bestBin;
+    });
+    leftCount = static_cast<uint32_t>(middle - begin);
+    return leftCount > 0 && leftCount < count;
 }
 
-BVH::~BVH() { delete root; }
+void BVH::subdivideSAH(std::vector<BVHNode>& out, uint32_t nodeIndex, uint32_t first, uint32_t count) {
+    uint32_t leftCount = 0;
+    if (count <= 1 || !splitSAH(first, count, leftCount)) {
+        out[nodeIndex].leftFirst = first;
+        out[nodeIndex].count = count;
+        return;
+    }
+    uint32_t leftChild = static_cast<uint32_t>(out.size());
+    out.push_back(BVHNode{});
+    out.push_back(BVHNode{});
+    out[nodeIndex].leftFirst = leftChild;
+    out[nodeIndex].count = 0;
+    subdivideSAH(out, leftChild, first, leftCount);
+    subdivideSAH(out, leftChild + 1, first + leftCount, count - leftCount);
+}
 
-void BVH::refit() {
-    if (root) root->refit(particles);
+// The top of the tree is split serially until there are enough subtrees to go around,
+// then every subtree is built in parallel into its own node array. The arrays are spliced
+// in subtree order, so the layout does not depend on the thread count.
+void BVH::buildSAH(const std::vector<GLuint>& sourceIndices) {
+    const uint32_t count = static_cast<uint32_t>(sourceIndices.size() / 3);
+    nodes.clear();
+    triangleIndices.clear();
+    computeCentroids(sourceIndices);
+    if (count == 0)
+        return;
+
+    triangleBounds.resize(count);
+    Parallel::forEach(static_cast<int>(count), [&](int t) {
+        glm::vec3 a = vertex(sourceIndices[3 * t]), b = vertex(sourceIndices[3 * t + 1]), c = vertex(sourceIndices[3 * t + 2]);
+        triangleBounds[t] = AABB{ glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) };
+    });
+
+    struct Subtree { uint32_t node, first, count; };
+    const uint32_t subtreeSize = std::max<uint32_t>(1024, count / 64);
+    std::vector<Subtree> subtrees, pending{ { 0, 0, count } };
+    nodes.push_back(BVHNode{});
+    while (!pending.empty()) {
+        Subtree task = pending.back();
+        pending.pop_back();
+        uint32_t leftCount = 0;
+        if (task.count <= subtreeSize || !splitSAH(task.first, task.count, leftCount)) {
+            subtrees.push_back(task);
+            continue;
+        }
+        uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(BVHNode{});
+        nodes.push_back(BVHNode{});
+        nodes[task.node].leftFirst = leftChild;
+        nodes[task.node].count = 0;
+        pending.push_back({ leftChild + 1, task.first + leftCount, task.count - leftCount });
+        pending.push_back({ leftChild, task.first, leftCount });
+    }
+
+    // Subtrees differ a lot in size, so they are handed out dynamically (each writes only its own array)
+    std::vector<std::vector<BVHNode>> subtreeNodes(subtrees.size());
+    const int subtreeCount = static_cast<int>(subtrees.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < subtreeCount; ++i) {
+        subtreeNodes[i].reserve(2 * subtrees[i].count);
+        subtreeNodes[i].push_back(BVHNode{});
+        subdivideSAH(subtreeNodes[i], 0, subtrees[i].first, subtrees[i].count);
+    }
+
+    for (int i = 0; i < subtreeCount; ++i) {
+        const std::vector<BVHNode>& local = subtreeNodes[i];
+        // Local node k > 0 lands at offset + k; the local root replaces the placeholder
+        uint32_t offset = static_cast<uint32_t>(nodes.size()) - 1;
+        auto relocate = [&](BVHNode node) {
+            if (!node.isLeaf())
+                node.leftFirst += offset;
+            return node;
+        };
+        nodes[subtrees[i].node] = relocate(local[0]);
+        for (size_t k = 1; k < local.size(); ++k)
+            nodes.push_back(relocate(local[k]));
+    }
+
+    triangleBounds.clear();
+    triangleBounds.shrink_to_fit();
+    permuteTriangles(sourceIndices);
+    computeLevels();
+    refit();
+    wide.build(*this);
+}
+
+void BVH::computeLevels() {
+    // Breadth-first from the root, so every level is complete before the next one starts
+    leafNodes.clear();
+    internalNodes.clear();
+    levelStart.assign(1, 0);
+    if (nodes.empty())
+        return;
+
+    std::vector<uint32_t> level(1, 0), next;
+    while (!level.empty()) {
+        next.clear();
+        for (uint32_t n : level) {
+            if (nodes[n].isLeaf()) {
+                leafNodes.push_back(n);
+            } else {
+                internalNodes.push_back(n);
+                next.push_back(nodes[n].leftFirst);
+                next.push_back(nodes[n].leftFirst + 1);
+            }
+        }
+        levelStart.push_back(static_cast<uint32_t>(internalNodes.size()));
+        level.swap(next);
+    }
 }
 
-BVHNode* BVH::build(const std::vector<GLuint>& triangleIndices) {
-    if (triangleIndices.size() <= 6) { // Leaf node (2 triangles)
-        BVHNode* node = new BVHNode();
-        node->triangleIndices = triangleIndices;
-        node->refit(particles);
-        return node;
+// Midpoint split on the longest axis of the centroid bounds, partitioning triangleIds in place
+void BVH::subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count) {
+    if (count <= MaxLeafTriangles) { // Leaf node (2 triangles)
+        nodes[nodeIndex].leftFirst = first;
+        nodes[nodeIndex].count = count;
+        return;
     }
 
-    AABB centroidAABB = computeCentroidAABB(triangleIndices);
-    glm::vec3 extent = centroidAABB.max - centroidAABB.min;
+    glm::vec3 centroidMin(std::numeric_limits<float>::max());
+    glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+    for (uint32_t t = first; t < first + count; ++t) {
+        centroidMin = glm::min(centroidMin, centroids[triangleIds[t]]);
+        centroidMax = glm::max(centroidMax, centroids[triangleIds[t]]);
+    }
+    glm::vec3 extent = centroidMax - centroidMin;
     int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 :
                (extent.y > extent.z) ? 1 : 2;
-    float splitValue = (centroidAABB.min[axis] + centroidAABB.max[axis]) * 0.5f;
-
-    std::vector<GLuint> leftIndices, rightIndices;
-    for (size_t i = 0; i < triangleIndices.size(); i += 3) {
-        glm::vec3 centroid = (
-            particles[triangleIndices[i]].getPosition() +
-            particles[triangleIndices[i+1]].getPosition() +
-            particles[triangleIndices[i+2]].getPosition()
-        ) / 3.0f;
-        if (centroid[axis] < splitValue) {
-            leftIndices.insert(leftIndices.end(), triangleIndices.begin()+i, triangleIndices.begin()+i+3);
+    float splitValue = (centroidMin[axis] + centroidMax[axis]) * 0.5f;
+
+    uint32_t* begin = triangleIds.data() + first;
+    uint32_t* middle = std::stable_partition(begin, begin + count, [&](uint32_t t) {
+        return centroids[t][axis] < splitValue;
+    });
+    uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+    if (leftCount == 0 || leftCount == count) // Fallback split
+        leftCount = count / 2;
+
+    uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(BVHNode{});
+    nodes.push_back(BVHNode{});
+    nodes[nodeIndex].leftFirst = leftChild;
+    nodes[nodeIndex].count = 0;
+    subdivide(leftChild, first, leftCount);
+    subdivide(leftChild + 1, first + leftCount, count - leftCount);
+}
+
+void BVH::refitNode(BVHNode& node, bool swept, float thickness) {
+    if (node.isLeaf()) {
+        node.min = glm::vec3(std::numeric_limits<float>::max());
+        node.max = glm::vec3(-std::numeric_limits<float>::max());
+        const GLuint* tri = leafTriangles(node);
+        for (uint32_t i = 0; i < 3 * node.count; ++i) {
+            glm::vec3 p = vertex(tri[i]);
+            node.min = glm::min(node.min, p);
+            node.max = glm::max(node.max, p);
+            if (swept) {
+                glm::vec3 previous = previousVertex(tri[i]);
+                node.min = glm::min(node.min, previous);
+                node.max = glm::max(node.max, previous);
+            }
+        }
+        node.min -= glm::vec3(thickness);
+        node.max += glm::vec3(thickness);
+    } else {
+        const BVHNode& left = nodes[node.leftFirst];
+        const BVHNode& right = nodes[node.leftFirst + 1];
+        node.min = glm::min(left.min, right.min);
+        node.max = glm::max(left.max, right.max);
+    }
+}
+
+// Leaves in parallel, then every level of internal nodes in parallel from the deepest up.
+// Min/max do not depend on evaluation order, so the result is the same for any thread count.
+void BVH::refitParallel(bool swept, float thickness) {
+    Parallel::forEach(static_cast<int>(leafNodes.size()), [&](int i) {
+        refitNode(nodes[leafNodes[i]], swept, thickness);
+    }, 64);
+
+    for (size_t d = levelStart.size() - 1; d-- > 0;) {
+        const int begin = static_cast<int>(levelStart[d]);
+        const int count = static_cast<int>(levelStart[d + 1]) - begin;
+        if (count < Parallel::BlockSize) { // Levels near the root are not worth a parallel region
+            for (int i = 0; i < count; ++i)
+                refitNode(nodes[internalNodes[begin + i]], swept, thickness);
         } else {
-            rightIndices.insert(rightIndices.end(), triangleIndices.begin()+i, triangleIndices.begin()+i+3);
+            Parallel::forEach(count, [&](int i) {
+                refitNode(nodes[internalNodes[begin + i]], swept, thickness);
+            });
         }
     }
+    if (!swept) // Only the plain bounds are queried through the wide tree
+        wide.updateBounds(*this);
+}
 
-    if (leftIndices.empty() || rightIndices.empty()) { // Fallback split
-        size_t mid = triangleIndices.size() / 2;
-        mid -= mid % 3;
-        leftIndices = std::vector<GLuint>(triangleIndices.begin(), triangleIndices.begin() + mid);
-        rightIndices = std::vector<GLuint>(triangleIndices.begin() + mid, triangleIndices.end());
+void BVH::refit() {
+    refitParallel(false, 0.0f);
+}
+
+bool BVH::refit(uint64_t step) {
+    if (step == refitStep)
+        return false;
+    refitParallel(false, 0.0f);
+    refitStep = step;
+    return true;
+}
+
+void BVH::refitSwept(float thickness) {
+    refitParallel(true, thickness);
+    refitStep = UINT64_MAX; // The bounds no longer match the plain refit of any step
+}
+
+void BVH::bindParticles(const std::vector<Particle>& liveParticles) {
+    particles = &liveParticles;
+    positions.clear();
+    positions.shrink_to_fit();
+    refitStep = UINT64_MAX;
+}
+
+void BVH::trackRemovals() {
+    tracking = true;
+    triangleSlot.resize(triangleIds.size());
+    for (uint32_t slot = 0; slot < triangleIds.size(); ++slot)
+        triangleSlot[triangleIds[slot]] = slot;
+
+    slotLeaf.resize(triangleIds.size());
+    parentNode.assign(nodes.size(), 0);
+    for (uint32_t n = 0; n < nodes.size(); ++n) {
+        const BVHNode& node = nodes[n];
+        if (node.isLeaf()) {
+            for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; ++slot)
+                slotLeaf[slot] = n;
+        } else {
+            parentNode[node.leftFirst] = parentNode[node.leftFirst + 1] = n;
+        }
     }
 
-    BVHNode* node = new BVHNode();
-    node->left = build(leftIndices);
-    node->right = build(rightIndices);
-    node->refit(particles);
-    return node;
+    wideSlot.assign(nodes.size(), BVH4::Empty);
+    const std::vector<uint32_t>& sources = wide.slotSources();
+    for (uint32_t slot = 0; slot < sources.size(); ++slot) {
+        if (sources[slot] != BVH4::Empty)
+            wideSlot[sources[slot]] = slot;
+    }
 }
 
-AABB BVH::computeCentroidAABB(const std::vector<GLuint>& triangleIndices) {
-    AABB aabb;
-    aabb.min = glm::vec3(std::numeric_limits<float>::max());
-    aabb.max = glm::vec3(-std::numeric_limits<float>::max());
-    for (size_t i = 0; i < triangleIndices.size(); i += 3) {
-        glm::vec3 centroid = (
-            particles[triangleIndices[i]].getPosition() +
-            particles[triangleIndices[i+1]].getPosition() +
-            particles[triangleIndices[i+2]].getPosition()
-        ) / 3.0f;
-        aabb.min = glm::min(aabb.min, centroid);
-        aabb.max = glm::max(aabb.max, centroid);
+void BVH::removeTriangle(uint32_t triangle) {
+    if (triangle >= static_cast<uint32_t>(triangleCount()))
+        return;
+    if (!tracking)
+        trackRemovals();
+    cornerOwners.clear();
+    const uint32_t last = static_cast<uint32_t>(triangleCount()) - 1;
+
+    // Swapped to the end of its leaf, so the leaf keeps its live triangles at the front of its range
+    const uint32_t slot = triangleSlot[triangle];
+    const uint32_t leaf = slotLeaf[slot];
+    const uint32_t end = nodes[leaf].leftFirst + nodes[leaf].count - 1;
+    if (slot != end) {
+        std::swap_ranges(&triangleIndices[3 * slot], &triangleIndices[3 * slot + 3], &triangleIndices[3 * end]);
+        std::swap(triangleIds[slot], triangleIds[end]);
+        triangleSlot[triangleIds[slot]] = slot;
+    }
+    if (triangle != last) {
+        triangleSlot[triangle] = triangleSlot[last];
+        triangleIds[triangleSlot[last]] = triangle;
+    }
+    triangleSlot.pop_back();
+    ++removedCount;
+
+    if (nodes[leaf].count > 1) {
+        --nodes[leaf].count; // The box shrinks on the next refit
+        if (wideSlot[leaf] != BVH4::Empty)
+            wide.setLeafCount(wideSlot[leaf], nodes[leaf].count);
+        return;
+    }
+    spliceOut(leaf);
+}
+
+// The emptied leaf keeps its count and range (a removed triangle still has valid vertices), so refitting it
+// along with the other spliced-out nodes stays harmless
+void BVH::spliceOut(uint32_t leaf) {
+    if (wideSlot[leaf] != BVH4::Empty) {
+        wide.clearSlot(wideSlot[leaf]);
+        wideSlot[leaf] = BVH4::Empty;
+    }
+    if (leaf == 0) { // That was the last triangle
+        nodes.clear();
+        computeLevels();
+        wide.build(*this);
+        return;
+    }
+
+    // The parent takes over the sibling. Its place in the refit schedule still comes after the sibling's
+    // children, which are deeper than the sibling was.
+    const uint32_t up = parentNode[leaf];
+    const uint32_t sibling = nodes[up].leftFirst == leaf ? leaf + 1 : leaf - 1;
+    nodes[up] = nodes[sibling];
+    const BVHNode& moved = nodes[up];
+    if (moved.isLeaf()) {
+        for (uint32_t slot = moved.leftFirst; slot < moved.leftFirst + moved.count; ++slot)
+            slotLeaf[slot] = up;
+    } else {
+        parentNode[moved.leftFirst] = parentNode[moved.leftFirst + 1] = up;
+    }
+
+    // In the wide tree the sibling's slot now shows the parent. If the parent has a slot of its own (one
+    // pointing to a wide node that held just the two), the sibling's content moves up into it.
+    if (wideSlot[sibling] != BVH4::Empty) {
+        if (wideSlot[up] != BVH4::Empty) {
+            wide.moveSlot(wideSlot[sibling], wideSlot[up], up);
+        } else {
+            wide.setSlotSource(wideSlot[sibling], up);
+            wideSlot[up] = wideSlot[sibling];
+        }
+        wideSlot[sibling] = BVH4::Empty;
+    }
+}
+
+BVHQuality BVH::measureQuality() const {
+    if (nodes.empty())
+        return BVHQuality{ 0.0f, 0.0f };
+
+    auto area = [](const glm::vec3& min, const glm::vec3& max) {
+        glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+        return 2.0 * (static_cast<double>(e.x) * e.y + static_cast<double>(e.y) * e.z + static_cast<double>(e.z) * e.x);
+    };
+    struct Sums { double sah, overlap; };
+    Sums sums = Parallel::reduce(static_cast<int>(nodes.size()), Sums{ 0.0, 0.0 }, [&](int begin, int end) {
+        Sums partial{ 0.0, 0.0 };
+        for (int i = begin; i < end; ++i) {
+            const BVHNode& node = nodes[i];
+            double nodeArea = area(node.min, node.max);
+            if (node.isLeaf()) {
+                partial.sah += nodeArea * node.count;
+            } else {
+                const BVHNode& left = nodes[node.leftFirst];
+                const BVHNode& right = nodes[node.leftFirst + 1];
+                partial.sah += nodeArea;
+                glm::vec3 overlapMin = glm::max(left.min, right.min);
+                glm::vec3 overlapMax = glm::min(left.max, right.max);
+                if (glm::all(glm::lessThan(overlapMin, overlapMax)))
+                    partial.overlap += area(overlapMin, overlapMax);
+            }
+        }
+        return partial;
+    }, [](const Sums& a, const Sums& b) { return Sums{ a.sah + b.sah, a.overlap + b.overlap }; });
+
+    double rootArea = std::max(area(nodes[0].min, nodes[0].max), 1e-12);
+    return BVHQuality{ static_cast<float>(sums.sah / rootArea), static_cast<float>(sums.overlap / rootArea) };
+}
+
+const std::vector<uint8_t>& BVH::ownedCorners() const {
+    if (!cornerOwners.empty() || nodes.empty())
+        return cornerOwners;
+    cornerOwners.assign(triangleIds.size(), 0);
+    std::vector<uint8_t> seen(particles ? particles->size() : positions.size(), 0);
+
+    // Leaves reached from the root only, so the slots removed triangles left behind are never owners
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty()) {
+        const BVHNode& node = nodes[stack.back()];
+        stack.pop_back();
+        if (!node.isLeaf()) {
+            stack.push_back(node.leftFirst + 1);
+            stack.push_back(node.leftFirst);
+            continue;
+        }
+        for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.count; ++slot) {
+            for (int k = 0; k < 3; ++k) {
+                const GLuint v = triangleIndices[3 * slot + k];
+                if (!seen[v]) {
+                    seen[v] = 1;
+                    cornerOwners[slot] |= static_cast<uint8_t>(1 << k);
+                }
+            }
+        }
+    }
+    return cornerOwners;
+}
+
+void BVH::subtreeRoots(int target, std::vector<uint32_t>& roots) const {
+    roots.clear();
+    if (nodes.empty())
+        return;
+    roots.push_back(0);
+    while (static_cast<int>(roots.size()) < target) {
+        // One whole level at a time, so the subtrees depend on the topology only, not on the bounds
+        const size_t count = roots.size();
+        for (size_t i = 0; i < count; ++i) {
+            const BVHNode& node = nodes[roots[i]];
+            if (!node.isLeaf()) {
+                roots[i] = node.leftFirst;
+                roots.push_back(node.leftFirst + 1);
+            }
+        }
+        if (roots.size() == count)
+            break; // Only leaves left
     }
-    return aabb;
+}
+
+void BVH::queryBox(uint32_t root, const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<GLuint>& out) const {
+    TraversalStack<uint32_t, 128> stack;
+    stack.push(root);
+    while (!stack.empty()) {
+        const BVHNode& node = nodes[stack.pop()];
+        if (glm::any(glm::lessThan(node.max, boxMin)) || glm::any(glm::greaterThan(node.min, boxMax)))
+            continue;
+        if (node.isLeaf()) {
+            const GLuint* tri = leafTriangles(node);
+            out.insert(out.end(), tri, tri + 3 * node.count);
+            continue;
+        }
+        stack.push(node.leftFirst + 1);
+        stack.push(node.leftFirst);
+    }
+}
+
+// Ericson, Real-Time Collision Detection 5.1.5: find the Voronoi region of p, then project onto it
+glm::vec3 BVH::closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+bool BVH::closestPoint(const glm::vec3& p, float maxDistance, glm::vec3& point, uint32_t& triangle) const {
+    if (nodes.empty())
+        return false;
+
+    auto boxDistance2 = [&](const BVHNode& node) {
+        glm::vec3 d = glm::max(glm::max(node.min - p, p - node.max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    };
+
+    float best2 = maxDistance * maxDistance;
+    bool found = false;
+    TraversalStack<uint32_t, 128> stack;
+    stack.push(0);
+    while (!stack.empty()) {
+        const BVHNode& node = nodes[stack.pop()];
+        if (boxDistance2(node) > best2)
+            continue; // The best distance shrank since this node was pushed
+        if (node.isLeaf()) {
+            const GLuint* tri = leafTriangles(node);
+            for (uint32_t k = 0; k < node.count; ++k) {
+                glm::vec3 q = closestPointOnTriangle(p, vertex(tri[3 * k]), vertex(tri[3 * k + 1]), vertex(tri[3 * k + 2]));
+                float d2 = glm::dot(q - p, q - p);
+                if (d2 <= best2) {
+                    best2 = d2;
+                    point = q;
+                    triangle = triangleIds[node.leftFirst + k];
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // Nearer child on top, so it is searched first and tightens the bound for the other one
+        uint32_t near = node.leftFirst, far = node.leftFirst + 1;
+        float nearDistance2 = boxDistance2(nodes[near]), farDistance2 = boxDistance2(nodes[far]);
+        if (farDistance2 < nearDistance2) {
+            std::swap(near, far);
+            std::swap(nearDistance2, farDistance2);
+        }
+        if (farDistance2 <= best2)
+            stack.push(far);
+        if (nearDistance2 <= best2)
+            stack.push(near);
+    }
+    return found;
+}
+
+bool BVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, float& t, uint32_t& triangle) const {
+    if (nodes.empty())
+        return false;
+
+    // Slab test against a node, returns the entry distance or a miss (+inf)
+    const glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    auto entry = [&](const BVHNode& node, float limit) {
+        glm::vec3 t0 = (node.min - origin) * inverse;
+        glm::vec3 t1 = (node.max - origin) * inverse;
+        glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, limit));
+        return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+    };
+
+    float best = maxT;
+    bool found = false;
+    if (entry(nodes[0], best) == std::numeric_limits<float>::infinity())
+        return false;
+    TraversalStack<uint32_t, 128> stack;
+    stack.push(0);
+    while (!stack.empty()) {
+        const BVHNode& node = nodes[stack.pop()];
+        if (entry(node, best) > best)
+            continue; // A nearer hit was found since this node was pushed
+        if (node.isLeaf()) {
+            const GLuint* tri = leafTriangles(node);
+            for (uint32_t k = 0; k < node.count; ++k) {
+                // Moller-Trumbore
+                glm::vec3 a = vertex(tri[3 * k]);
+                glm::vec3 e1 = vertex(tri[3 * k + 1]) - a, e2 = vertex(tri[3 * k + 2]) - a;
+                glm::vec3 p = glm::cross(direction, e2);
+                float det = glm::dot(e1, p);
+                if (std::abs(det) < 1e-12f)
+                    continue;
+                float invDet = 1.0f / det;
+                glm::vec3 s = origin - a;
+                float u = glm::dot(s, p) * invDet;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+                glm::vec3 q = glm::cross(s, e1);
+                float v = glm::dot(direction, q) * invDet;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+                float hit = glm::dot(e2, q) * invDet;
+                if (hit >= 0.0f && hit <= best) {
+                    best = hit;
+                    triangle = triangleIds[node.leftFirst + k];
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // Nearer child on top
+        uint32_t near = node.leftFirst, far = node.leftFirst + 1;
+        float nearT = entry(nodes[near], best), farT = entry(nodes[far], best);
+        if (farT < nearT) {
+            std::swap(near, far);
+            std::swap(nearT, farT);
+        }
+        if (farT <= best)
+            stack.push(far);
+        if (nearT <= best)
+            stack.push(near);
+    }
+    if (found)
+        t = best;
+    return found;
+}
+
+void BVH::closestPoints(const glm::vec3* points, int count, float* distance2, glm::vec3* closest, uint32_t* triangle) const {
+    count = std::min(count, MaxQueryBatch);
+    for (int i = 0; i < count; ++i)
+        triangle[i] = UINT32_MAX;
+    if (nodes.empty() || count <= 0)
+        return;
+
+    // Points and best distances split into x/y/z arrays for the lane loops
+    float px[MaxQueryBatch], py[MaxQueryBatch], pz[MaxQueryBatch], best2[MaxQueryBatch];
+    glm::vec3 batchCenter(0.0f);
+    for (int i = 0; i < count; ++i) {
+        px[i] = points[i].x; py[i] = points[i].y; pz[i] = points[i].z;
+        best2[i] = distance2[i];
+        batchCenter += points[i];
+    }
+    batchCenter /= static_cast<float>(count);
+
+    // Seed: the point of the mesh nearest the batch center bounds every point's distance from above, so
+    // the batch starts with tight radii instead of the search radius
+    float batchRadius = 0.0f, maxBest2 = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        batchRadius = std::max(batchRadius, glm::length(points[i] - batchCenter));
+        maxBest2 = std::max(maxBest2, best2[i]);
+    }
+    glm::vec3 seedPoint;
+    uint32_t seedTriangle;
+    if (closestPoint(batchCenter, std::sqrt(maxBest2) + batchRadius, seedPoint, seedTriangle)) {
+        for (int i = 0; i < count; ++i) {
+            float d2 = glm::dot(seedPoint - points[i], seedPoint - points[i]);
+            if (d2 <= best2[i]) {
+                best2[i] = d2;
+                closest[i] = seedPoint;
+                triangle[i] = seedTriangle;
+            }
+        }
+    }
+
+    // Whether the box may still hold something closer for at least one point
+    auto reachable = [&](const BVHNode& node) {
+        int any = 0;
+#pragma omp simd reduction(|:any)
+        for (int i = 0; i < count; ++i) {
+            float dx = std::max(std::max(node.min.x - px[i], px[i] - node.max.x), 0.0f);
+            float dy = std::max(std::max(node.min.y - py[i], py[i] - node.max.y), 0.0f);
+            float dz = std::max(std::max(node.min.z - pz[i], pz[i] - node.max.z), 0.0f);
+            any |= (dx * dx + dy * dy + dz * dz <= best2[i]) ? 1 : 0;
+        }
+        return any != 0;
+    };
+    auto centerDistance2 = [&](const BVHNode& node) {
+        glm::vec3 d = glm::max(glm::max(node.min - batchCenter, batchCenter - node.max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    };
+
+    TraversalStack<uint32_t, 128> stack;
+    stack.push(0);
+    while (!stack.empty()) {
+        const BVHNode& node = nodes[stack.pop()];
+        if (!reachable(node))
+            continue;
+        if (node.isLeaf()) {
+            const GLuint* tri = leafTriangles(node);
+            for (uint32_t k = 0; k < node.count; ++k) {
+                const glm::vec3 a = vertex(tri[3 * k]), b = vertex(tri[3 * k + 1]), c = vertex(tri[3 * k + 2]);
+                const uint32_t id = triangleIds[node.leftFirst + k];
+                // The triangle's box against every point in one SIMD loop, then the exact (branchy) closest
+                // point only for the points the box can still improve
+                const glm::vec3 triMin = glm::min(glm::min(a, b), c), triMax = glm::max(glm::max(a, b), c);
+                unsigned char near[MaxQueryBatch];
+#pragma omp simd
+                for (int i = 0; i < count; ++i) {
+                    float dx = std::max(std::max(triMin.x - px[i], px[i] - triMax.x), 0.0f);
+                    float dy = std::max(std::max(triMin.y - py[i], py[i] - triMax.y), 0.0f);
+                    float dz = std::max(std::max(triMin.z - pz[i], pz[i] - triMax.z), 0.0f);
+                    near[i] = (dx * dx + dy * dy + dz * dz <= best2[i]) ? 1 : 0;
+                }
+                for (int i = 0; i < count; ++i) {
+                    if (!near[i])
+                        continue;
+                    glm::vec3 p(px[i], py[i], pz[i]);
+                    glm::vec3 q = closestPointOnTriangle(p, a, b, c);
+                    float d2 = glm::dot(q - p, q - p);
+                    if (d2 <= best2[i]) {
+                        best2[i] = d2;
+                        closest[i] = q;
+                        triangle[i] = id;
+                    }
+                }
+            }
+            continue;
+        }
+        // Child nearer to the batch on top
+        uint32_t near = node.leftFirst, far = node.leftFirst + 1;
+        if (centerDistance2(nodes[far]) < centerDistance2(nodes[near]))
+            std::swap(near, far);
+        stack.push(far);
+        stack.push(near);
+    }
+
+    for (int i = 0; i < count; ++i)
+        distance2[i] = best2[i];
 }
@@ -1,7 +1,10 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <glad/glad.h>
 #include <vector>
+#include <cstdint>
 #include "Particle.h"
+#include "BVH4.h"
 
 struct AABB {
     glm::vec3 min;
@@ -11,28 +14,148 @@ struct AABB {
     bool intersectsSphere(const glm::vec3& center, float radius) const;
 };
 
-class BVHNode {
-public:
-    AABB aabb;
-    std::vector<GLuint> triangleIndices;
-    BVHNode* left = nullptr;
-    BVHNode* right = nullptr;
-
-    ~BVHNode();
-    void refit(const std::vector<Particle>& particles);
-    bool isLeaf() const;
+// 32-byte node. Internal nodes (count == 0) have their two children at leftFirst and leftFirst + 1,
+// leaves hold triangles [leftFirst, leftFirst + count) of the BVH's permuted triangle array.
+struct BVHNode {
+    glm::vec3 min;
+    uint32_t leftFirst;
+    glm::vec3 max;
+    uint32_t count;
+
+    bool isLeaf() const { return count > 0; }
+    AABB aabb() const { return AABB{ min, max }; }
 };
+static_assert(sizeof(BVHNode) == 32, "BVHNode should stay 32 bytes");
 
+// Tree quality, both relative to the root's surface area. sahCost is the expected cost of a random ray
+// (one unit per node visited, one per triangle tested); overlap sums the area shared by sibling boxes.
+struct BVHQuality {
+    float sahCost;
+    float overlap;
+};
+
+enum class BVHBuilder {
+    Midpoint, // Top-down, midpoint split on the longest centroid axis, up to 2 triangles per leaf
+    LBVH,     // Parallel linear BVH: Morton-sorted centroids, one triangle per leaf
+    SAH       // Binned surface area heuristic, subtrees built in parallel. Slower to build, faster to query:
+              // meant for static collider meshes
+};
+
+// Flat BVH over a triangle mesh: either the cloth (vertices are particles, refit every step)
+// or a static mesh with its own copy of the vertex positions. nodes[0] is the root.
 class BVH {
 public:
-    BVHNode* root;
-    const std::vector<Particle>& particles;
+    std::vector<BVHNode> nodes;
+    std::vector<GLuint> triangleIndices; // Vertex indices, 3 per triangle, in leaf order
+    std::vector<uint32_t> triangleIds;   // Index of each triangle in the original index array
+    const std::vector<Particle>* particles = nullptr; // Cloth vertices
+    std::vector<glm::vec3> positions;                  // Static mesh vertices, when particles is null
 
-    BVH(const std::vector<Particle>& particles, const std::vector<GLuint>& triangleIndices);
-    ~BVH();
+    BVH(const std::vector<Particle>& particles, const std::vector<GLuint>& triangleIndices, BVHBuilder builder = BVHBuilder::Midpoint);
+    BVH(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& triangleIndices, BVHBuilder builder = BVHBuilder::SAH);
     void refit();
+    // Refits only if the tree was not already refit for this simulation step. Returns whether it ran.
+    bool refit(uint64_t step);
+    // Swept refit: bounds cover the motion from previous to current positions, grown by thickness
+    void refitSwept(float thickness);
+
+    // Switches a tree built over a snapshot of positions to the live cloth particles (same vertex order)
+    void bindParticles(const std::vector<Particle>& particles);
+
+    // Takes a triangle out of the tree, mirroring a swap-remove on the index array it was built from: the
+    // last triangle (triangleCount() - 1) is renumbered to triangle. Only its leaf changes, and a leaf left
+    // empty is spliced out by moving its sibling into their parent. Spliced-out nodes stay in the array, and
+    // in the refit schedule and measureQuality, until the next build, so a heavily torn tree shows up as
+    // degraded to BVHRebuilder.
+    void removeTriangle(uint32_t triangle);
+    // Builds the bookkeeping removeTriangle needs, which otherwise the first removal does. It is a pass over
+    // the whole tree, so a tree that is going to be torn gets it ahead of time instead of in a tearing step.
+    void trackRemovals();
+    bool tracksRemovals() const { return tracking; }
+
+    BVHQuality measureQuality() const;
+
+    bool empty() const { return nodes.empty(); }
+    int triangleCount() const { return static_cast<int>(triangleIds.size() - removedCount); }
+
+    glm::vec3 vertex(GLuint v) const { return particles ? (*particles)[v].getPosition() : positions[v]; }
+    glm::vec3 previousVertex(GLuint v) const { return particles ? (*particles)[v].getPreviousPosition() : positions[v]; }
+
+    // Candidate triangles (vertex indices, 3 per triangle) overlapping a box or a sphere, through the
+    // 4-wide copy of the tree. Results are appended to out, so one buffer can be reused every step.
+    void queryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<GLuint>& out) const { wide.queryBox(boxMin, boxMax, triangleIndices, out); }
+    void querySphere(const glm::vec3& center, float radius, std::vector<GLuint>& out) const { wide.querySphere(center, radius, triangleIndices, out); }
+
+    // Roots of at least target disjoint subtrees that together cover the tree (fewer if it has fewer
+    // leaves): the first level of the tree that is wide enough. They only change when the tree is rebuilt,
+    // and their bounds are kept current by refit, so a broadphase can test against a few dozen boxes.
+    void subtreeRoots(int target, std::vector<uint32_t>& roots) const;
+    // queryBox restricted to the subtree under nodes[root], on the binary tree
+    void queryBox(uint32_t root, const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<GLuint>& out) const;
+
+    // First triangle hit by the ray origin + t * direction for t in [0, maxT]: t and the triangle (index into
+    // the original index array / 3) of the nearest hit. Both sides of a triangle count.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxT, float& t, uint32_t& triangle) const;
+
+    // Nearest point of the mesh to p, searching no further than maxDistance. Returns false when nothing is
+    // that close; otherwise point, and triangle (index into the original index array / 3), are set.
+    bool closestPoint(const glm::vec3& p, float maxDistance, glm::vec3& point, uint32_t& triangle) const;
+    // closestPoint for a batch of up to MaxQueryBatch points in one traversal: a node is entered when it may
+    // hold something closer for any point of the batch, and at a leaf each triangle is tested against the
+    // whole batch in one SIMD loop. distance2[i] is the squared search radius on entry and the squared
+    // distance found on return; triangle[i] is UINT32_MAX where nothing was within the radius.
+    static constexpr int MaxQueryBatch = 64;
+    void closestPoints(const glm::vec3* points, int count, float* distance2, glm::vec3* closest, uint32_t* triangle) const;
+    static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+    // Vertex indices of the triangles in a leaf
+    const GLuint* leafTriangles(const BVHNode& node) const { return &triangleIndices[3 * node.leftFirst]; }
+
+    // Per leaf slot, bit k is set when corner k of the triangle there is the first time its vertex appears
+    // in tree order, so a test meant once per vertex can skip the other corners (a grid vertex is in six
+    // triangles). Built on first use after a build or a removal.
+    const std::vector<uint8_t>& ownedCorners() const;
 
 private:
-    BVHNode* build(const std::vector<GLuint>& triangleIndices);
-    AABB computeCentroidAABB(const std::vector<GLuint>& triangleIndices);
+    static constexpr uint32_t MaxLeafTriangles = 2;
+    static constexpr uint32_t MaxSAHLeafTriangles = 4;
+    static constexpr int SAHBins = 16;
+
+    BVH4 wide; // Query layout, same leaves, bounds copied on every refit
+
+    std::vector<glm::vec3> centroids; // Build scratch, per original triangle
+    std::vector<AABB> triangleBounds; // SAH build scratch, per original triangle
+
+    // Refit schedule: all leaves at once, then the internal nodes one depth at a time from the bottom up.
+    // Internal nodes of depth d are internalNodes[levelStart[d] .. levelStart[d + 1]).
+    std::vector<uint32_t> leafNodes;
+    std::vector<uint32_t> internalNodes;
+    std::vector<uint32_t> levelStart;
+    uint64_t refitStep = UINT64_MAX;
+
+    // Removal bookkeeping (trackRemovals): the slot of every triangle in the leaf order, the
+    // leaf over every slot, every node's parent and the wide slot showing every node (BVH4::Empty if none)
+    std::vector<uint32_t> triangleSlot;
+    std::vector<uint32_t> slotLeaf;
+    std::vector<uint32_t> parentNode;
+    std::vector<uint32_t> wideSlot;
+    uint32_t removedCount = 0;
+    bool tracking = false;
+    mutable std::vector<uint8_t> cornerOwners;
+    void spliceOut(uint32_t leaf);
+
+    void computeLevels();
+    void refitParallel(bool swept, float thickness);
+
+    void buildMidpoint(const std::vector<GLuint>& sourceIndices);
+    void subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count);
+    void buildLBVH(const std::vector<GLuint>& sourceIndices);
+    void buildSAH(const std::vector<GLuint>& sourceIndices);
+    // Splits triangles [first, first + count) by binned SAH; returns false when a leaf is cheaper
+    bool splitSAH(uint32_t first, uint32_t count, uint32_t& leftCount);
+    void subdivideSAH(std::vector<BVHNode>& out, uint32_t nodeIndex, uint32_t first, uint32_t count);
+    void build(const std::vector<GLuint>& sourceIndices, BVHBuilder builder);
+    void computeCentroids(const std::vector<GLuint>& sourceIndices);
+    void permuteTriangles(const std::vector<GLuint>& sourceIndices);
+    void refitNode(BVHNode& node, bool swept, float thickness);
 };
@@ -0,0 +1,193 @@
+#include "BVH4.h"
+#include "BVH.h"
+#include "Parallel.h"
+#include "TraversalStack.h"
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH4_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    float surfaceArea(const BVHNode& node) {
+        glm::vec3 e = glm::max(node.max - node.min, glm::vec3(0.0f));
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+}
+
+void BVH4::build(const BVH& bvh) {
+    nodes.clear();
+    slotSource.clear();
+    if (bvh.empty())
+        return;
+    nodes.reserve(bvh.nodes.size() / 2 + 1);
+    slotSource.reserve(nodes.capacity() * 4);
+    collapse(bvh, 0);
+    updateBounds(bvh);
+}
+
+// Opens the binary subtree under binaryNode until there are up to four children, always expanding the
+// internal child with the largest surface area, which is the one a query is most likely to enter
+uint32_t BVH4::collapse(const BVH& bvh, uint32_t binaryNode) {
+    uint32_t children[4];
+    int childCount = 0;
+    if (bvh.nodes[binaryNode].isLeaf()) {
+        children[childCount++] = binaryNode;
+    } else {
+        children[childCount++] = bvh.nodes[binaryNode].leftFirst;
+        children[childCount++] = bvh.nodes[binaryNode].leftFirst + 1;
+    }
+    while (childCount < 4) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for (int k = 0; k < childCount; ++k) {
+            const BVHNode& node = bvh.nodes[children[k]];
+            if (!node.isLeaf() && surfaceArea(node) > largestArea) {
+                largestArea = surfaceArea(node);
+                largest = k;
+            }
+        }
+        if (largest < 0)
+            break;
+        uint32_t opened = children[largest];
+        children[largest] = bvh.nodes[opened].leftFirst;
+        children[childCount++] = bvh.nodes[opened].leftFirst + 1;
+    }
+
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(BVH4Node{});
+    slotSource.resize(nodes.size() * 4, Empty);
+    for (int k = 0; k < 4; ++k) {
+        nodes[index].child[k] = Empty;
+        nodes[index].count[k] = 0;
+    }
+
+    for (int k = 0; k < childCount; ++k) {
+        const BVHNode& node = bvh.nodes[children[k]];
+        slotSource[index * 4 + k] = children[k];
+        if (node.isLeaf()) {
+            nodes[index].child[k] = node.leftFirst;
+            nodes[index].count[k] = node.count;
+        } else {
+            uint32_t child = collapse(bvh, children[k]); // May reallocate nodes, so index again afterwards
+            nodes[index].child[k] = child;
+            nodes[index].count[k] = 0;
+        }
+    }
+    return index;
+}
+
+void BVH4::updateBounds(const BVH& bvh) {
+    const float inf = std::numeric_limits<float>::infinity();
+    Parallel::forEach(static_cast<int>(nodes.size()), [&](int i) {
+        BVH4Node& node = nodes[i];
+        for (int k = 0; k < 4; ++k) {
+            uint32_t source = slotSource[i * 4 + k];
+            if (source == Empty) {
+                node.minX[k] = node.minY[k] = node.minZ[k] = inf;
+                node.maxX[k] = node.maxY[k] = node.maxZ[k] = -inf;
+                continue;
+            }
+            const BVHNode& b = bvh.nodes[source];
+            node.minX[k] = b.min.x; node.minY[k] = b.min.y; node.minZ[k] = b.min.z;
+            node.maxX[k] = b.max.x; node.maxY[k] = b.max.y; node.maxZ[k] = b.max.z;
+        }
+    }, 64);
+}
+
+void BVH4::clearSlot(uint32_t slot) {
+    const float inf = std::numeric_limits<float>::infinity();
+    BVH4Node& node = nodes[slot / 4];
+    const int k = slot % 4;
+    node.child[k] = Empty;
+    node.count[k] = 0;
+    node.minX[k] = node.minY[k] = node.minZ[k] = inf;
+    node.maxX[k] = node.maxY[k] = node.maxZ[k] = -inf;
+    slotSource[slot] = Empty;
+}
+
+void BVH4::moveSlot(uint32_t from, uint32_t to, uint32_t binaryNode) {
+    // The bounds stay the ones of to until the next refit, which still cover everything below it
+    nodes[to / 4].child[to % 4] = nodes[from / 4].child[from % 4];
+    nodes[to / 4].count[to % 4] = nodes[from / 4].count[from % 4];
+    slotSource[to] = binaryNode;
+    clearSlot(from);
+}
+
+template <typename LaneTest>
+void BVH4::query(LaneTest test, const std::vector<GLuint>& triangleIndices, std::vector<GLuint>& out) const {
+    if (nodes.empty())
+        return;
+
+    TraversalStack<uint32_t, 256> stack;
+    stack.push(0);
+    while (!stack.empty()) {
+        const BVH4Node& node = nodes[stack.pop()];
+        int mask = test(node);
+        for (int k = 0; k < 4; ++k) {
+            if (!(mask & (1 << k)))
+                continue;
+            if (node.count[k] > 0) {
+                const GLuint* tri = &triangleIndices[3 * node.child[k]];
+                out.insert(out.end(), tri, tri + 3 * node.count[k]);
+            } else {
+                stack.push(node.child[k]);
+            }
+        }
+    }
+}
+
+void BVH4::queryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, const std::vector<GLuint>& triangleIndices, std::vector<GLuint>& out) const {
+#ifdef BVH4_SSE
+    const __m128 qMinX = _mm_set1_ps(boxMin.x), qMinY = _mm_set1_ps(boxMin.y), qMinZ = _mm_set1_ps(boxMin.z);
+    const __m128 qMaxX = _mm_set1_ps(boxMax.x), qMaxY = _mm_set1_ps(boxMax.y), qMaxZ = _mm_set1_ps(boxMax.z);
+    query([&](const BVH4Node& node) {
+        __m128 overlap = _mm_and_ps(
+            _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minX), qMaxX), _mm_cmpge_ps(_mm_load_ps(node.maxX), qMinX)),
+            _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minY), qMaxY), _mm_cmpge_ps(_mm_load_ps(node.maxY), qMinY)));
+        overlap = _mm_and_ps(overlap,
+            _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minZ), qMaxZ), _mm_cmpge_ps(_mm_load_ps(node.maxZ), qMinZ)));
+        return _mm_movemask_ps(overlap);
+    }, triangleIndices, out);
+#else
+    query([&](const BVH4Node& node) {
+        int mask = 0;
+        for (int k = 0; k < 4; ++k) {
+            bool overlap = node.minX[k] <= boxMax.x && node.maxX[k] >= boxMin.x &&
+                           node.minY[k] <= boxMax.y && node.maxY[k] >= boxMin.y &&
+                           node.minZ[k] <= boxMax.z && node.maxZ[k] >= boxMin.z;
+            mask |= overlap ? (1 << k) : 0;
+        }
+        return mask;
+    }, triangleIndices, out);
+#endif
+}
+
+void BVH4::querySphere(const glm::vec3& center, float radius, const std::vector<GLuint>& triangleIndices, std::vector<GLuint>& out) const {
+#ifdef BVH4_SSE
+    const __m128 cX = _mm_set1_ps(center.x), cY = _mm_set1_ps(center.y), cZ = _mm_set1_ps(center.z);
+    const __m128 r2 = _mm_set1_ps(radius * radius);
+    const __m128 zero = _mm_setzero_ps();
+    query([&](const BVH4Node& node) {
+        // Distance from the center to each box: how far it lies outside on every axis
+        __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(node.minX), cX), _mm_sub_ps(cX, _mm_load_ps(node.maxX))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(node.minY), cY), _mm_sub_ps(cY, _mm_load_ps(node.maxY))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_load_ps(node.minZ), cZ), _mm_sub_ps(cZ, _mm_load_ps(node.maxZ))), zero);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        return _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+    }, triangleIndices, out);
+#else
+    query([&](const BVH4Node& node) {
+        int mask = 0;
+        for (int k = 0; k < 4; ++k) {
+            float dx = std::max(std::max(node.minX[k] - center.x, center.x - node.maxX[k]), 0.0f);
+            float dy = std::max(std::max(node.minY[k] - center.y, center.y - node.maxY[k]), 0.0f);
+            float dz = std::max(std::max(node.minZ[k] - center.z, center.z - node.maxZ[k]), 0.0f);
+            mask |= (dx * dx + dy * dy + dz * dz <= radius * radius) ? (1 << k) : 0;
+        }
+        return mask;
+    }, triangleIndices, out);
+#endif
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+
+class BVH;
+
+// 4-wide node: the bounds of all four children side by side (SoA), so one SSE compare tests them all.
+// A child slot is either another 4-wide node (count == 0), a leaf range of the binary BVH's permuted
+// triangle array (count > 0), or empty (child == Empty, bounds inverted so every test fails).
+struct alignas(16) BVH4Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    uint32_t child[4];
+    uint32_t count[4];
+};
+
+// Collapsed copy of a binary BVH for queries. The topology is fixed at build time; refit only copies
+// the refit binary bounds into the slots.
+class BVH4 {
+public:
+    static constexpr uint32_t Empty = 0xFFFFFFFFu;
+
+    std::vector<BVH4Node> nodes;
+
+    void build(const BVH& bvh);
+    void updateBounds(const BVH& bvh);
+
+    // Slot edits for BVH::removeTriangle. A slot is nodes[slot / 4] lane slot % 4.
+    const std::vector<uint32_t>& slotSources() const { return slotSource; }
+    void setLeafCount(uint32_t slot, uint32_t count) { nodes[slot / 4].count[slot % 4] = count; }
+    void setSlotSource(uint32_t slot, uint32_t binaryNode) { slotSource[slot] = binaryNode; }
+    void clearSlot(uint32_t slot);
+    // Copies what slot from points to into slot to (now showing binaryNode), then clears from
+    void moveSlot(uint32_t from, uint32_t to, uint32_t binaryNode);
+
+    // Appends the vertex indices (3 per triangle) of every leaf whose box overlaps the query.
+    // Iterative, with no allocation unless the tree is unusually deep, and out is only appended to, so
+    // callers can reuse one buffer.
+    void queryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, const std::vector<GLuint>& triangleIndices, std::vector<GLuint>& out) const;
+    void querySphere(const glm::vec3& center, float radius, const std::vector<GLuint>& triangleIndices, std::vector<GLuint>& out) const;
+
+private:
+    std::vector<uint32_t> slotSource; // Binary node behind every slot (nodes.size() * 4), Empty for empty slots
+
+    uint32_t collapse(const BVH& bvh, uint32_t binaryNode);
+
+    template <typename LaneTest>
+    void query(LaneTest test, const std::vector<GLuint>& triangleIndices, std::vector<GLuint>& out) const;
+};
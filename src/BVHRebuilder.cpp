@@ -0,0 +1,51 @@
+#include "BVHRebuilder.h"
+#include "Parallel.h"
+
+void BVHRebuilder::reset(const BVH& tree) {
+    if (pending.valid())
+        pending.wait(); // The result was built for the old cloth and is dropped
+    pending = std::future<std::unique_ptr<BVH>>();
+    quality = tree.measureQuality();
+    baselineCost = quality.sahCost;
+}
+
+bool BVHRebuilder::update(BVH*& tree, const std::vector<Particle>& particles, const std::vector<GLuint>& indices, uint64_t step, bool deterministic) {
+    if (!tree)
+        return false;
+
+    // A finished rebuild replaces the tree between steps, so no query ever sees half of a swap
+    bool replaced = false;
+    if (pending.valid() && (deterministic || pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+        std::unique_ptr<BVH> rebuilt = pending.get();
+        if (rebuilt && rebuilt->triangleCount() * 3 == static_cast<int>(indices.size())) {
+            rebuilt->bindParticles(particles);
+            rebuilt->refit(step);
+            delete tree;
+            tree = rebuilt.release();
+            quality = tree->measureQuality();
+            baselineCost = quality.sahCost;
+            ++rebuildCount;
+            replaced = true;
+        }
+    }
+
+    if (!replaced)
+        quality = tree->measureQuality();
+
+    if (enabled && !pending.valid() && baselineCost > 0.0f && quality.sahCost > baselineCost * costThreshold) {
+        // The background build works on its own copies, the simulation keeps running on the old tree
+        std::vector<glm::vec3> positions(particles.size());
+        Parallel::forEach(static_cast<int>(particles.size()), [&](int i) {
+            positions[i] = particles[i].getPosition();
+        });
+        std::vector<GLuint> triangles = indices;
+        const bool tracked = tree->tracksRemovals(); // A torn cloth's tree comes ready to be torn further
+        pending = std::async(std::launch::async, [positions = std::move(positions), triangles = std::move(triangles), tracked, builder = builder]() {
+            std::unique_ptr<BVH> rebuilt(new BVH(positions, triangles, builder));
+            if (tracked)
+                rebuilt->trackRemovals();
+            return rebuilt;
+        });
+    }
+    return replaced;
+}
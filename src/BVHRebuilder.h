@@ -0,0 +1,37 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <memory>
+#include <future>
+#include <cstdint>
+#include "Particle.h"
+#include "BVH.h"
+
+// Watches the cloth BVH as refits stretch its boxes. When the SAH cost has grown past costThreshold
+// times its value right after the last build, a new tree is built on a background thread from a
+// snapshot of the positions, and it replaces the old one at the start of a later step.
+class BVHRebuilder {
+public:
+    bool enabled = true;
+    float costThreshold = 1.3f;
+    BVHBuilder builder = BVHBuilder::LBVH; // What a rebuild uses
+
+    BVHQuality quality{ 0.0f, 0.0f };  // Measured this step
+    float baselineCost = 0.0f;         // SAH cost right after the current tree was built
+    int rebuildCount = 0;
+
+    // Call after a fresh build of the tree (drops any rebuild still running for the old one)
+    void reset(const BVH& tree);
+
+    // Call once per step, after the step's refit. Swaps in a finished rebuild (refit for this step),
+    // measures the tree and starts a rebuild if it has degraded. Returns true when the tree was replaced.
+    // With deterministic set, a rebuild is always swapped in on the step after it started (waiting for it
+    // if needed), so the tree in use does not depend on how fast the background thread was.
+    bool update(BVH*& tree, const std::vector<Particle>& particles, const std::vector<GLuint>& indices, uint64_t step, bool deterministic);
+
+    float costRatio() const { return baselineCost > 0.0f ? quality.sahCost / baselineCost : 1.0f; }
+    bool isRebuilding() const { return pending.valid(); }
+
+private:
+    std::future<std::unique_ptr<BVH>> pending;
+};
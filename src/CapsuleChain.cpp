@@ -0,0 +1,165 @@
+#include "CapsuleChain.h"
+#include "SignedDistanceField.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+CapsuleChain::CapsuleChain(std::vector<SkeletonBone> skeleton) : bones(std::move(skeleton)) {
+    const size_t count = bones.size();
+    for (std::vector<float>* array : { &sx, &sy, &sz, &dx, &dy, &dz, &inverseLength2, &radius })
+        array->resize(count);
+    capsuleMin.resize(count);
+    capsuleMax.resize(count);
+    worldRotation.resize(count);
+    setPose(glm::vec3(0.0f), std::vector<glm::quat>(count, glm::quat(1.0f, 0.0f, 0.0f, 0.0f)));
+}
+
+std::unique_ptr<CapsuleChain> CapsuleChain::open(const std::string& path) {
+    auto stream = std::make_unique<PoseStream>();
+    if (!stream->open(path))
+        return nullptr;
+    auto chain = std::make_unique<CapsuleChain>(stream->getBones());
+    chain->stream = std::move(stream);
+    chain->posed = false; // The first streamed pose is where it starts, not a motion from rest
+    chain->advance(0.0f);
+    return chain;
+}
+
+void CapsuleChain::advance(float time) {
+    if (stream && stream->sample(time, streamRoot, streamRotations))
+        setPose(streamRoot, streamRotations);
+}
+
+void CapsuleChain::setPose(const glm::vec3& rootTranslation, const std::vector<glm::quat>& rotations) {
+    const glm::vec3 previousMin = poseMin, previousMax = poseMax;
+    poseMin = glm::vec3(std::numeric_limits<float>::max());
+    poseMax = glm::vec3(-std::numeric_limits<float>::max());
+
+    // Parents come first, so one pass poses every joint
+    for (size_t b = 0; b < bones.size(); ++b) {
+        const SkeletonBone& bone = bones[b];
+        const glm::quat local = b < rotations.size() ? rotations[b] : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        glm::vec3 joint;
+        if (bone.parent < 0) {
+            worldRotation[b] = local;
+            joint = rootTranslation + bone.offset;
+        } else {
+            const glm::quat& parent = worldRotation[bone.parent];
+            worldRotation[b] = parent * local;
+            joint = glm::vec3(sx[bone.parent], sy[bone.parent], sz[bone.parent]) + parent * bone.offset;
+        }
+        const glm::vec3 segment = worldRotation[b] * glm::vec3(0.0f, bone.length, 0.0f);
+        sx[b] = joint.x; sy[b] = joint.y; sz[b] = joint.z;
+        dx[b] = segment.x; dy[b] = segment.y; dz[b] = segment.z;
+        const float length2 = glm::dot(segment, segment);
+        inverseLength2[b] = length2 > 1e-12f ? 1.0f / length2 : 0.0f; // A zero length bone is a sphere
+        radius[b] = bone.radius;
+        capsuleMin[b] = glm::min(joint, joint + segment) - glm::vec3(bone.radius);
+        capsuleMax[b] = glm::max(joint, joint + segment) + glm::vec3(bone.radius);
+        poseMin = glm::min(poseMin, capsuleMin[b]);
+        poseMax = glm::max(poseMax, capsuleMax[b]);
+    }
+
+    boundsMin = posed ? glm::min(poseMin, previousMin) : poseMin;
+    boundsMax = posed ? glm::max(poseMax, previousMax) : poseMax;
+    posed = true;
+}
+
+void CapsuleChain::closestCapsule(const uint32_t* capsules, int capsuleCount, const float* px, const float* py, const float* pz,
+    float* distance, float* nx, float* ny, float* nz, int count) const {
+    for (int c = 0; c < capsuleCount; ++c) {
+        const uint32_t k = capsules[c];
+        const float ax = sx[k], ay = sy[k], az = sz[k];
+        const float ux = dx[k], uy = dy[k], uz = dz[k];
+        const float inverse2 = inverseLength2[k], r = radius[k];
+#pragma omp simd
+        for (int i = 0; i < count; ++i) {
+            // From the closest point of the bone segment
+            const float wx = px[i] - ax, wy = py[i] - ay, wz = pz[i] - az;
+            const float t = std::min(std::max((wx * ux + wy * uy + wz * uz) * inverse2, 0.0f), 1.0f);
+            const float ox = wx - t * ux, oy = wy - t * uy, oz = wz - t * uz;
+            const float length = std::sqrt(ox * ox + oy * oy + oz * oz);
+            const float inverse = 1.0f / std::max(length, 1e-12f);
+            const float d = length - r;
+            const bool closer = d < distance[i];
+            distance[i] = closer ? d : distance[i];
+            nx[i] = closer ? ox * inverse : nx[i];
+            ny[i] = closer ? (length > 1e-12f ? oy * inverse : 1.0f) : ny[i]; // On the bone: straight up
+            nz[i] = closer ? oz * inverse : nz[i];
+        }
+    }
+}
+
+float CapsuleChain::sample(const glm::vec3& position, glm::vec3& normal) const {
+    float distance;
+    sampleBatch(&position.x, &position.y, &position.z, &distance, &normal.x, &normal.y, &normal.z, 1);
+    return distance;
+}
+
+void CapsuleChain::sampleBatch(const float* px, const float* py, const float* pz,
+    float* distance, float* nx, float* ny, float* nz, int count) const {
+    for (int i = 0; i < count; ++i) {
+        distance[i] = std::numeric_limits<float>::max();
+        nx[i] = nz[i] = 0.0f;
+        ny[i] = 1.0f;
+    }
+    uint32_t capsules[CapsuleBatch];
+    for (size_t first = 0; first < bones.size(); first += CapsuleBatch) {
+        const int batch = static_cast<int>(std::min<size_t>(CapsuleBatch, bones.size() - first));
+        for (int c = 0; c < batch; ++c)
+            capsules[c] = static_cast<uint32_t>(first + c);
+        closestCapsule(capsules, batch, px, py, pz, distance, nx, ny, nz, count);
+    }
+}
+
+void CapsuleChain::resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const {
+    Parallel::forBlocks(candidateCount, [&](int begin, int end) {
+        float px[Parallel::BlockSize], py[Parallel::BlockSize], pz[Parallel::BlockSize];
+        float distance[Parallel::BlockSize], nx[Parallel::BlockSize], ny[Parallel::BlockSize], nz[Parallel::BlockSize];
+        uint32_t capsules[CapsuleBatch];
+        const int count = end - begin;
+
+        // Where two capsules overlap, the way out of one can end inside the other: the block is tested
+        // again after a push, up to ProjectionPasses times
+        for (int pass = 0; pass < ProjectionPasses; ++pass) {
+            glm::vec3 blockMin(std::numeric_limits<float>::max()), blockMax(-std::numeric_limits<float>::max());
+            for (int i = 0; i < count; ++i) {
+                glm::vec3 p = particles[candidates ? candidates[begin + i] : begin + i].getPosition();
+                px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+                distance[i] = std::numeric_limits<float>::max();
+                nx[i] = nz[i] = 0.0f;
+                ny[i] = 1.0f;
+                blockMin = glm::min(blockMin, p);
+                blockMax = glm::max(blockMax, p);
+            }
+            blockMin -= glm::vec3(thickness);
+            blockMax += glm::vec3(thickness);
+
+            // Only capsules within thickness of the block's box can push any of its particles; the others
+            // never win a particle that is in contact, so skipping them leaves the contacts exact
+            int nearby = 0;
+            bool any = false;
+            for (size_t k = 0; k < bones.size(); ++k) {
+                if (glm::any(glm::lessThan(capsuleMax[k], blockMin)) || glm::any(glm::greaterThan(capsuleMin[k], blockMax)))
+                    continue;
+                capsules[nearby++] = static_cast<uint32_t>(k);
+                if (nearby == CapsuleBatch) {
+                    closestCapsule(capsules, nearby, px, py, pz, distance, nx, ny, nz, count);
+                    nearby = 0;
+                }
+                any = true;
+            }
+            if (!any)
+                return;
+            closestCapsule(capsules, nearby, px, py, pz, distance, nx, ny, nz, count);
+
+            bool pushed = false;
+            for (int i = 0; i < count; ++i)
+                pushed |= distance[i] < thickness;
+            if (!pushed)
+                return;
+            SignedDistanceField::pushOut(particles, candidates, begin, count, distance, nx, ny, nz, thickness, staticFriction, kineticFriction);
+        }
+    });
+}
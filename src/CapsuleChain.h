@@ -0,0 +1,63 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "Particle.h"
+#include "PoseStream.h"
+
+// Body proxy: a skeleton with a capsule around each bone, posed every step by forward kinematics from
+// local bone rotations, usually played from a PoseStream. Cloth is tested against the capsules only,
+// which is a few dozen segment distances per particle instead of a mesh query. The capsules are kept as
+// x/y/z arrays; the query runs capsule by capsule over a block of particles in one SIMD loop, and a block
+// only visits the capsules whose box is near its own.
+class CapsuleChain {
+public:
+    explicit CapsuleChain(std::vector<SkeletonBone> bones);
+    // Skeleton and motion from a pose stream file; nullptr if it cannot be read
+    static std::unique_ptr<CapsuleChain> open(const std::string& path);
+
+    // rotations: one local rotation per bone, relative to the parent
+    void setPose(const glm::vec3& rootTranslation, const std::vector<glm::quat>& rotations);
+    // Poses the chain at this time of its stream (nothing without one)
+    void advance(float time);
+
+    // Distance to the closest capsule (negative inside) and the outward normal there
+    float sample(const glm::vec3& position, glm::vec3& normal) const;
+    void sampleBatch(const float* px, const float* py, const float* pz,
+        float* distance, float* nx, float* ny, float* nz, int count) const;
+    // Pushes particles candidates[0 .. candidateCount) (all of them when null) closer than thickness out
+    void resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const;
+
+    int getBoneCount() const { return static_cast<int>(bones.size()); }
+    const std::vector<SkeletonBone>& getBones() const { return bones; }
+    // Root joint of the rest pose
+    glm::vec3 getCenter() const { return bones.empty() ? glm::vec3(0.0f) : bones[0].offset; }
+    // Around the capsules in this pose and the one before, so a limb's motion over the step is covered
+    glm::vec3 getBoundsMin(float reach) const { return boundsMin - glm::vec3(reach); }
+    glm::vec3 getBoundsMax(float reach) const { return boundsMax + glm::vec3(reach); }
+
+private:
+    static constexpr int CapsuleBatch = 64;    // Capsules tested per pass over a block of particles
+    static constexpr int ProjectionPasses = 3; // Most a particle is pushed per step, one capsule after another
+
+    std::vector<SkeletonBone> bones;
+    std::unique_ptr<PoseStream> stream;
+    glm::vec3 streamRoot = glm::vec3(0.0f);
+    std::vector<glm::quat> streamRotations;
+
+    // Posed capsules: segment from (sx, sy, sz) along (dx, dy, dz), and each capsule's box
+    std::vector<float> sx, sy, sz, dx, dy, dz, inverseLength2, radius;
+    std::vector<glm::vec3> capsuleMin, capsuleMax;
+    std::vector<glm::quat> worldRotation; // Scratch for setPose
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+    glm::vec3 poseMin = glm::vec3(0.0f), poseMax = glm::vec3(0.0f); // This pose only
+    bool posed = false;
+
+    // Lowers distance and replaces the normal wherever one of capsules[0 .. capsuleCount) is closer
+    void closestCapsule(const uint32_t* capsules, int capsuleCount, const float* px, const float* py, const float* pz,
+        float* distance, float* nx, float* ny, float* nz, int count) const;
+};
@@ -0,0 +1,208 @@
+#include "ClothCollision.h"
+#include "Parallel.h"
+#include "TraversalStack.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // Barycentric weights of a point of the triangle (a, b, c)
+    glm::vec3 barycentric(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+        float d00 = glm::dot(ab, ab), d01 = glm::dot(ab, ac), d11 = glm::dot(ac, ac);
+        float d20 = glm::dot(ap, ab), d21 = glm::dot(ap, ac);
+        float denominator = d00 * d11 - d01 * d01;
+        if (denominator <= 0.0f)
+            return glm::vec3(1.0f, 0.0f, 0.0f);
+        float v = (d11 * d20 - d01 * d21) / denominator;
+        float w = (d00 * d21 - d01 * d20) / denominator;
+        return glm::vec3(1.0f - v - w, v, w);
+    }
+}
+
+bool ClothCollision::overlaps(const BVHNode& a, const BVHNode& b) const {
+    return !(glm::any(glm::lessThan(a.max + glm::vec3(thickness), b.min)) || glm::any(glm::greaterThan(a.min - glm::vec3(thickness), b.max)));
+}
+
+template <typename Visit>
+void ClothCollision::descend(const BVH& a, const BVH& b, const NodePair& pair, Visit visit) const {
+    const BVHNode& nodeA = a.nodes[pair.a];
+    const BVHNode& nodeB = b.nodes[pair.b];
+    // Into both at once when both are internal, which visits half as many internal pairs as going down one
+    // side at a time
+    const uint32_t firstA = nodeA.isLeaf() ? pair.a : nodeA.leftFirst, endA = nodeA.isLeaf() ? pair.a + 1 : nodeA.leftFirst + 2;
+    const uint32_t firstB = nodeB.isLeaf() ? pair.b : nodeB.leftFirst, endB = nodeB.isLeaf() ? pair.b + 1 : nodeB.leftFirst + 2;
+    for (uint32_t childA = firstA; childA < endA; ++childA) {
+        for (uint32_t childB = firstB; childB < endB; ++childB) {
+            if (overlaps(a.nodes[childA], b.nodes[childB]))
+                visit(NodePair{ childA, childB });
+        }
+    }
+}
+
+int ClothCollision::resolve(std::vector<Particle>& particles, const BVH& a, const BVH& b) {
+    contactCount = 0;
+    if (a.empty() || b.empty() || !overlaps(a.nodes[0], b.nodes[0]))
+        return 0;
+    if (closestCount != particles.size()) {
+        closestCount = particles.size();
+        closest.reset(new std::atomic<uint64_t>[closestCount]);
+        for (size_t i = 0; i < closestCount; ++i)
+            closest[i].store(NoContact, std::memory_order_relaxed);
+    }
+
+    // Breadth first until there are enough pairs to share out. The cut depends on the trees and their
+    // bounds only, and every pair in it overlaps.
+    pairs.assign(1, NodePair{ 0, 0 });
+    while (static_cast<int>(pairs.size()) < PairTasks) {
+        nextPairs.clear();
+        bool split = false;
+        for (const NodePair& pair : pairs) {
+            if (a.nodes[pair.a].isLeaf() && b.nodes[pair.b].isLeaf()) {
+                nextPairs.push_back(pair);
+                continue;
+            }
+            descend(a, b, pair, [&](const NodePair& child) { nextPairs.push_back(child); });
+            split = true;
+        }
+        pairs.swap(nextPairs);
+        if (!split || pairs.empty())
+            break;
+    }
+
+    // Built here, before the parallel part, when a tree changed since the last step
+    a.ownedCorners();
+    b.ownedCorners();
+
+    const int pairCount = static_cast<int>(pairs.size());
+    pairTouched.resize(pairCount);
+    Parallel::forEach(pairCount, [&](int i) {
+        pairTouched[i].clear();
+        traverse(a, b, pairs[i], particles, pairTouched[i]);
+    }, 4);
+    touched.clear();
+    for (int i = 0; i < pairCount; ++i)
+        touched.insert(touched.end(), pairTouched[i].begin(), pairTouched[i].end());
+    std::sort(touched.begin(), touched.end());
+
+    // One at a time in vertex order, each from the positions the pushes before it left
+    for (GLuint v : touched) {
+        const uint64_t key = closest[v].load(std::memory_order_relaxed);
+        closest[v].store(NoContact, std::memory_order_relaxed);
+        const BVH& faces = (key & 1) ? b : a;
+        const uint32_t slot = static_cast<uint32_t>(key) >> 1;
+        Contact contact;
+        if (makeContact(v, &faces.triangleIndices[3 * slot], particles, contact)) {
+            applyContact(contact, particles);
+            ++contactCount;
+        }
+    }
+    return contactCount;
+}
+
+void ClothCollision::traverse(const BVH& a, const BVH& b, NodePair root, const std::vector<Particle>& particles, std::vector<GLuint>& found) {
+    // Every pop pushes at most four pairs, three more than it takes, once per level of the deeper tree
+    TraversalStack<NodePair, 256> stack;
+    stack.push(root);
+    while (!stack.empty()) {
+        const NodePair pair = stack.pop();
+        const BVHNode& nodeA = a.nodes[pair.a];
+        const BVHNode& nodeB = b.nodes[pair.b];
+        if (nodeA.isLeaf() && nodeB.isLeaf()) {
+            testCorners(a, nodeA.leftFirst, nodeA.count, nodeB, b, true, particles, found);
+            testCorners(b, nodeB.leftFirst, nodeB.count, nodeA, a, false, particles, found);
+            continue;
+        }
+        descend(a, b, pair, [&](const NodePair& child) { stack.push(child); });
+    }
+}
+
+void ClothCollision::testCorners(const BVH& tree, uint32_t first, uint32_t count, const BVHNode& leaf, const BVH& other, bool otherIsB,
+    const std::vector<Particle>& particles, std::vector<GLuint>& found) {
+    const std::vector<uint8_t>& owned = tree.ownedCorners();
+    const glm::vec3 boxMin = leaf.min - glm::vec3(thickness), boxMax = leaf.max + glm::vec3(thickness);
+    const GLuint* faces = other.leafTriangles(leaf);
+    for (uint32_t slot = first; slot < first + count; ++slot) {
+        for (int k = 0; k < 3; ++k) {
+            if (!(owned[slot] & (1 << k)))
+                continue;
+            const GLuint v = tree.triangleIndices[3 * slot + k];
+            const glm::vec3 p = particles[v].getPosition();
+            if (glm::any(glm::lessThan(p, boxMin)) || glm::any(glm::greaterThan(p, boxMax)))
+                continue;
+            for (uint32_t j = 0; j < leaf.count; ++j) {
+                const GLuint* face = faces + 3 * j;
+                if (v == face[0] || v == face[1] || v == face[2])
+                    continue;
+                // The triangle's own box first, which turns away most of a leaf of several triangles
+                const glm::vec3 a = particles[face[0]].getPosition();
+                const glm::vec3 b = particles[face[1]].getPosition();
+                const glm::vec3 c = particles[face[2]].getPosition();
+                if (glm::any(glm::lessThan(p, glm::min(a, glm::min(b, c)) - glm::vec3(thickness))) ||
+                    glm::any(glm::greaterThan(p, glm::max(a, glm::max(b, c)) + glm::vec3(thickness))))
+                    continue;
+                const glm::vec3 offset = p - BVH::closestPointOnTriangle(p, a, b, c);
+                const float distance2 = glm::dot(offset, offset);
+                if (distance2 >= thickness * thickness)
+                    continue;
+
+                // A non-negative float's bits order like the float, so the smallest key is the closest
+                // triangle, then the lowest slot
+                uint32_t bits;
+                std::memcpy(&bits, &distance2, sizeof(bits));
+                const uint64_t key = (static_cast<uint64_t>(bits) << 32) | ((leaf.leftFirst + j) << 1) | (otherIsB ? 1u : 0u);
+                uint64_t previous = closest[v].load(std::memory_order_relaxed);
+                while (key < previous && !closest[v].compare_exchange_weak(previous, key, std::memory_order_relaxed)) {}
+                if (previous == NoContact)
+                    found.push_back(v);
+            }
+        }
+    }
+}
+
+bool ClothCollision::makeContact(GLuint v, const GLuint* face, const std::vector<Particle>& particles, Contact& contact) const {
+    const glm::vec3 p = particles[v].getPosition();
+    const glm::vec3 a = particles[face[0]].getPosition();
+    const glm::vec3 b = particles[face[1]].getPosition();
+    const glm::vec3 c = particles[face[2]].getPosition();
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    const float length = glm::length(normal);
+    if (length < 1e-12f)
+        return false;
+    normal /= length;
+
+    // The side the vertex started the step on, or the one it is on now if it started in the plane
+    const glm::vec3 closestPoint = BVH::closestPointOnTriangle(p, a, b, c);
+    const glm::vec3 a0 = particles[face[0]].getPreviousPosition();
+    float side = glm::dot(particles[v].getPreviousPosition() - a0,
+        glm::cross(particles[face[1]].getPreviousPosition() - a0, particles[face[2]].getPreviousPosition() - a0));
+    if (std::abs(side) < 1e-12f)
+        side = glm::dot(p - closestPoint, normal);
+    if (side < 0.0f)
+        normal = -normal;
+
+    const glm::vec3 weights = barycentric(closestPoint, a, b, c);
+    contact = Contact{ { v, face[0], face[1], face[2] }, { 1.0f, -weights.x, -weights.y, -weights.z }, normal };
+    return true;
+}
+
+// Moves the vertex and the triangle apart along the normal until they are thickness apart, split between
+// them by weight and inverse mass, from where they are now
+void ClothCollision::applyContact(const Contact& contact, std::vector<Particle>& particles) const {
+    float separation = 0.0f, denominator = 0.0f;
+    float inverseMass[4];
+    for (int k = 0; k < 4; ++k) {
+        const Particle& particle = particles[contact.vertices[k]];
+        separation += contact.weights[k] * glm::dot(particle.getPosition(), contact.normal);
+        inverseMass[k] = particle.isPinned() ? 0.0f : 1.0f / particle.getMass();
+        denominator += contact.weights[k] * contact.weights[k] * inverseMass[k];
+    }
+
+    const float correction = thickness - separation;
+    if (correction <= 0.0f || denominator <= 0.0f)
+        return;
+    for (int k = 0; k < 4; ++k) {
+        if (inverseMass[k] > 0.0f)
+            particles[contact.vertices[k]].displace(contact.normal * (correction * contact.weights[k] * inverseMass[k] / denominator));
+    }
+}
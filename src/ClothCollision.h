@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include "Particle.h"
+#include "BVH.h"
+
+// Collision between separate cloth instances (the layers of a garment, a stack of sheets), each with its own
+// BVH. The two trees are traversed against each other with their boxes grown by thickness, so the cost
+// follows the regions where the cloths come close, not their size. Every vertex of one cloth within
+// thickness of the other is pushed back out to thickness from the closest triangle, on the side of it the
+// vertex was on at the start of the step; the push is split between the vertex and the triangle's corners by
+// inverse mass. Deeper crossings are left to ContinuousCollision.
+//
+// The pair traversal is cut into subtree pairs, which are then traversed in parallel. A vertex is tested from
+// one of its triangles only (BVH::ownedCorners) and keeps its closest triangle as an atomic minimum, which
+// does not depend on the order the pairs run in; the pushes are then made one vertex at a time in vertex
+// order, so the result does not depend on the thread count.
+class ClothCollision {
+public:
+    bool enabled = false;
+    float thickness = 0.01f; // Distance kept between the cloths
+    int contactCount = 0;    // Vertices found within thickness by the last resolve
+
+    // Both cloths' vertices are in particles; a and b are built over their own triangles.
+    // Returns the number of vertices found within thickness.
+    int resolve(std::vector<Particle>& particles, const BVH& a, const BVH& b);
+
+private:
+    static constexpr int PairTasks = 256; // Subtree pairs to cut the traversal into before it goes parallel
+    static constexpr uint64_t NoContact = UINT64_MAX;
+
+    struct NodePair {
+        uint32_t a;
+        uint32_t b;
+    };
+
+    // vertices[0] is the vertex, [1..3] the triangle. weights are 1 and minus the barycentric weights of the
+    // closest point, so sum(weights[i] * x[i]) is the separation vector.
+    struct Contact {
+        GLuint vertices[4];
+        float weights[4];
+        glm::vec3 normal; // Out of the triangle, towards the vertex's side
+    };
+
+    std::vector<NodePair> pairs;
+    std::vector<NodePair> nextPairs;
+    // Per particle, the closest triangle of the other cloth found so far: (squared distance bits << 32) |
+    // (leaf slot << 1) | (1 if the slot is in b), NoContact when none. Back to NoContact after every resolve.
+    std::unique_ptr<std::atomic<uint64_t>[]> closest;
+    size_t closestCount = 0;
+    std::vector<std::vector<GLuint>> pairTouched; // Vertices each pair task found a first triangle for
+    std::vector<GLuint> touched;
+
+    bool overlaps(const BVHNode& a, const BVHNode& b) const;
+    // Calls visit(child pair) for the overlapping pairs one level down (on both sides that are not leaves)
+    template <typename Visit>
+    void descend(const BVH& a, const BVH& b, const NodePair& pair, Visit visit) const;
+    void traverse(const BVH& a, const BVH& b, NodePair root, const std::vector<Particle>& particles, std::vector<GLuint>& found);
+    // The corners of the triangles in slots [first, first + count) of tree that it owns, against the
+    // triangles of a leaf of the other tree
+    void testCorners(const BVH& tree, uint32_t first, uint32_t count, const BVHNode& leaf, const BVH& other, bool otherIsB,
+        const std::vector<Particle>& particles, std::vector<GLuint>& found);
+    // Contact of vertex v with the triangle face, from the current positions; false if the triangle is degenerate
+    bool makeContact(GLuint v, const GLuint* face, const std::vector<Particle>& particles, Contact& contact) const;
+    void applyContact(const Contact& contact, std::vector<Particle>& particles) const;
+};
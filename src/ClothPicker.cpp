@@ -0,0 +1,96 @@
+#include "ClothPicker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    // Moller-Trumbore, both sides; the ray parameter of the hit or a negative value on a miss
+    float intersect(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        const glm::vec3 e1 = b - a, e2 = c - a;
+        const glm::vec3 p = glm::cross(direction, e2);
+        const float det = glm::dot(e1, p);
+        if (std::abs(det) < 1e-12f)
+            return -1.0f;
+        const float invDet = 1.0f / det;
+        const glm::vec3 s = origin - a;
+        const float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return -1.0f;
+        const glm::vec3 q = glm::cross(s, e1);
+        const float v = glm::dot(direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return -1.0f;
+        return glm::dot(e2, q) * invDet;
+    }
+}
+
+bool ClothPicker::pick(const BVH& bvh, const std::vector<Particle>& particles, const std::vector<GLuint>& indices,
+    const glm::vec3& origin, const glm::vec3& direction, float maxT, const glm::vec3& viewDirection) {
+    const auto start = std::chrono::steady_clock::now();
+    particle = -1;
+    float t;
+    uint32_t triangle;
+    bool hit = bvh.raycast(origin, direction, maxT, t, triangle);
+    for (uint32_t moved : movedTriangles) {
+        const GLuint* face = &indices[3 * moved];
+        const float movedT = intersect(origin, direction, particles[face[0]].getPosition(), particles[face[1]].getPosition(), particles[face[2]].getPosition());
+        if (movedT >= 0.0f && movedT <= (hit ? t : maxT)) {
+            t = movedT;
+            triangle = moved;
+            hit = true;
+        }
+    }
+    if (hit) {
+        // The hit triangle's corner nearest to the hit point
+        const glm::vec3 point = origin + t * direction;
+        float nearest = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            const GLuint v = indices[3 * triangle + k];
+            const glm::vec3 d = particles[v].getPosition() - point;
+            if (particle < 0 || glm::dot(d, d) < nearest) {
+                particle = static_cast<int>(v);
+                nearest = glm::dot(d, d);
+            }
+        }
+        offset = particles[particle].getPosition() - point;
+        depth = glm::dot(point - origin, viewDirection);
+        target = particles[particle].getPosition();
+    }
+    pickTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return hit;
+}
+
+void ClothPicker::drag(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& viewDirection) {
+    if (particle < 0)
+        return;
+    // Where the ray crosses the plane facing the camera at the grabbed depth. The ray points into the view
+    // frustum, so it is never parallel to that plane.
+    const float along = glm::dot(direction, viewDirection);
+    if (along <= 1e-6f)
+        return;
+    target = origin + (depth / along) * direction + offset;
+}
+
+void ClothPicker::markMoved(uint32_t triangle) {
+    // Dragging one particle around marks the same few triangles every frame
+    if (std::find(movedTriangles.begin(), movedTriangles.end(), triangle) == movedTriangles.end())
+        movedTriangles.push_back(triangle);
+}
+
+int ClothPicker::apply(std::vector<Particle>& particles) const {
+    if (particle < 0)
+        return -1;
+    Particle& grabbed = particles[particle];
+    if (grabbed.isPinned())
+        grabbed.setPosition(target);
+    else
+        grabbed.displace((target - grabbed.getPosition()) * stiffness);
+    return particle;
+}
+
+int ClothPicker::place(std::vector<Particle>& particles) const {
+    if (particle < 0)
+        return -1;
+    particles[particle].setPosition(target);
+    return particle;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include "Particle.h"
+#include "BVH.h"
+
+// Mouse picking and dragging. A click casts the ray through the cursor into the cloth BVH and grabs the
+// corner of the hit triangle nearest to the hit; the ray only enters the nodes it passes through, nearest
+// first, so a pick costs about the same at any cloth size. The tree is the one refit at the start of the
+// last step; the triangles are tested at their current positions. While the button is held the particle is
+// pulled to where the cursor ray crosses the plane facing the camera at the grabbed depth, keeping the
+// offset from the hit point it was grabbed at so it does not jump.
+class ClothPicker {
+public:
+    bool enabled = true;
+    float stiffness = 1.0f; // Fraction of the way to the cursor a dragged particle is moved every step
+    float pickTime = 0.0f;  // Milliseconds the last pick took
+
+    // Grabs the particle under the ray origin + t * direction (direction normalized, maxT its length),
+    // false when it hits no triangle. viewDirection is the camera's forward axis.
+    bool pick(const BVH& bvh, const std::vector<Particle>& particles, const std::vector<GLuint>& indices,
+        const glm::vec3& origin, const glm::vec3& direction, float maxT, const glm::vec3& viewDirection);
+    // Moves the target to the new cursor ray
+    void drag(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& viewDirection);
+    void release() { particle = -1; }
+
+    // A paused drag moves a particle without a refit of the tree (a full refit is far more than a pick), so
+    // the triangles around it may lie outside their boxes. They are listed here and tested against the ray
+    // directly until the next step's refit clears them.
+    void markMoved(uint32_t triangle);
+    void clearMoved() { movedTriangles.clear(); }
+
+    bool isDragging() const { return particle >= 0; }
+    int getParticle() const { return particle; }
+    const glm::vec3& getTarget() const { return target; }
+
+    // The drag constraint, once per step after integration: the particle is moved towards the target and
+    // keeps the motion as velocity, so it swings when let go. A pinned particle is moved all the way and
+    // stays pinned there. Returns the particle moved, -1 when nothing is dragged.
+    int apply(std::vector<Particle>& particles) const;
+    // The same while the simulation is paused: the particle goes straight to the target, with no velocity
+    int place(std::vector<Particle>& particles) const;
+
+private:
+    int particle = -1;
+    glm::vec3 target = glm::vec3(0.0f);
+    glm::vec3 offset = glm::vec3(0.0f); // Grabbed particle minus the hit point
+    float depth = 0.0f;                 // Of the hit point along the view direction, from the ray origin
+    std::vector<uint32_t> movedTriangles;
+};
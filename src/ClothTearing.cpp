@@ -0,0 +1,29 @@
+#include "ClothTearing.h"
+#include "Parallel.h"
+
+int* ClothTearing::beginCount(int springCount) {
+    blockStart.assign(Parallel::blockCount(springCount) + 1, 0);
+    return blockStart.data() + 1;
+}
+
+const std::vector<int>& ClothTearing::collectBroken(const std::vector<Spring>& springs) {
+    // Counts to offsets, then every block with a break writes its springs at its offset
+    const int blocks = static_cast<int>(blockStart.size()) - 1;
+    for (int b = 0; b < blocks; ++b)
+        blockStart[b + 1] += blockStart[b];
+
+    broken.resize(blocks > 0 ? blockStart[blocks] : 0);
+    if (!broken.empty()) {
+        Parallel::forBlocks(static_cast<int>(springs.size()), [&](int begin, int end) {
+            const int block = begin / Parallel::BlockSize;
+            if (blockStart[block] == blockStart[block + 1])
+                return;
+            int next = blockStart[block];
+            for (int s = begin; s < end; ++s) {
+                if (snaps(springs[s]))
+                    broken[next++] = s;
+            }
+        });
+    }
+    return broken;
+}
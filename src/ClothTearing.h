@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "Spring.h"
+
+// Tearing: a spring stretched past breakingStrain breaks, and the triangles it was an edge of go with it.
+// This finds the springs; Application::tearCloth edits the topology in place (springs, triangles, both
+// adjacencies, the BVH and the changed part of the index buffer), so a step costs what broke, not the
+// size of the cloth.
+class ClothTearing {
+public:
+    bool enabled = false;
+    float breakingStrain = 0.6f; // Breaks at (1 + breakingStrain) times the rest length
+
+    int brokenSprings = 0;     // Last step
+    int removedTriangles = 0;  // Last step
+    int totalBrokenSprings = 0;
+
+    bool snaps(const Spring& spring) const {
+        glm::vec3 d = spring.getP2()->getPosition() - spring.getP1()->getPosition();
+        const float length = (1.0f + breakingStrain) * spring.getRestLength();
+        return glm::dot(d, d) > length * length;
+    }
+
+    // Broken springs are found in two passes. The spring force loop, which reads both ends anyway, counts
+    // them per block of Parallel::BlockSize springs into the array beginCount returns; collectBroken then
+    // lists them in spring order, looking again only at the blocks that had one.
+    int* beginCount(int springCount);
+    const std::vector<int>& collectBroken(const std::vector<Spring>& springs);
+
+    // Edits of one item's list entries[begin .. end) in an adjacency with a fixed start per item and a
+    // shrinking end. The order of the other entries is kept, so gathers stay in the same order.
+    static void eraseEntry(std::vector<int>& entries, int begin, int& end, int value) {
+        end = static_cast<int>(std::remove(entries.begin() + begin, entries.begin() + end, value) - entries.begin());
+    }
+    static void replaceEntry(std::vector<int>& entries, int begin, int end, int from, int to) {
+        std::replace(entries.begin() + begin, entries.begin() + end, from, to);
+    }
+
+private:
+    std::vector<int> broken;
+    std::vector<int> blockStart; // Per block count, then broken springs before every block
+};
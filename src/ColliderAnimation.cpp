@@ -0,0 +1,54 @@
+#include "ColliderAnimation.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+glm::mat4 ColliderTransform::matrix(const glm::vec3& pivot) const {
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), pivot + translation);
+    m = m * glm::mat4_cast(rotation);
+    m = glm::scale(m, glm::vec3(scale));
+    return glm::translate(m, -pivot);
+}
+
+bool ColliderTransform::isIdentity() const {
+    return translation == glm::vec3(0.0f) && rotation == glm::quat(1.0f, 0.0f, 0.0f, 0.0f) && scale == 1.0f;
+}
+
+ColliderTransform ColliderTransform::interpolate(const ColliderTransform& a, const ColliderTransform& b, float t) {
+    ColliderTransform result;
+    result.translation = glm::mix(a.translation, b.translation, t);
+    result.rotation = glm::slerp(a.rotation, b.rotation, t);
+    result.scale = a.scale + (b.scale - a.scale) * t;
+    return result;
+}
+
+void ColliderAnimation::addKeyframe(float time, const ColliderTransform& transform) {
+    auto at = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+        [](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+    keyframes.insert(at, Keyframe{ time, transform });
+}
+
+ColliderTransform ColliderAnimation::evaluate(float time) const {
+    if (script)
+        return script(time);
+    if (keyframes.empty())
+        return ColliderTransform();
+    if (keyframes.size() == 1)
+        return keyframes.front().transform;
+
+    const float start = keyframes.front().time;
+    const float length = keyframes.back().time - start;
+    if (loop && length > 0.0f)
+        time = start + std::fmod(std::fmod(time - start, length) + length, length);
+    if (time <= start)
+        return keyframes.front().transform;
+    if (time >= keyframes.back().time)
+        return keyframes.back().transform;
+
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+        [](float t, const Keyframe& keyframe) { return t < keyframe.time; });
+    const Keyframe& b = *next;
+    const Keyframe& a = *(next - 1);
+    const float span = b.time - a.time;
+    return ColliderTransform::interpolate(a.transform, b.transform, span > 0.0f ? (time - a.time) / span : 1.0f);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <functional>
+
+// Pose of a collider relative to its rest shape: scaled and rotated about the shape's pivot (its center),
+// then translated. The scale is uniform, so distances only change by that factor and normals only rotate,
+// and the collision can run on the rest shape unchanged.
+struct ColliderTransform {
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    float scale = 1.0f;
+
+    glm::vec3 toWorld(const glm::vec3& rest, const glm::vec3& pivot) const {
+        return pivot + translation + rotation * (scale * (rest - pivot));
+    }
+    glm::vec3 toRest(const glm::vec3& world, const glm::vec3& pivot) const {
+        return pivot + (glm::conjugate(rotation) * (world - pivot - translation)) / scale;
+    }
+    glm::mat4 matrix(const glm::vec3& pivot) const;
+    bool isIdentity() const;
+
+    static ColliderTransform interpolate(const ColliderTransform& a, const ColliderTransform& b, float t);
+};
+
+// Motion of a collider over time: keyframes, interpolated linearly (rotations by slerp) and held or looped
+// past the last one, or a script, any function of time
+class ColliderAnimation {
+public:
+    struct Keyframe {
+        float time;
+        ColliderTransform transform;
+    };
+
+    bool loop = true;
+
+    void addKeyframe(float time, const ColliderTransform& transform);
+    void setScript(std::function<ColliderTransform(float)> motion) { script = std::move(motion); }
+    bool empty() const { return keyframes.empty() && !script; }
+
+    ColliderTransform evaluate(float time) const;
+
+private:
+    std::vector<Keyframe> keyframes; // Sorted by time
+    std::function<ColliderTransform(float)> script;
+};
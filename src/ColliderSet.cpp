@@ -0,0 +1,360 @@
+#include "ColliderSet.h"
+#include "NewCollision.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+int ColliderSet::insert(std::unique_ptr<ColliderShape> shape) {
+    intervalsDirty = true;
+    Collider collider;
+    collider.pivot = shape->center();
+    collider.shape = std::move(shape);
+    for (size_t i = 0; i < colliders.size(); ++i) {
+        if (!colliders[i].live()) {
+            colliders[i] = std::move(collider);
+            return static_cast<int>(i);
+        }
+    }
+    colliders.push_back(std::move(collider));
+    return static_cast<int>(colliders.size()) - 1;
+}
+
+int ColliderSet::add(std::unique_ptr<Object> object) {
+    return insert(std::unique_ptr<ColliderShape>(new ObjectShape(std::move(object))));
+}
+
+int ColliderSet::add(std::unique_ptr<SignedDistanceField> field) {
+    return insert(std::unique_ptr<ColliderShape>(new FieldShape<SignedDistanceField>(std::move(field))));
+}
+
+int ColliderSet::add(std::unique_ptr<SparseDistanceField> field) {
+    return insert(std::unique_ptr<ColliderShape>(new FieldShape<SparseDistanceField>(std::move(field))));
+}
+
+int ColliderSet::add(std::unique_ptr<AnalyticCollider> shape) {
+    return insert(std::unique_ptr<ColliderShape>(new FieldShape<AnalyticCollider>(std::move(shape))));
+}
+
+int ColliderSet::add(std::unique_ptr<CapsuleChain> body) {
+    if (!body) // CapsuleChain::open failed
+        return -1;
+    std::unique_ptr<ColliderShape> shape(new FieldShape<CapsuleChain>(std::move(body)));
+    shape->advance(time);
+    return insert(std::move(shape));
+}
+
+void ColliderSet::remove(int id) {
+    if (!contains(id))
+        return;
+    colliders[id] = Collider();
+    intervalsDirty = true;
+}
+
+void ColliderSet::clear() {
+    colliders.clear();
+    intervalsDirty = true;
+}
+
+int ColliderSet::size() const {
+    int count = 0;
+    for (const Collider& collider : colliders)
+        count += collider.live() ? 1 : 0;
+    return count;
+}
+
+void ColliderSet::clearContacts() {
+    for (Collider& collider : colliders)
+        collider.contacts.clear();
+}
+
+void ColliderSet::setAnimation(int id, ColliderAnimation animation) {
+    if (!contains(id))
+        return;
+    Collider& collider = colliders[id];
+    collider.animation = std::move(animation);
+    collider.current = collider.animation.empty() ? ColliderTransform() : collider.animation.evaluate(time);
+    collider.previous = collider.current; // Starts from rest: a jump to the first pose is not a motion
+    collider.moving = !collider.current.isIdentity();
+    collider.shape->setPose(collider.current.matrix(collider.pivot));
+}
+
+void ColliderSet::advance(float dt) {
+    time += dt;
+    for (Collider& collider : colliders) {
+        if (!collider.live())
+            continue;
+        collider.previous = collider.current;
+        collider.shape->advance(time);
+        if (!collider.animation.empty())
+            collider.current = collider.animation.evaluate(time);
+        collider.moving = !collider.previous.isIdentity() || !collider.current.isIdentity();
+        if (collider.moving)
+            collider.shape->setPose(collider.current.matrix(collider.pivot));
+    }
+}
+
+void ColliderSet::rewind() {
+    time = 0.0f;
+    // The second advance makes the pose at 0 both the previous and the current one
+    advance(0.0f);
+    advance(0.0f);
+}
+
+void ColliderSet::updateBoxes(const BVH& clothBVH, float particleMotion) {
+    clothBVH.subtreeRoots(SubtreeTarget, subtrees);
+    if (subtrees != lastSubtrees) { // New tree (rebuilt, or another cloth)
+        lastSubtrees = subtrees;
+        intervalsDirty = true;
+    }
+
+    const size_t subtreeCount = subtrees.size();
+    boxMin.resize(subtreeCount + colliders.size());
+    boxMax.resize(subtreeCount + colliders.size());
+    for (size_t i = 0; i < subtreeCount; ++i) {
+        boxMin[i] = clothBVH.nodes[subtrees[i]].min;
+        boxMax[i] = clothBVH.nodes[subtrees[i]].max;
+    }
+
+    // Collider boxes reach as far as their narrowphase can push a particle from. A moving collider's box
+    // covers its rest box in both poses of the step, and every box is grown by the longest particle move
+    // of the step, so the continuous pass sees any particle that could have crossed the collider.
+    for (size_t id = 0; id < colliders.size(); ++id) {
+        Collider& collider = colliders[id];
+        if (collider.live())
+            collider.shape->bounds(NewCollision::offset, NewCollision::meshReach, collider.restMin, collider.restMax);
+
+        if (collider.moving) {
+            collider.boxMin = glm::vec3(std::numeric_limits<float>::max());
+            collider.boxMax = glm::vec3(-std::numeric_limits<float>::max());
+            for (const ColliderTransform* pose : { &collider.previous, &collider.current }) {
+                for (int corner = 0; corner < 8; ++corner) {
+                    glm::vec3 rest((corner & 1) ? collider.restMax.x : collider.restMin.x,
+                        (corner & 2) ? collider.restMax.y : collider.restMin.y,
+                        (corner & 4) ? collider.restMax.z : collider.restMin.z);
+                    glm::vec3 world = pose->toWorld(rest, collider.pivot);
+                    collider.boxMin = glm::min(collider.boxMin, world);
+                    collider.boxMax = glm::max(collider.boxMax, world);
+                }
+            }
+        } else {
+            collider.boxMin = collider.restMin;
+            collider.boxMax = collider.restMax;
+        }
+        collider.boxMin -= glm::vec3(particleMotion);
+        collider.boxMax += glm::vec3(particleMotion);
+        boxMin[subtreeCount + id] = collider.boxMin;
+        boxMax[subtreeCount + id] = collider.boxMax;
+    }
+
+    if (intervalsDirty) {
+        intervals.clear();
+        for (size_t i = 0; i < subtreeCount; ++i)
+            intervals.push_back({ 0.0f, static_cast<uint32_t>(i) });
+        for (size_t id = 0; id < colliders.size(); ++id) {
+            if (colliders[id].live())
+                intervals.push_back({ 0.0f, static_cast<uint32_t>(subtreeCount + id) });
+        }
+        intervalsDirty = false;
+        intervalsResorted = false; // Out of order, sorted from scratch
+    }
+    for (Interval& interval : intervals) {
+        interval.min = boxMin[interval.box].x;
+    }
+}
+
+void ColliderSet::sweep() {
+    if (intervalsResorted) {
+        // Insertion sort on the start of each interval: the order of the last step is almost right already
+        for (size_t i = 1; i < intervals.size(); ++i) {
+            Interval moving = intervals[i];
+            size_t j = i;
+            for (; j > 0 && intervals[j - 1].min > moving.min; --j)
+                intervals[j] = intervals[j - 1];
+            intervals[j] = moving;
+        }
+    } else {
+        std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) { return a.min < b.min; });
+        intervalsResorted = true;
+    }
+
+    // The intervals open along x, one list per kind: a new one is only paired against the open ones of the
+    // other kind (that also overlap in y and z), and colliders are never tested against each other. An
+    // interval that closed before the current one opened is dropped for good.
+    const uint32_t subtreeCount = static_cast<uint32_t>(subtrees.size());
+    pairs.clear();
+    openSubtrees.clear();
+    openColliders.clear();
+    for (const Interval& interval : intervals) {
+        const uint32_t box = interval.box;
+        const bool isSubtree = box < subtreeCount;
+        std::vector<uint32_t>& others = isSubtree ? openColliders : openSubtrees;
+        size_t kept = 0;
+        for (uint32_t other : others) {
+            if (boxMax[other].x < interval.min)
+                continue;
+            others[kept++] = other;
+            if (boxMax[other].y < boxMin[box].y || boxMin[other].y > boxMax[box].y ||
+                boxMax[other].z < boxMin[box].z || boxMin[other].z > boxMax[box].z)
+                continue;
+            uint32_t collider = (isSubtree ? other : box) - subtreeCount;
+            uint32_t subtree = isSubtree ? box : other;
+            pairs.push_back((static_cast<uint64_t>(collider) << 32) | subtree);
+        }
+        others.resize(kept);
+        (isSubtree ? openSubtrees : openColliders).push_back(box);
+    }
+    // Grouped by collider, so the narrowphase runs in the same order every step
+    std::sort(pairs.begin(), pairs.end());
+}
+
+void ColliderSet::gatherParticles(const Collider& collider, size_t particleCount) {
+    if (particleStamp.size() != particleCount) {
+        particleStamp.assign(particleCount, 0);
+        stamp = 0;
+    }
+    if (++stamp == 0) {
+        std::fill(particleStamp.begin(), particleStamp.end(), 0);
+        stamp = 1;
+    }
+    candidateParticles.clear();
+    auto gather = [&](uint32_t v) {
+        if (v < particleCount && particleStamp[v] != stamp) {
+            particleStamp[v] = stamp;
+            candidateParticles.push_back(v);
+        }
+    };
+    for (GLuint v : candidateTriangles)
+        gather(v);
+    // The contact cache re-tests these even when they are not near any candidate triangle any more
+    for (const Contact& contact : collider.contacts.latest())
+        gather(contact.particle);
+}
+
+void ColliderSet::toRestFrame(const Collider& collider, std::vector<Particle>& particles) {
+    const int count = static_cast<int>(candidateParticles.size());
+    worldPosition.resize(count);
+    worldPrevious.resize(count);
+    restPosition.resize(count);
+    restPrevious.resize(count);
+    Parallel::forEach(count, [&](int i) {
+        Particle& particle = particles[candidateParticles[i]];
+        worldPosition[i] = particle.getPosition();
+        worldPrevious[i] = particle.getPreviousPosition();
+        // Each end of the particle's motion in the pose the collider had at that time, so in the rest frame
+        // the motion is relative to the collider
+        restPosition[i] = collider.current.toRest(worldPosition[i], collider.pivot);
+        restPrevious[i] = collider.previous.toRest(worldPrevious[i], collider.pivot);
+        particle.setPosition(restPosition[i]);
+        particle.setPreviousPosition(restPrevious[i]);
+    });
+}
+
+void ColliderSet::toWorldFrame(const Collider& collider, std::vector<Particle>& particles) {
+    Parallel::forEach(static_cast<int>(candidateParticles.size()), [&](int i) {
+        Particle& particle = particles[candidateParticles[i]];
+        glm::vec3 position = particle.getPosition(), previous = particle.getPreviousPosition();
+        if (position == restPosition[i] && previous == restPrevious[i]) {
+            // Untouched: restored exactly rather than through a round trip that would round it
+            particle.setPosition(worldPosition[i]);
+            particle.setPreviousPosition(worldPrevious[i]);
+            return;
+        }
+        // A particle held on the surface (rest velocity zero) leaves with the collider's own velocity
+        particle.setPosition(collider.current.toWorld(position, collider.pivot));
+        particle.setPreviousPosition(collider.previous.toWorld(previous, collider.pivot));
+    });
+}
+
+void ColliderSet::sweepParticles(const Collider& collider, std::vector<Particle>& particles, float thickness) {
+    Parallel::forEach(static_cast<int>(candidateParticles.size()), [&](int i) {
+        Particle& particle = particles[candidateParticles[i]];
+        if (particle.isPinned())
+            return;
+        const glm::vec3 from = particle.getPreviousPosition(), to = particle.getPosition();
+        const glm::vec3 motion = to - from;
+        const float length2 = glm::dot(motion, motion);
+        // Slower than this, the end position is never past the middle of the shell and the static
+        // test pushes it out the side it came from
+        if (length2 <= thickness * thickness)
+            return;
+        float t = 0.0f;
+        if (!collider.shape->trace(from, to, thickness, t))
+            return;
+        // Back to where it entered, a hair inside so the narrowphase takes it as a new contact there
+        glm::vec3 entry = from + motion * t + motion * (1e-3f * thickness / std::sqrt(length2));
+        particle.displace(entry - to);
+    });
+}
+
+void ColliderSet::narrowphase(Collider& collider, std::vector<Particle>& particles, float staticFriction, float kineticFriction) {
+    gatherParticles(collider, particles.size());
+
+    // In the rest frame of a scaled collider, the offset and reach are in rest units too
+    float thickness = NewCollision::offset, reach = NewCollision::meshReach;
+    if (collider.moving) {
+        toRestFrame(collider, particles);
+        thickness /= collider.current.scale;
+        reach /= collider.current.scale;
+    }
+
+    sweepParticles(collider, particles, thickness);
+
+    collider.shape->resolve(particles, candidateTriangles, candidateParticles.data(), static_cast<int>(candidateParticles.size()),
+        collider.contacts, thickness, reach, staticFriction, kineticFriction);
+
+    if (collider.moving)
+        toWorldFrame(collider, particles);
+}
+
+void ColliderSet::resolve(std::vector<Particle>& particles, const BVH& clothBVH, float staticFriction, float kineticFriction) {
+    pairCount = activeColliders = contactCount = reusedCount = 0;
+    if (clothBVH.empty() || colliders.empty())
+        return;
+
+    // Longest particle move of the last step
+    float particleMotion = Parallel::reduce(static_cast<int>(particles.size()), 0.0f, [&](int begin, int end) {
+        float longest = 0.0f;
+        for (int i = begin; i < end; ++i)
+            longest = std::max(longest, glm::length(particles[i].getPosition() - particles[i].getPreviousPosition()));
+        return longest;
+    }, [](float a, float b) { return std::max(a, b); });
+
+    updateBoxes(clothBVH, particleMotion);
+    sweep();
+    pairCount = static_cast<int>(pairs.size());
+
+    // Colliders one after the other, since two of them may push the same particle; each narrowphase is
+    // parallel over its own candidates
+    size_t next = 0;
+    for (size_t id = 0; id < colliders.size(); ++id) {
+        Collider& collider = colliders[id];
+        candidateTriangles.clear();
+        bool paired = false;
+        for (; next < pairs.size() && (pairs[next] >> 32) == id; ++next) {
+            clothBVH.queryBox(subtrees[static_cast<uint32_t>(pairs[next])], collider.boxMin, collider.boxMax, candidateTriangles);
+            paired = true;
+        }
+        activeColliders += paired ? 1 : 0;
+        if (!collider.live())
+            continue;
+
+        const bool primitive = collider.shape->cachesContacts();
+        if (primitive)
+            collider.contacts.enabled = persistentContacts;
+        // A primitive runs without pairs too while contacts remain, so the cache sees them end
+        if (paired || (primitive && collider.contacts.contactCount > 0))
+            narrowphase(collider, particles, staticFriction, kineticFriction);
+        if (primitive) {
+            contactCount += collider.contacts.contactCount;
+            reusedCount += collider.contacts.reusedCount;
+        }
+    }
+}
+
+void ColliderSet::render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPos, const glm::vec3& viewPos, const glm::vec3& color) {
+    for (Collider& collider : colliders) {
+        if (collider.live())
+            collider.shape->render(shaderProgram, view, projection, lightPos, viewPos, color);
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Particle.h"
+#include "Object.h"
+#include "BVH.h"
+#include "ContactCache.h"
+#include "SignedDistanceField.h"
+#include "SparseDistanceField.h"
+#include "AnalyticCollider.h"
+#include "CapsuleChain.h"
+#include "ColliderAnimation.h"
+#include "ColliderShape.h"
+
+// The scene's colliders: cubes, spheres, meshes, distance fields, analytic shapes and capsule-chain bodies,
+// any number of each. Every step a sweep-and-prune along x pairs the colliders' boxes with the boxes of a
+// few dozen cloth BVH subtrees, and a collider's narrowphase only sees the particles of the subtrees it
+// overlaps. A collider nowhere near the cloth costs one interval in the sweep, so the cost follows the
+// overlaps rather than the collider count.
+//
+// Colliders can be animated (translation, rotation, uniform scale). A moving collider's box covers its
+// whole motion over the step, its candidate particles are taken into the collider's rest frame (previous
+// position through last step's pose, position through this step's), and the static narrowphase runs there
+// on the unchanged rest shape. Particles that moved further than the collision offset relative to the
+// collider are first traced along that motion, so neither a fast collider nor a fast particle can pass
+// through the other within one step. A capsule chain also moves on its own, posed from its stream at the
+// set's time; its box covers the pose of the step before as well. Every kind is reached through the one
+// ColliderShape interface.
+class ColliderSet {
+public:
+    static constexpr int SubtreeTarget = 64; // Cloth subtrees in the broadphase
+
+    bool persistentContacts = true; // Applied to every primitive collider's ContactCache
+
+    // Stats of the last step
+    int pairCount = 0;       // Overlapping (collider, subtree) pairs
+    int activeColliders = 0; // Colliders with at least one pair
+    int contactCount = 0;    // Cached contacts, summed over the primitive colliders
+    int reusedCount = 0;
+
+    // Ids stay valid until the collider is removed; a freed id is handed out again
+    int add(std::unique_ptr<Object> object);
+    int add(std::unique_ptr<SignedDistanceField> field);
+    int add(std::unique_ptr<SparseDistanceField> field);
+    int add(std::unique_ptr<AnalyticCollider> shape);
+    int add(std::unique_ptr<CapsuleChain> body);
+    void remove(int id);
+    void clear();
+    bool contains(int id) const { return id >= 0 && id < static_cast<int>(colliders.size()) && colliders[id].live(); }
+    int size() const;
+
+    // The cloth was rebuilt, particle ids in the contact caches mean nothing any more
+    void clearContacts();
+
+    // The collider follows the animation from the current time on; an empty one puts it back in rest pose
+    void setAnimation(int id, ColliderAnimation animation);
+    // Moves the animated colliders and the capsule chains to their pose dt later (call once per step,
+    // before resolve)
+    void advance(float dt);
+    float getTime() const { return time; }
+    // Back to time 0, every collider in its pose there and not moving
+    void rewind();
+
+    // clothBVH must be refit for this step
+    void resolve(std::vector<Particle>& particles, const BVH& clothBVH, float staticFriction, float kineticFriction);
+
+    void render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection,
+        const glm::vec3& lightPos, const glm::vec3& viewPos, const glm::vec3& color);
+
+private:
+    struct Collider {
+        std::unique_ptr<ColliderShape> shape;
+        ContactCache contacts; // Cubes and spheres only, in the rest frame
+        glm::vec3 restMin{ 0.0f }, restMax{ 0.0f }; // Rest shape grown by the reach of its narrowphase
+        glm::vec3 boxMin{ 0.0f }, boxMax{ 0.0f };   // World box over the step's motion
+
+        ColliderAnimation animation;
+        ColliderTransform previous, current; // Poses at the start and the end of the step
+        glm::vec3 pivot{ 0.0f };             // Rest shape center, what rotation and scale are about
+        bool moving = false;                 // Not in rest pose, or was not at the start of the step
+
+        bool live() const { return shape != nullptr; }
+    };
+    std::vector<Collider> colliders; // Indexed by id
+
+    // Sweep-and-prune state. Boxes 0 .. subtrees.size() are cloth subtrees, the rest are colliders (box
+    // subtrees.size() + id). The interval order is kept between steps, so re-sorting after a small motion
+    // is a near linear insertion sort; only new intervals get a full sort.
+    struct Interval {
+        float min; // The end is read from boxMax
+        uint32_t box;
+    };
+    std::vector<Interval> intervals;
+    std::vector<uint32_t> subtrees;     // Root node of each cloth subtree
+    std::vector<uint32_t> lastSubtrees; // Subtrees the intervals were made for
+    std::vector<glm::vec3> boxMin, boxMax;
+    std::vector<uint32_t> openSubtrees, openColliders;
+    std::vector<uint64_t> pairs;        // (collider << 32) | subtree
+    bool intervalsDirty = true;    // Colliders or subtrees changed, the intervals are made again
+    bool intervalsResorted = false; // The intervals were sorted last step
+
+    float time = 0.0f;
+
+    std::vector<GLuint> candidateTriangles;
+    std::vector<GLuint> candidateParticles;
+    // Moving colliders: the candidates' world positions, and what was written for them in the rest frame
+    std::vector<glm::vec3> worldPosition, worldPrevious, restPosition, restPrevious;
+    std::vector<uint32_t> particleStamp;
+    uint32_t stamp = 0;
+
+    int insert(std::unique_ptr<ColliderShape> shape);
+    void updateBoxes(const BVH& clothBVH, float particleMotion);
+    void sweep();
+    // Vertices of candidateTriangles and particles of the collider's cached contacts, each once
+    void gatherParticles(const Collider& collider, size_t particleCount);
+    void toRestFrame(const Collider& collider, std::vector<Particle>& particles);
+    void toWorldFrame(const Collider& collider, std::vector<Particle>& particles);
+    // Continuous pass, in the rest frame: a candidate whose motion is longer than the collision offset
+    // and enters the collider on the way is moved back to where it entered
+    void sweepParticles(const Collider& collider, std::vector<Particle>& particles, float thickness);
+    void narrowphase(Collider& collider, std::vector<Particle>& particles, float staticFriction, float kineticFriction);
+};
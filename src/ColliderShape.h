@@ -0,0 +1,129 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "Particle.h"
+#include "Object.h"
+#include "ContactCache.h"
+#include "NewCollision.h"
+#include "CapsuleChain.h"
+
+// What ColliderSet needs from a collider, whatever its kind: the rest shape's box, the continuous test and
+// the narrowphase, all in the collider's rest frame. Each kind is wrapped once here, so the set has one
+// call per operation instead of a branch per kind.
+class ColliderShape {
+public:
+    virtual ~ColliderShape() = default;
+
+    // What rotation and scale are about
+    virtual glm::vec3 center() const = 0;
+    // Rest shape grown by how far its narrowphase reaches: thickness, or reach behind a mesh's surface
+    virtual void bounds(float thickness, float reach, glm::vec3& min, glm::vec3& max) const = 0;
+    // Where the segment from -> to first comes within thickness of the shape, as a fraction t of the way.
+    // False if it never does, or from already is (the narrowphase handles that).
+    virtual bool trace(const glm::vec3& from, const glm::vec3& to, float thickness, float& t) const = 0;
+    // Pushes particles candidates[0 .. count) out. Cubes and spheres test the vertices of the candidate
+    // triangles instead and keep their contacts in the cache.
+    virtual void resolve(std::vector<Particle>& particles, const std::vector<GLuint>& triangles, const GLuint* candidates, int count,
+        ContactCache& contacts, float thickness, float reach, float staticFriction, float kineticFriction) = 0;
+    virtual bool cachesContacts() const { return false; }
+
+    // Shapes that move on their own (capsule chains) take their pose at this time
+    virtual void advance(float) {}
+    // Drawn shapes follow the collider's pose
+    virtual void setPose(const glm::mat4&) {}
+    virtual void render(GLuint, const glm::mat4&, const glm::mat4&, const glm::vec3&, const glm::vec3&, const glm::vec3&) {}
+};
+
+// Cubes, spheres and triangle meshes
+class ObjectShape : public ColliderShape {
+public:
+    explicit ObjectShape(std::unique_ptr<Object> object) : object(std::move(object)) {}
+
+    glm::vec3 center() const override { return object->getCenter(); }
+    void bounds(float thickness, float reach, glm::vec3& min, glm::vec3& max) const override {
+        if (object->isMesh()) {
+            min = object->getBoundsMin() - glm::vec3(reach);
+            max = object->getBoundsMax() + glm::vec3(reach);
+        } else {
+            glm::vec3 extent(object->getHalfLength() + thickness);
+            min = object->getCenter() - extent;
+            max = object->getCenter() + extent;
+        }
+    }
+    bool trace(const glm::vec3& from, const glm::vec3& to, float thickness, float& t) const override {
+        return NewCollision::sweepShell(*object, from, to, thickness, t);
+    }
+    void resolve(std::vector<Particle>& particles, const std::vector<GLuint>& triangles, const GLuint* candidates, int count,
+        ContactCache& contacts, float thickness, float reach, float staticFriction, float kineticFriction) override {
+        if (object->isMesh())
+            NewCollision::resolveMeshCollision(particles, candidates, count, *object, thickness, reach, staticFriction, kineticFriction);
+        else
+            NewCollision::resolveCollision(particles, triangles, *object, contacts, thickness, staticFriction, kineticFriction);
+    }
+    bool cachesContacts() const override { return !object->isMesh(); }
+
+    void setPose(const glm::mat4& matrix) override { object->setModelMatrix(matrix); }
+    void render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection,
+        const glm::vec3& lightPos, const glm::vec3& viewPos, const glm::vec3& color) override {
+        object->render(shaderProgram, view, projection, lightPos, viewPos, color);
+    }
+
+private:
+    std::unique_ptr<Object> object;
+};
+
+// Anything with a signed distance: the dense and sparse distance fields, analytic shapes and capsule
+// chains. They share sample, resolveCollision, getCenter and getBoundsMin/Max(reach).
+template <typename Field>
+class FieldShape : public ColliderShape {
+public:
+    explicit FieldShape(std::unique_ptr<Field> field) : field(std::move(field)) {}
+
+    glm::vec3 center() const override { return field->getCenter(); }
+    void bounds(float thickness, float, glm::vec3& min, glm::vec3& max) const override {
+        min = field->getBoundsMin(thickness);
+        max = field->getBoundsMax(thickness);
+    }
+    // Sphere tracing until within thickness of the surface. Steps never exceed the distance left to the
+    // shell, so the shell cannot be stepped over.
+    bool trace(const glm::vec3& from, const glm::vec3& to, float thickness, float& t) const override {
+        constexpr int MaxSteps = 256;
+        glm::vec3 gradient;
+        const glm::vec3 motion = to - from;
+        const float length = glm::length(motion);
+        float distance = field->sample(from, gradient);
+        if (distance < thickness)
+            return false; // In contact already, the static test handles it
+        float travelled = 0.0f;
+        for (int iteration = 0; iteration < MaxSteps; ++iteration) {
+            travelled += std::max(distance - thickness, 0.05f * thickness);
+            if (travelled >= length)
+                return false;
+            distance = field->sample(from + motion * (travelled / length), gradient);
+            if (distance < thickness) {
+                t = travelled / length;
+                return true;
+            }
+        }
+        // Out of steps short of the end (a long motion grazing the surface): the rest of the way was never
+        // checked, so the particle stops at the last point sampled, which is still outside the shell
+        t = travelled / length;
+        return true;
+    }
+    void resolve(std::vector<Particle>& particles, const std::vector<GLuint>&, const GLuint* candidates, int count,
+        ContactCache&, float thickness, float, float staticFriction, float kineticFriction) override {
+        field->resolveCollision(particles, candidates, count, thickness, staticFriction, kineticFriction);
+    }
+
+    void advance(float time) override { advanceField(*field, time); }
+
+private:
+    std::unique_ptr<Field> field;
+
+    static void advanceField(CapsuleChain& chain, float time) { chain.advance(time); }
+    template <typename Other>
+    static void advanceField(Other&, float) {}
+};
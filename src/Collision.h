@@ -2,6 +2,11 @@
 #include <glm/glm.hpp>
 #include "Particle.h"
 #include "Object.h"
+#include "Spring.h"
+#include "SpatialHash.h"
+#include "Parallel.h"
+#include <vector>
+#include <cmath>
 
 class Collision {
 public:
@@ -115,25 +120,61 @@ public:
         }
     }
 
-    static void resolveSelfCollision(Particle& particle, const std::vector<Particle>& particles) {
-        glm::vec3 position = particle.getPosition();
-
-        for (const auto& other : particles) {
-            if (&particle != &other) { // Ensure we're not comparing the particle with itself
-                glm::vec3 otherPosition = other.getPosition();
-                float distance = glm::length(position - otherPosition);
+    // Particle-particle self-collision through the spatial hash, so each particle only looks at the 27 cells around it.
+    // Particles joined by a spring are skipped. Every push is computed from the same positions before any is applied,
+    // which makes the result independent of the order (and of the thread count).
+    static void resolveSelfCollision(std::vector<Particle>& particles, SpatialHash& grid, const std::vector<Spring>& springs,
+        const std::vector<int>& springAdjacencyStart, const std::vector<int>& springAdjacencyEnd, const std::vector<int>& springAdjacency,
+        std::vector<glm::vec3>& corrections) {
+        const int particleCount = static_cast<int>(particles.size());
+        if (particleCount == 0)
+            return;
+
+        // Cells as wide as the largest contact distance, so the 27 cells cover every possible contact
+        float maxRadius = Parallel::reduce(particleCount, 0.0f, [&](int begin, int end) {
+            float r = 0.0f;
+            for (int i = begin; i < end; ++i)
+                r = std::max(r, particles[i].getRadius());
+            return r;
+        }, [](float a, float b) { return std::max(a, b); });
+        grid.build(particles, 2.0f * maxRadius);
+
+        const Particle* base = particles.data();
+        corrections.assign(particleCount, glm::vec3(0.0f));
+        Parallel::forEach(particleCount, [&](int i) {
+            const Particle& particle = particles[i];
+            glm::vec3 position = particle.getPosition();
+            glm::vec3 correction(0.0f);
+
+            grid.forEachNeighbor(position, [&](int j) {
+                if (j == i)
+                    return;
+                const Particle& other = particles[j];
+                glm::vec3 delta = position - other.getPosition();
                 float combinedRadius = particle.getRadius() + other.getRadius();
-                if (distance < combinedRadius) { // Collision detected
-                    // Calculate the normal vector
-                    glm::vec3 normal = glm::normalize(position - otherPosition);
-
-                    // Resolve the collision by moving the particle away from the other particle
-                    float penetrationDepth = combinedRadius - distance;
-                    position += normal * (penetrationDepth * 0.5f); // Push half of the penetration depth away
-                    particle.setPosition(position);
+                float distance2 = glm::dot(delta, delta);
+                if (distance2 >= combinedRadius * combinedRadius || distance2 <= 0.0f)
+                    return;
+
+                // Springs already keep topological neighbours apart
+                for (int a = springAdjacencyStart[i]; a < springAdjacencyEnd[i]; ++a) {
+                    const Spring& spring = springs[springAdjacency[a] >> 1];
+                    const Particle* neighbour = (springAdjacency[a] & 1) ? spring.getP2() : spring.getP1();
+                    if (neighbour - base == j)
+                        return;
                 }
-            }
-        }
+
+                // Each particle moves away by half the penetration depth
+                float distance = std::sqrt(distance2);
+                correction += delta * ((combinedRadius - distance) * 0.5f / distance);
+            });
+            corrections[i] = correction;
+        });
+
+        Parallel::forEach(particleCount, [&](int i) {
+            if (corrections[i] != glm::vec3(0.0f))
+                particles[i].setPosition(particles[i].getPosition() + corrections[i]);
+        });
     }
 
 };
\ No newline at end of file
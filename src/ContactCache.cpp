@@ -0,0 +1,41 @@
+#include "ContactCache.h"
+#include <algorithm>
+
+void ContactCache::clear() {
+    last.clear();
+    current.clear();
+    contactCount = 0;
+    reusedCount = 0;
+}
+
+void ContactCache::beginStep(const Object& object, size_t particleCount) {
+    bool sameCollider = object.objectType == objectType && object.getCenter() == objectCenter &&
+                        object.getHalfLength() == objectHalfLength;
+    if (!sameCollider || claimed.size() != particleCount) {
+        clear();
+        claimed.assign(particleCount, 0);
+        stamp = 0;
+        objectType = object.objectType;
+        objectCenter = object.getCenter();
+        objectHalfLength = object.getHalfLength();
+    }
+
+    last.swap(current);
+    current.clear();
+    if (!enabled)
+        last.clear();
+
+    if (++stamp == 0) { // Wrapped around, old stamps could look like this step's
+        std::fill(claimed.begin(), claimed.end(), 0);
+        stamp = 1;
+    }
+}
+
+void ContactCache::endStep() {
+    // Sorted by key, so the next step walks them in the same order whatever order they were found in
+    std::sort(current.begin(), current.end(), [](const Contact& a, const Contact& b) { return a.key() < b.key(); });
+    contactCount = static_cast<int>(current.size());
+    reusedCount = 0;
+    for (const Contact& contact : current)
+        reusedCount += contact.age > 0 ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "Object.h"
+
+// One particle touching one feature of the collider. Features: cube faces are axis * 2 + (1 on the positive
+// side), the sphere surface is 0.
+struct Contact {
+    uint32_t particle;
+    uint32_t feature;
+    glm::vec3 normal;   // Outward collider normal
+    glm::vec3 anchor;   // Where static friction holds the particle on the surface
+    float depth;        // How far the particle is inside the collision shell, negative once it has left it
+    int age;            // Steps the contact has existed, 0 when found this step
+    bool sticking;      // Static friction held last step
+
+    uint64_t key() const { return (static_cast<uint64_t>(particle) << 3) | feature; }
+};
+
+// Particle-vs-collider contacts carried from one step to the next. The narrowphase first re-tests the
+// contacts of the last step against their own feature and only searches the BVH candidates for particles
+// that are not in contact yet; each contact keeps its friction state (stick anchor, static or sliding),
+// so a resting drape is held in place instead of restarting friction from zero every step.
+class ContactCache {
+public:
+    bool enabled = true;
+    float margin = 0.002f; // A contact survives this far outside the shell, so resting particles don't flicker
+
+    int contactCount = 0;  // Contacts after the last step
+    int reusedCount = 0;   // Of those, carried over from the step before
+
+    void clear();
+
+    // Starts a step: the contacts of the last step become previous(). Drops them if the collider or the
+    // cloth changed, since particle and feature ids would no longer mean the same thing.
+    void beginStep(const Object& object, size_t particleCount);
+    void endStep();
+
+    const std::vector<Contact>& previous() const { return last; }
+    // Contacts found by the last step, before beginStep makes them previous()
+    const std::vector<Contact>& latest() const { return current; }
+
+    // Marks the particle as handled this step, false if it already was
+    bool claim(uint32_t particle) {
+        if (claimed[particle] == stamp)
+            return false;
+        claimed[particle] = stamp;
+        return true;
+    }
+    bool isClaimed(uint32_t particle) const { return claimed[particle] == stamp; }
+
+    void add(const Contact& contact) { current.push_back(contact); }
+
+private:
+    std::vector<Contact> last;
+    std::vector<Contact> current;
+    std::vector<uint32_t> claimed; // Step stamp per particle
+    uint32_t stamp = 0;
+
+    // Collider the contacts refer to
+    ObjectType objectType = ObjectType::Cube;
+    glm::vec3 objectCenter{ 0.0f };
+    float objectHalfLength = -1.0f;
+};
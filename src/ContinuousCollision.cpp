@@ -0,0 +1,579 @@
+#include "ContinuousCollision.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/quaternion.hpp>
+
+namespace {
+    const float Pi = 3.14159265f;
+
+    // Closest point on triangle (a, b, c) to p as barycentric weights (Ericson, Real-Time Collision Detection 5.1.5)
+    glm::vec3 closestBarycentric(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) return glm::vec3(1.0f, 0.0f, 0.0f);
+
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) return glm::vec3(0.0f, 1.0f, 0.0f);
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            float v = d1 / (d1 - d3);
+            return glm::vec3(1.0f - v, v, 0.0f);
+        }
+
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) return glm::vec3(0.0f, 0.0f, 1.0f);
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            float w = d2 / (d2 - d6);
+            return glm::vec3(1.0f - w, 0.0f, w);
+        }
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+            float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            return glm::vec3(0.0f, 1.0f - w, w);
+        }
+
+        float denom = 1.0f / (va + vb + vc);
+        float v = vb * denom, w = vc * denom;
+        return glm::vec3(1.0f - v - w, v, w);
+    }
+
+    // Closest points between segments (p1, q1) and (p2, q2) as parameters s and u (Ericson 5.1.9)
+    void closestSegmentParameters(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2, float& s, float& u) {
+        const float eps = 1e-12f;
+        glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+        float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+        if (a <= eps && e <= eps) { s = u = 0.0f; return; }
+        if (a <= eps) {
+            s = 0.0f;
+            u = glm::clamp(f / e, 0.0f, 1.0f);
+            return;
+        }
+        float c = glm::dot(d1, r);
+        if (e <= eps) {
+            u = 0.0f;
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+            return;
+        }
+        float b = glm::dot(d1, d2);
+        float denom = a * e - b * b;
+        s = denom != 0.0f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+        u = (b * s + f) / e;
+        if (u < 0.0f) {
+            u = 0.0f;
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        } else if (u > 1.0f) {
+            u = 1.0f;
+            s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+        }
+    }
+
+    // Coefficients of (A(t) x B(t)) . C(t) for linearly moving A, B, C, highest power first
+    void coplanarityCubic(const glm::dvec3& A0, const glm::dvec3& A1, const glm::dvec3& B0, const glm::dvec3& B1,
+        const glm::dvec3& C0, const glm::dvec3& C1, double coefficients[4]) {
+        glm::dvec3 k0 = glm::cross(A0, B0);
+        glm::dvec3 k1 = glm::cross(A0, B1) + glm::cross(A1, B0);
+        glm::dvec3 k2 = glm::cross(A1, B1);
+        coefficients[0] = glm::dot(k2, C1);
+        coefficients[1] = glm::dot(k2, C0) + glm::dot(k1, C1);
+        coefficients[2] = glm::dot(k1, C0) + glm::dot(k0, C1);
+        coefficients[3] = glm::dot(k0, C0);
+    }
+
+    glm::vec3 lerp(const glm::vec3& x0, const glm::vec3& x1, float t) {
+        return x0 + (x1 - x0) * t;
+    }
+
+    bool sharesVertex(const GLuint* a, int countA, const GLuint* b, int countB) {
+        for (int i = 0; i < countA; ++i)
+            for (int j = 0; j < countB; ++j)
+                if (a[i] == b[j])
+                    return true;
+        return false;
+    }
+}
+
+int ContinuousCollision::solveCubic(double a, double b, double c, double d, float roots[3]) {
+    auto f = [&](double t) { return ((a * t + b) * t + c) * t + d; };
+
+    // Split [0, 1] where the derivative 3a t^2 + 2b t + c vanishes, so f is monotonic on every piece
+    double points[4];
+    int pointCount = 0;
+    points[pointCount++] = 0.0;
+    double qa = 3.0 * a, qb = 2.0 * b, qc = c;
+    if (std::abs(qa) > 1e-20) {
+        double disc = qb * qb - 4.0 * qa * qc;
+        if (disc >= 0.0) {
+            double sq = std::sqrt(disc);
+            double r0 = (-qb - sq) / (2.0 * qa), r1 = (-qb + sq) / (2.0 * qa);
+            if (r0 > r1) std::swap(r0, r1);
+            if (r0 > 0.0 && r0 < 1.0) points[pointCount++] = r0;
+            if (r1 > 0.0 && r1 < 1.0 && r1 != r0) points[pointCount++] = r1;
+        }
+    } else if (std::abs(qb) > 1e-20) {
+        double r = -qc / qb;
+        if (r > 0.0 && r < 1.0) points[pointCount++] = r;
+    }
+    points[pointCount++] = 1.0;
+
+    int rootCount = 0;
+    for (int i = 0; i + 1 < pointCount; ++i) {
+        double lo = points[i], hi = points[i + 1];
+        double flo = f(lo), fhi = f(hi);
+        if (flo == 0.0) {
+            if (rootCount == 0 || roots[rootCount - 1] != static_cast<float>(lo))
+                roots[rootCount++] = static_cast<float>(lo);
+            continue;
+        }
+        if (fhi == 0.0) {
+            roots[rootCount++] = static_cast<float>(hi);
+            continue;
+        }
+        if ((flo < 0.0) == (fhi < 0.0))
+            continue;
+        // Bisection on a monotonic piece
+        for (int iteration = 0; iteration < 40 && hi - lo > 1e-7; ++iteration) {
+            double mid = 0.5 * (lo + hi);
+            double fmid = f(mid);
+            if ((fmid < 0.0) == (flo < 0.0)) { lo = mid; flo = fmid; }
+            else hi = mid;
+        }
+        roots[rootCount++] = static_cast<float>(0.5 * (lo + hi));
+    }
+    return rootCount;
+}
+
+bool ContinuousCollision::vertexFaceImpact(
+    const glm::vec3& p0, const glm::vec3& p1,
+    const glm::vec3& a0, const glm::vec3& a1,
+    const glm::vec3& b0, const glm::vec3& b1,
+    const glm::vec3& c0, const glm::vec3& c1,
+    float thickness, float& t, glm::vec3& barycentric, glm::vec3& normal) {
+
+    // Coplanar when ((b - a) x (c - a)) . (p - a) = 0, relative to a
+    double coefficients[4];
+    coplanarityCubic(
+        glm::dvec3(b0 - a0), glm::dvec3((b1 - a1) - (b0 - a0)),
+        glm::dvec3(c0 - a0), glm::dvec3((c1 - a1) - (c0 - a0)),
+        glm::dvec3(p0 - a0), glm::dvec3((p1 - a1) - (p0 - a0)), coefficients);
+
+    float roots[3];
+    int rootCount = solveCubic(coefficients[0], coefficients[1], coefficients[2], coefficients[3], roots);
+
+    for (int r = 0; r < rootCount; ++r) {
+        glm::vec3 p = lerp(p0, p1, roots[r]);
+        glm::vec3 a = lerp(a0, a1, roots[r]);
+        glm::vec3 b = lerp(b0, b1, roots[r]);
+        glm::vec3 c = lerp(c0, c1, roots[r]);
+        glm::vec3 weights = closestBarycentric(p, a, b, c);
+        glm::vec3 closest = weights.x * a + weights.y * b + weights.z * c;
+        if (glm::dot(p - closest, p - closest) >= thickness * thickness)
+            continue;
+
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if (length < 1e-12f)
+            continue;
+        t = roots[r];
+        barycentric = weights;
+        normal = n / length;
+        return true;
+    }
+    return false;
+}
+
+bool ContinuousCollision::edgeEdgeImpact(
+    const glm::vec3& a0, const glm::vec3& a1,
+    const glm::vec3& b0, const glm::vec3& b1,
+    const glm::vec3& c0, const glm::vec3& c1,
+    const glm::vec3& d0, const glm::vec3& d1,
+    float thickness, float& t, float& s, float& u, glm::vec3& normal) {
+
+    // Coplanar when ((b - a) x (d - c)) . (c - a) = 0
+    double coefficients[4];
+    coplanarityCubic(
+        glm::dvec3(b0 - a0), glm::dvec3((b1 - a1) - (b0 - a0)),
+        glm::dvec3(d0 - c0), glm::dvec3((d1 - c1) - (d0 - c0)),
+        glm::dvec3(c0 - a0), glm::dvec3((c1 - a1) - (c0 - a0)), coefficients);
+
+    float roots[3];
+    int rootCount = solveCubic(coefficients[0], coefficients[1], coefficients[2], coefficients[3], roots);
+
+    for (int r = 0; r < rootCount; ++r) {
+        glm::vec3 a = lerp(a0, a1, roots[r]);
+        glm::vec3 b = lerp(b0, b1, roots[r]);
+        glm::vec3 c = lerp(c0, c1, roots[r]);
+        glm::vec3 d = lerp(d0, d1, roots[r]);
+        float edgeS, edgeU;
+        closestSegmentParameters(a, b, c, d, edgeS, edgeU);
+        glm::vec3 separation = lerp(a, b, edgeS) - lerp(c, d, edgeU);
+        float distance2 = glm::dot(separation, separation);
+        if (distance2 >= thickness * thickness)
+            continue;
+
+        // Normal of the plane both edges lie in, or the separation when the edges are parallel
+        glm::vec3 n = glm::cross(b - a, d - c);
+        float length = glm::length(n);
+        if (length < 1e-12f) {
+            n = separation;
+            length = std::sqrt(distance2);
+            if (length < 1e-12f)
+                continue;
+        }
+        t = roots[r];
+        s = edgeS;
+        u = edgeU;
+        normal = n / length;
+        return true;
+    }
+    return false;
+}
+
+void ContinuousCollision::detect(std::vector<Particle>& particles, BVH& clothBVH, bool cullNormals) {
+    // Broadphase: swept bounds, then the BVH against itself
+    clothBVH.refitSwept(thickness);
+    candidatePairs.clear();
+    selfTraverse(clothBVH, 0, particles, cullNormals);
+
+    // Narrowphase over the candidate pairs, impacts kept per block and joined in block order
+    const int pairCount = static_cast<int>(candidatePairs.size());
+    blockImpacts.resize(Parallel::blockCount(pairCount));
+    Parallel::forBlocks(pairCount, [&](int begin, int end) {
+        std::vector<Impact>& out = blockImpacts[begin / Parallel::BlockSize];
+        out.clear();
+        for (int i = begin; i < end; ++i)
+            testPair(candidatePairs[i], particles, out);
+    });
+    impacts.clear();
+    for (int b = 0; b < Parallel::blockCount(pairCount); ++b)
+        impacts.insert(impacts.end(), blockImpacts[b].begin(), blockImpacts[b].end());
+}
+
+int ContinuousCollision::resolveSelfCollision(std::vector<Particle>& particles, BVH& clothBVH) {
+    impacts.clear();
+    zoneCount = zoneParticles = zonePasses = impactsLeft = 0;
+    if (clothBVH.empty())
+        return 0;
+
+    bool responded = false;
+    for (int iteration = 0; iteration < maxIterations; ++iteration) {
+        detect(particles, clothBVH, true);
+        if (impacts.empty())
+            break;
+        responded = true;
+
+        // Response one impact at a time, each seeing the corrections made before it
+        for (const Impact& impact : impacts)
+            applyImpact(impact, particles);
+    }
+    // Nothing found on the motion as integrated: testing every pair of a flat cloth costs tens of times
+    // the culled pass, so the cones are trusted for a step that needed no response
+    if (!responded && maxIterations > 0)
+        return 0;
+
+    // The pushes bent the motion, which the cones of the last pass may not have covered, so what is left
+    // is only known after a detection over every pair of overlapping boxes
+    detect(particles, clothBVH, false);
+    impactsLeft = static_cast<int>(impacts.size());
+    if (impactsLeft > 0 && impactZones)
+        impactsLeft = resolveImpactZones(particles, clothBVH);
+    return impactsLeft;
+}
+
+uint32_t ContinuousCollision::findZone(uint32_t v) {
+    while (zoneParent[v] != v) {
+        zoneParent[v] = zoneParent[zoneParent[v]]; // Path halving
+        v = zoneParent[v];
+    }
+    return v;
+}
+
+int ContinuousCollision::resolveImpactZones(std::vector<Particle>& particles, BVH& clothBVH) {
+    const uint32_t particleCount = static_cast<uint32_t>(particles.size());
+    zoneParent.resize(particleCount);
+    for (uint32_t v = 0; v < particleCount; ++v)
+        zoneParent[v] = v;
+    zoneTouched.assign(particleCount, 0);
+    zoneHeld.assign(particleCount, 0);
+
+    for (int pass = 0; !impacts.empty(); ++pass) {
+        // An impact inside a zone means its rigid motion still collides (the straight-line paths of a
+        // rotation only approximate it), and the zone holds still instead. An impact between two zones
+        // merges them.
+        for (const Impact& impact : impacts) {
+            uint32_t root = findZone(impact.vertices[0]);
+            if (findZone(impact.vertices[1]) == root && findZone(impact.vertices[2]) == root && findZone(impact.vertices[3]) == root)
+                zoneHeld[root] = 1;
+        }
+        for (const Impact& impact : impacts) {
+            uint32_t root = findZone(impact.vertices[0]);
+            for (int k = 1; k < 4; ++k) {
+                uint32_t other = findZone(impact.vertices[k]);
+                if (other != root) {
+                    zoneParent[other] = root;
+                    zoneHeld[root] |= zoneHeld[other];
+                }
+            }
+            for (int k = 0; k < 4; ++k)
+                zoneTouched[impact.vertices[k]] = 1;
+        }
+        zonePasses = pass + 1;
+
+        if (pass == FrozenZonePasses) {
+            // Last resort: nothing moves this step, and the start of the step was free of crossings
+            Parallel::forEach(static_cast<int>(particleCount), [&](int v) {
+                particles[v].displace(particles[v].getPreviousPosition() - particles[v].getPosition());
+            });
+            zoneCount = 1;
+            zoneParticles = static_cast<int>(particleCount);
+            // Only contacts the step started in can be left
+            detect(particles, clothBVH, false);
+            break;
+        }
+
+        // Members grouped by zone (sorted by root, then particle), so the moves are deterministic
+        zoneMembers.clear();
+        for (uint32_t v = 0; v < particleCount; ++v) {
+            if (zoneTouched[v])
+                zoneMembers.push_back((static_cast<uint64_t>(findZone(v)) << 32) | v);
+        }
+        std::sort(zoneMembers.begin(), zoneMembers.end());
+        zoneStart.clear();
+        for (size_t i = 0; i < zoneMembers.size(); ++i) {
+            if (i == 0 || (zoneMembers[i] >> 32) != (zoneMembers[i - 1] >> 32))
+                zoneStart.push_back(static_cast<uint32_t>(i));
+        }
+        zoneStart.push_back(static_cast<uint32_t>(zoneMembers.size()));
+        zoneCount = static_cast<int>(zoneStart.size()) - 1;
+        zoneParticles = static_cast<int>(zoneMembers.size());
+
+        // Zones are disjoint, so they move in parallel
+        Parallel::forEach(zoneCount, [&](int z) {
+            const bool frozen = pass >= RigidZonePasses || zoneHeld[zoneMembers[zoneStart[z]] >> 32];
+            moveZone(zoneMembers.data() + zoneStart[z], static_cast<int>(zoneStart[z + 1] - zoneStart[z]), frozen, particles);
+        }, 16);
+
+        detect(particles, clothBVH, false);
+    }
+    return static_cast<int>(impacts.size());
+}
+
+void ContinuousCollision::moveZone(const uint64_t* members, int count, bool frozen, std::vector<Particle>& particles) const {
+    // A pinned particle cannot move rigidly with the others; its zone holds still instead
+    for (int i = 0; i < count && !frozen; ++i)
+        frozen = particles[static_cast<uint32_t>(members[i])].isPinned();
+    if (frozen) {
+        for (int i = 0; i < count; ++i) {
+            Particle& particle = particles[static_cast<uint32_t>(members[i])];
+            particle.displace(particle.getPreviousPosition() - particle.getPosition());
+        }
+        return;
+    }
+
+    // Mass, center and mean motion of the zone at the start of the step
+    float mass = 0.0f;
+    glm::vec3 center(0.0f), motion(0.0f);
+    for (int i = 0; i < count; ++i) {
+        const Particle& particle = particles[static_cast<uint32_t>(members[i])];
+        mass += particle.getMass();
+        center += particle.getMass() * particle.getPreviousPosition();
+        motion += particle.getMass() * (particle.getPosition() - particle.getPreviousPosition());
+    }
+    center /= mass;
+    motion /= mass;
+
+    // Angular momentum and inertia about the center give the rotation over the step
+    glm::vec3 angularMomentum(0.0f);
+    glm::mat3 inertia(0.0f);
+    for (int i = 0; i < count; ++i) {
+        const Particle& particle = particles[static_cast<uint32_t>(members[i])];
+        glm::vec3 r = particle.getPreviousPosition() - center;
+        glm::vec3 v = particle.getPosition() - particle.getPreviousPosition() - motion;
+        angularMomentum += particle.getMass() * glm::cross(r, v);
+        inertia += particle.getMass() * (glm::dot(r, r) * glm::mat3(1.0f) - glm::outerProduct(r, r));
+    }
+    // Regularized, since a zone along a line has no inertia about that line
+    float trace = inertia[0][0] + inertia[1][1] + inertia[2][2];
+    inertia += glm::mat3(1e-4f * trace + 1e-12f);
+    glm::vec3 omega = glm::inverse(inertia) * angularMomentum;
+    float angle = glm::length(omega);
+    glm::quat rotation = angle > 1e-9f ? glm::angleAxis(angle, omega / angle) : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < count; ++i) {
+        Particle& particle = particles[static_cast<uint32_t>(members[i])];
+        glm::vec3 target = center + motion + rotation * (particle.getPreviousPosition() - center);
+        particle.displace(target - particle.getPosition());
+    }
+}
+
+// Bottom-up over the tree: a subtree whose normals all fit in a cone narrower than a half-sphere
+// cannot fold onto itself, so only the pairs of children of curved subtrees are tested against each other.
+// Like Volino's criterion this assumes the subtree is one connected patch (the contour test is skipped), and
+// a flat patch whose boundary folds over it breaks that, so without cullNormals every pair is tested.
+ContinuousCollision::NormalCone ContinuousCollision::selfTraverse(const BVH& bvh, uint32_t nodeIndex, const std::vector<Particle>& particles, bool cullNormals) {
+    auto merge = [](const NormalCone& c1, const NormalCone& c2) {
+        glm::vec3 axis = c1.axis + c2.axis;
+        float length = glm::length(axis);
+        if (length < 1e-6f)
+            return NormalCone{ c1.axis, Pi };
+        axis /= length;
+        float angle1 = std::acos(glm::clamp(glm::dot(axis, c1.axis), -1.0f, 1.0f)) + c1.angle;
+        float angle2 = std::acos(glm::clamp(glm::dot(axis, c2.axis), -1.0f, 1.0f)) + c2.angle;
+        return NormalCone{ axis, std::min(Pi, std::max(angle1, angle2)) };
+    };
+
+    const BVHNode& node = bvh.nodes[nodeIndex];
+    if (!cullNormals) {
+        if (node.isLeaf()) {
+            addLeafPairs(bvh, nodeIndex, nodeIndex);
+        } else {
+            selfTraverse(bvh, node.leftFirst, particles, false);
+            selfTraverse(bvh, node.leftFirst + 1, particles, false);
+            pairTraverse(bvh, node.leftFirst, node.leftFirst + 1);
+        }
+        return NormalCone{ glm::vec3(0.0f, 1.0f, 0.0f), Pi };
+    }
+    if (node.isLeaf()) {
+        NormalCone cone{ glm::vec3(0.0f), -1.0f };
+        const GLuint* tri = bvh.leafTriangles(node);
+        for (uint32_t i = 0; i < 3 * node.count; i += 3) {
+            // Normals at the start and the end of the step
+            for (int end = 0; end < 2; ++end) {
+                auto x = [&](GLuint v) { return end ? particles[v].getPosition() : particles[v].getPreviousPosition(); };
+                glm::vec3 n = glm::cross(x(tri[i + 1]) - x(tri[i]), x(tri[i + 2]) - x(tri[i]));
+                float length = glm::length(n);
+                NormalCone triangleCone = length > 1e-12f ? NormalCone{ n / length, 0.0f } : NormalCone{ glm::vec3(0.0f, 1.0f, 0.0f), Pi };
+                cone = cone.angle < 0.0f ? triangleCone : merge(cone, triangleCone);
+            }
+        }
+        if (cone.angle >= 0.5f * Pi)
+            addLeafPairs(bvh, nodeIndex, nodeIndex);
+        return cone;
+    }
+
+    NormalCone cone = merge(selfTraverse(bvh, node.leftFirst, particles, true), selfTraverse(bvh, node.leftFirst + 1, particles, true));
+    if (cone.angle >= 0.5f * Pi)
+        pairTraverse(bvh, node.leftFirst, node.leftFirst + 1);
+    return cone;
+}
+
+void ContinuousCollision::pairTraverse(const BVH& bvh, uint32_t a, uint32_t b) {
+    const BVHNode& nodeA = bvh.nodes[a];
+    const BVHNode& nodeB = bvh.nodes[b];
+    if (!nodeA.aabb().intersects(nodeB.aabb()))
+        return;
+    if (nodeA.isLeaf() && nodeB.isLeaf()) {
+        addLeafPairs(bvh, a, b);
+        return;
+    }
+    // Descend into the larger of the two
+    glm::vec3 extentA = nodeA.max - nodeA.min, extentB = nodeB.max - nodeB.min;
+    bool descendA = nodeB.isLeaf() || (!nodeA.isLeaf() && extentA.x + extentA.y + extentA.z > extentB.x + extentB.y + extentB.z);
+    if (descendA) {
+        pairTraverse(bvh, nodeA.leftFirst, b);
+        pairTraverse(bvh, nodeA.leftFirst + 1, b);
+    } else {
+        pairTraverse(bvh, a, nodeB.leftFirst);
+        pairTraverse(bvh, a, nodeB.leftFirst + 1);
+    }
+}
+
+void ContinuousCollision::addLeafPairs(const BVH& bvh, uint32_t a, uint32_t b) {
+    const BVHNode& nodeA = bvh.nodes[a];
+    const BVHNode& nodeB = bvh.nodes[b];
+    const GLuint* triA = bvh.leafTriangles(nodeA);
+    const GLuint* triB = bvh.leafTriangles(nodeB);
+    for (uint32_t i = 0; i < nodeA.count; ++i) {
+        for (uint32_t j = (a == b ? i + 1 : 0); j < nodeB.count; ++j) {
+            TrianglePair pair;
+            std::copy(triA + 3 * i, triA + 3 * i + 3, pair.a);
+            std::copy(triB + 3 * j, triB + 3 * j + 3, pair.b);
+            candidatePairs.push_back(pair);
+        }
+    }
+}
+
+void ContinuousCollision::testPair(const TrianglePair& pair, const std::vector<Particle>& particles, std::vector<Impact>& out) const {
+    auto x0 = [&](GLuint v) { return particles[v].getPreviousPosition(); };
+    auto x1 = [&](GLuint v) { return particles[v].getPosition(); };
+
+    // Keeps the impact only if the primitives approach each other along its normal
+    auto emit = [&](Impact& impact) {
+        glm::vec3 separation0(0.0f), motion(0.0f);
+        for (int k = 0; k < 4; ++k) {
+            separation0 += impact.weights[k] * x0(impact.vertices[k]);
+            motion += impact.weights[k] * (x1(impact.vertices[k]) - x0(impact.vertices[k]));
+        }
+        float d0 = glm::dot(separation0, impact.normal);
+        if (std::abs(d0) > 1e-9f ? d0 < 0.0f : glm::dot(motion, impact.normal) > 0.0f)
+            impact.normal = -impact.normal;
+        if (glm::dot(motion, impact.normal) < 0.0f)
+            out.push_back(impact);
+    };
+
+    // Vertex-face: every vertex of one triangle against the other triangle, unless it is one of its corners
+    for (int side = 0; side < 2; ++side) {
+        const GLuint* points = side ? pair.b : pair.a;
+        const GLuint* face = side ? pair.a : pair.b;
+        for (int k = 0; k < 3; ++k) {
+            if (sharesVertex(&points[k], 1, face, 3))
+                continue;
+            float t;
+            glm::vec3 barycentric, normal;
+            if (vertexFaceImpact(x0(points[k]), x1(points[k]), x0(face[0]), x1(face[0]), x0(face[1]), x1(face[1]),
+                x0(face[2]), x1(face[2]), thickness, t, barycentric, normal)) {
+                Impact impact{ { points[k], face[0], face[1], face[2] },
+                    { 1.0f, -barycentric.x, -barycentric.y, -barycentric.z }, normal, t };
+                emit(impact);
+            }
+        }
+    }
+
+    // Edge-edge: every edge of one triangle against every edge of the other, unless they share a vertex
+    for (int i = 0; i < 3; ++i) {
+        GLuint edgeA[2] = { pair.a[i], pair.a[(i + 1) % 3] };
+        for (int j = 0; j < 3; ++j) {
+            GLuint edgeB[2] = { pair.b[j], pair.b[(j + 1) % 3] };
+            if (sharesVertex(edgeA, 2, edgeB, 2))
+                continue;
+            float t, s, u;
+            glm::vec3 normal;
+            if (edgeEdgeImpact(x0(edgeA[0]), x1(edgeA[0]), x0(edgeA[1]), x1(edgeA[1]),
+                x0(edgeB[0]), x1(edgeB[0]), x0(edgeB[1]), x1(edgeB[1]), thickness, t, s, u, normal)) {
+                Impact impact{ { edgeA[0], edgeA[1], edgeB[0], edgeB[1] },
+                    { 1.0f - s, s, -(1.0f - u), -u }, normal, t };
+                emit(impact);
+            }
+        }
+    }
+}
+
+// Inelastic push along the normal: the relative motion of the two primitives is changed so they end the step
+// no closer than they started (or than thickness), split between the vertices by weight and inverse mass
+void ContinuousCollision::applyImpact(const Impact& impact, std::vector<Particle>& particles) const {
+    float d0 = 0.0f, approach = 0.0f, denominator = 0.0f;
+    float inverseMass[4];
+    for (int k = 0; k < 4; ++k) {
+        const Particle& particle = particles[impact.vertices[k]];
+        d0 += impact.weights[k] * glm::dot(particle.getPreviousPosition(), impact.normal);
+        approach += impact.weights[k] * glm::dot(particle.getPosition() - particle.getPreviousPosition(), impact.normal);
+        inverseMass[k] = particle.isPinned() ? 0.0f : 1.0f / particle.getMass();
+        denominator += impact.weights[k] * impact.weights[k] * inverseMass[k];
+    }
+
+    float target = std::min(d0, thickness) - d0;
+    float correction = target - approach;
+    if (correction <= 0.0f || denominator <= 0.0f)
+        return;
+
+    for (int k = 0; k < 4; ++k) {
+        if (inverseMass[k] > 0.0f)
+            particles[impact.vertices[k]].displace(impact.normal * (correction * impact.weights[k] * inverseMass[k] / denominator));
+    }
+}
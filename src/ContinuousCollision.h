@@ -0,0 +1,109 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <cstdint>
+#include "Particle.h"
+#include "BVH.h"
+
+// Continuous self-collision for the cloth triangles. Every particle moves on a straight line from its
+// previous to its current position during the step. Vertex-face and edge-edge pairs are tested for the
+// time they become coplanar (a cubic in t), and contacts found that way get an inelastic push along the contact normal.
+//
+// Impacts the pushes leave behind go to a failsafe (rigid impact zones, Provot; Bridson et al. 2002; Harmon
+// et al. 2008): the vertices of each remaining impact are merged into a zone, every zone moves rigidly with
+// the mean linear and angular momentum of its vertices, and detection runs again until no impact is left.
+// A zone that still collides with itself holds still, and after FrozenZonePasses the whole cloth does.
+// The passes cull subtrees by their normal cones, which can miss a flat patch whose edge folds over it.
+// Once a pass has found impacts, the check after the passes and every failsafe pass test all pairs of
+// overlapping boxes instead. A step whose first pass finds nothing is only as sound as the cones.
+class ContinuousCollision {
+public:
+    bool enabled = false;
+    float thickness = 0.005f;  // Distance kept between cloth layers
+    int maxIterations = 4;     // Detect/respond passes per step
+    bool impactZones = true;   // Failsafe after the passes
+    static constexpr int RigidZonePasses = 16;   // Then the zones that still collide stop where they started
+    static constexpr int FrozenZonePasses = 64;  // Then the whole cloth does
+
+    // Stats of the last step's failsafe
+    int zoneCount = 0;
+    int zoneParticles = 0;
+    int zonePasses = 0;
+    int impactsLeft = 0; // What resolveSelfCollision returned
+
+    // An impact found during the step. Vertex-face: vertices[0] is the point, [1..3] the triangle.
+    // Edge-edge: [0, 1] and [2, 3] are the edges. weights are the barycentric weights at the impact,
+    // signed so that sum(weights[i] * x[i]) is the separation vector.
+    struct Impact {
+        GLuint vertices[4];
+        float weights[4];
+        glm::vec3 normal;
+        float time;
+    };
+
+    // Runs detection and response on the cloth until no impact is left or maxIterations is reached, then
+    // the impact zones if enabled. Returns the number of impacts left, found without normal cone culling
+    // once any were responded to. With the zones only contacts the step started in can be left.
+    int resolveSelfCollision(std::vector<Particle>& particles, BVH& clothBVH);
+
+    const std::vector<Impact>& getImpacts() const { return impacts; }
+
+    // Earliest t in [0, 1] where the moving point p is within thickness of the moving triangle (a, b, c)
+    static bool vertexFaceImpact(
+        const glm::vec3& p0, const glm::vec3& p1,
+        const glm::vec3& a0, const glm::vec3& a1,
+        const glm::vec3& b0, const glm::vec3& b1,
+        const glm::vec3& c0, const glm::vec3& c1,
+        float thickness, float& t, glm::vec3& barycentric, glm::vec3& normal);
+
+    // Earliest t in [0, 1] where the moving edges (a, b) and (c, d) come within thickness of each other
+    static bool edgeEdgeImpact(
+        const glm::vec3& a0, const glm::vec3& a1,
+        const glm::vec3& b0, const glm::vec3& b1,
+        const glm::vec3& c0, const glm::vec3& c1,
+        const glm::vec3& d0, const glm::vec3& d1,
+        float thickness, float& t, float& s, float& u, glm::vec3& normal);
+
+private:
+    struct TrianglePair {
+        GLuint a[3];
+        GLuint b[3];
+    };
+
+    // Range of directions the normals of a subtree point in: axis and half-angle
+    struct NormalCone {
+        glm::vec3 axis;
+        float angle;
+    };
+
+    std::vector<TrianglePair> candidatePairs;
+    std::vector<Impact> impacts;
+    std::vector<std::vector<Impact>> blockImpacts;
+
+    // Impact zones: union-find over the particles, the particles in any zone, and those as (zone << 32) |
+    // particle, sorted, with where each zone starts
+    std::vector<uint32_t> zoneParent;
+    std::vector<uint8_t> zoneTouched;
+    std::vector<uint8_t> zoneHeld; // By zone root: holds still for the rest of the step
+    std::vector<uint64_t> zoneMembers;
+    std::vector<uint32_t> zoneStart;
+
+    NormalCone selfTraverse(const BVH& bvh, uint32_t nodeIndex, const std::vector<Particle>& particles, bool cullNormals);
+    void pairTraverse(const BVH& bvh, uint32_t a, uint32_t b);
+    void addLeafPairs(const BVH& bvh, uint32_t a, uint32_t b);
+    void testPair(const TrianglePair& pair, const std::vector<Particle>& particles, std::vector<Impact>& out) const;
+    void applyImpact(const Impact& impact, std::vector<Particle>& particles) const;
+    // One detection pass over the step's motion, into impacts. cullNormals skips the pairs inside subtrees
+    // that are nearly flat.
+    void detect(std::vector<Particle>& particles, BVH& clothBVH, bool cullNormals);
+
+    uint32_t findZone(uint32_t v);
+    // Returns the impacts left: none, or after the last resort only contacts the step started in
+    int resolveImpactZones(std::vector<Particle>& particles, BVH& clothBVH);
+    // The zone's particles end the step where its rigid motion takes them, or where they started if frozen
+    void moveZone(const uint64_t* members, int count, bool frozen, std::vector<Particle>& particles) const;
+
+    // Roots of a t^3 + b t^2 + c t + d in [0, 1], ascending. Returns how many were found.
+    static int solveCubic(double a, double b, double c, double d, float roots[3]);
+};
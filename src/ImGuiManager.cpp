@@ -87,6 +87,25 @@ void ImGuiManager::Render()
         if (StartSimulation) {
             ImGui::Checkbox("Start Simulation", StartSimulation);
         }
+
+        if (DeterministicMode) {
+            // Restart from the initial state so runs with the same settings can be compared
+            if (ImGui::Checkbox("Deterministic Mode", DeterministicMode) && clothNeedsReset) {
+                *clothNeedsReset = true;
+            }
+            if (*DeterministicMode && SimulationStep && StateHash) {
+                ImGui::Text("Step %llu, state hash %016llx", (unsigned long long)*SimulationStep, (unsigned long long)*StateHash);
+            }
+            if (*DeterministicMode && DeterminismCheckRequest && DeterminismCheckResult) {
+                // Resets the cloth, runs it twice (all threads, then one) and compares the end states
+                if (ImGui::Button("Check Determinism"))
+                    *DeterminismCheckRequest = true;
+                if (*DeterminismCheckResult != 0) {
+                    ImGui::SameLine();
+                    ImGui::Text(*DeterminismCheckResult > 0 ? "Hashes match" : "Hashes differ");
+                }
+            }
+        }
         ImGui::EndGroup();
 
         ImGui::Spacing();
@@ -98,6 +117,70 @@ void ImGuiManager::Render()
         if (toggleWind) {
             ImGui::Checkbox("Wind Enabled", toggleWind);
         }
+        if (AeroEnabled) {
+            ImGui::Checkbox("Aerodynamic Wind", AeroEnabled);
+            if (*AeroEnabled && AeroDrag && AeroLift) {
+                ImGui::SliderFloat("Drag Coefficient", AeroDrag, 0.0f, 3.0f);
+                ImGui::SliderFloat("Lift Coefficient", AeroLift, 0.0f, 2.0f);
+            }
+        }
+        if (AirGridEnabled) {
+            ImGui::Checkbox("Air Simulation", AirGridEnabled);
+            if (*AirGridEnabled && AirGridResolution && AirGridIterations) {
+                // Independent from the cloth resolution, so this bounds the cost of the air
+                ImGui::SliderInt("Air Grid Resolution", AirGridResolution, 8, 48);
+                ImGui::SliderInt("Pressure Iterations", AirGridIterations, 5, 60);
+            }
+        }
+        if (CCDEnabled) {
+            ImGui::Checkbox("Continuous Self-Collision", CCDEnabled);
+            if (*CCDEnabled && CCDThickness) {
+                ImGui::SliderFloat("Cloth Thickness", CCDThickness, 0.001f, 0.02f, "%.3f");
+            }
+            if (*CCDEnabled && ImpactZones && CCDIterations) {
+                // With the failsafe on, the pushes only need to catch most impacts
+                ImGui::SliderInt("Collision Passes", CCDIterations, 1, 8);
+                ImGui::Checkbox("Rigid Impact Zones", ImpactZones);
+                if (*ImpactZones && ZoneCount && ZoneParticles)
+                    ImGui::Text("Impact zones %d (%d particles)", *ZoneCount, *ZoneParticles);
+                // Should stay 0 with the zones on; contacts the step started in are all that can be left
+                if (ImpactsLeft)
+                    ImGui::Text("Impacts left %d", *ImpactsLeft);
+            }
+        }
+        if (TearingEnabled) {
+            // Broken springs stay broken until the cloth is reset
+            ImGui::Checkbox("Tearing", TearingEnabled);
+            if (*TearingEnabled && BreakingStrain) {
+                ImGui::SliderFloat("Breaking Strain", BreakingStrain, 0.1f, 2.0f, "%.2f");
+                if (BrokenSprings && TotalBrokenSprings)
+                    ImGui::Text("Broken springs %d (%d this step)", *TotalBrokenSprings, *BrokenSprings);
+            }
+        }
+        if (ClothLayers) {
+            // The layers are laid out when the cloth is set up, so a change resets it
+            if (ImGui::SliderInt("Cloth Layers", ClothLayers, 1, 4) && clothNeedsReset)
+                *clothNeedsReset = true;
+            if (*ClothLayers > 1 && LayerCollision) {
+                ImGui::Checkbox("Layer Collision", LayerCollision);
+                if (*LayerCollision && LayerThickness) {
+                    ImGui::SliderFloat("Layer Thickness", LayerThickness, 0.002f, 0.02f, "%.3f");
+                    if (LayerContacts)
+                        ImGui::Text("Layer contacts %d", *LayerContacts);
+                    if (LayerRebuilds)
+                        ImGui::Text("Layer BVH rebuilds %d", *LayerRebuilds);
+                }
+            }
+        }
+        if (PickingEnabled) {
+            // Left click on the cloth with the cursor shown ('C') grabs the particle under it
+            ImGui::Checkbox("Mouse Picking", PickingEnabled);
+            if (*PickingEnabled && DragStiffness) {
+                ImGui::SliderFloat("Drag Stiffness", DragStiffness, 0.05f, 1.0f, "%.2f");
+                if (PickTime)
+                    ImGui::Text("Last pick %.3f ms", *PickTime);
+            }
+        }
         if (toggleCloth) {
             // Track the previous state of the cloth orientation
             static bool prevToggleCloth = *toggleCloth;
@@ -146,13 +229,50 @@ void ImGuiManager::Render()
         ImGui::BeginGroup();
         ImGui::TextColored(ImVec4(0.4f, 0.7f, 1.0f, 1.0f), "Objects");
         ImGui::Separator();
+        if (BVHAutoRebuild && BVHThreshold) {
+            ImGui::Checkbox("Rebuild Degraded BVH", BVHAutoRebuild);
+            if (*BVHAutoRebuild) {
+                ImGui::SliderFloat("Rebuild Threshold", BVHThreshold, 1.05f, 3.0f, "%.2fx");
+            }
+        }
+        if (BVHCost && BVHBaseline && BVHOverlap && BVHRebuilds) {
+            ImGui::Text("BVH cost %.1f (%.2fx), overlap %.2f, rebuilds %d", *BVHCost,
+                *BVHBaseline > 0.0f ? *BVHCost / *BVHBaseline : 1.0f, *BVHOverlap, *BVHRebuilds);
+        }
+        if (PersistentContacts) {
+            ImGui::Checkbox("Persistent Contacts", PersistentContacts);
+        }
+        if (ContactCount && ReusedContacts) {
+            ImGui::Text("Contacts %d (%d kept from last step)", *ContactCount, *ReusedContacts);
+        }
+        if (ActiveColliders && BroadphasePairs) {
+            ImGui::Text("Colliders near the cloth %d (%d subtree pairs)", *ActiveColliders, *BroadphasePairs);
+        }
         if (SelectCube && SelectSphere) {
+            // Any combination: the colliders are independent
             ImGui::Checkbox("Show Cube", SelectCube);
             ImGui::SameLine();
             ImGui::Checkbox("Show Sphere", SelectSphere);
-
-            if (*SelectCube) *SelectSphere = false;
-            if (*SelectSphere) *SelectCube = false;
+            if (SelectModel) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Show Model", SelectModel);
+            }
+            if (SelectFloor) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Floor", SelectFloor);
+            }
+            if (SelectBody) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Walking Body", SelectBody);
+            }
+            if (SelectModel && *SelectModel && ModelKind) {
+                // A distance field is built the first time it is picked, then read from its cache file
+                const char* kinds[] = { "Mesh", "Distance Field", "Sparse Distance Field" };
+                ImGui::Combo("Model Collider", ModelKind, kinds, 3);
+            }
+        }
+        if (AnimateColliders) {
+            ImGui::Checkbox("Animate Colliders", AnimateColliders);
         }
         ImGui::EndGroup();
 
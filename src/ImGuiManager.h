@@ -9,6 +9,7 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstdint>
 
 
 class ImGuiManager
@@ -54,6 +55,41 @@ public:
 
     void SetSphere(bool* ptr) { SelectSphere = ptr; }
     void SetCube(bool* ptr) { SelectCube = ptr; }
+    void SetModelCollider(bool* ptr, int* kind) { SelectModel = ptr; ModelKind = kind; }
+    void SetFloor(bool* ptr) { SelectFloor = ptr; }
+    void SetBody(bool* ptr) { SelectBody = ptr; }
+
+    void SetDeterministic(bool* mode, uint64_t* step, uint64_t* hash) { DeterministicMode = mode; SimulationStep = step; StateHash = hash; }
+    void SetDeterminismCheck(bool* request, const int* result) { DeterminismCheckRequest = request; DeterminismCheckResult = result; }
+
+    void SetAerodynamics(bool* enabled, float* drag, float* lift) { AeroEnabled = enabled; AeroDrag = drag; AeroLift = lift; }
+
+    void SetAirGrid(bool* enabled, int* resolution, int* iterations) { AirGridEnabled = enabled; AirGridResolution = resolution; AirGridIterations = iterations; }
+
+    void SetContinuousCollision(bool* enabled, float* thickness) { CCDEnabled = enabled; CCDThickness = thickness; }
+    void SetImpactZones(bool* enabled, int* iterations, const int* zones, const int* particles, const int* impactsLeft) {
+        ImpactZones = enabled; CCDIterations = iterations; ZoneCount = zones; ZoneParticles = particles; ImpactsLeft = impactsLeft;
+    }
+
+    void SetTearing(bool* enabled, float* strain, const int* broken, const int* totalBroken) {
+        TearingEnabled = enabled; BreakingStrain = strain; BrokenSprings = broken; TotalBrokenSprings = totalBroken;
+    }
+
+    void SetClothLayers(int* layers, bool* collision, float* thickness, const int* contacts, const int* rebuilds) {
+        ClothLayers = layers; LayerCollision = collision; LayerThickness = thickness; LayerContacts = contacts; LayerRebuilds = rebuilds;
+    }
+
+    void SetPicking(bool* enabled, float* stiffness, const float* time) { PickingEnabled = enabled; DragStiffness = stiffness; PickTime = time; }
+
+    void SetBVHMonitor(bool* autoRebuild, float* threshold, const float* cost, const float* baseline, const float* overlap, const int* rebuilds) {
+        BVHAutoRebuild = autoRebuild; BVHThreshold = threshold; BVHCost = cost; BVHBaseline = baseline; BVHOverlap = overlap; BVHRebuilds = rebuilds;
+    }
+
+    void SetContactCache(bool* persistent, const int* contacts, const int* reused) { PersistentContacts = persistent; ContactCount = contacts; ReusedContacts = reused; }
+
+    void SetColliderAnimation(bool* ptr) { AnimateColliders = ptr; }
+
+    void SetBroadphase(const int* activeColliders, const int* pairs) { ActiveColliders = activeColliders; BroadphasePairs = pairs; }
 
     int GetFabricTypeUniform();
 
@@ -87,6 +123,62 @@ private:
 
     bool* SelectSphere;
     bool* SelectCube;
+    bool* SelectModel = nullptr;
+    int* ModelKind = nullptr;
+    bool* SelectFloor = nullptr;
+    bool* SelectBody = nullptr;
+
+    bool* AeroEnabled = nullptr;
+    float* AeroDrag = nullptr;
+    float* AeroLift = nullptr;
+
+    bool* AirGridEnabled = nullptr;
+    int* AirGridResolution = nullptr;
+    int* AirGridIterations = nullptr;
+
+    bool* CCDEnabled = nullptr;
+    float* CCDThickness = nullptr;
+    bool* ImpactZones = nullptr;
+    int* CCDIterations = nullptr;
+    const int* ZoneCount = nullptr;
+    const int* ZoneParticles = nullptr;
+    const int* ImpactsLeft = nullptr;
+
+    bool* TearingEnabled = nullptr;
+    float* BreakingStrain = nullptr;
+    const int* BrokenSprings = nullptr;
+    const int* TotalBrokenSprings = nullptr;
+
+    int* ClothLayers = nullptr;
+    bool* LayerCollision = nullptr;
+    float* LayerThickness = nullptr;
+    const int* LayerContacts = nullptr;
+    const int* LayerRebuilds = nullptr;
+
+    bool* PickingEnabled = nullptr;
+    float* DragStiffness = nullptr;
+    const float* PickTime = nullptr;
+
+    bool* BVHAutoRebuild = nullptr;
+    float* BVHThreshold = nullptr;
+    const float* BVHCost = nullptr;
+    const float* BVHBaseline = nullptr;
+    const float* BVHOverlap = nullptr;
+    const int* BVHRebuilds = nullptr;
+
+    bool* PersistentContacts = nullptr;
+    const int* ContactCount = nullptr;
+    const int* ReusedContacts = nullptr;
+
+    const int* ActiveColliders = nullptr;
+    const int* BroadphasePairs = nullptr;
+    bool* AnimateColliders = nullptr;
+
+    bool* DeterministicMode = nullptr;
+    uint64_t* SimulationStep = nullptr;
+    uint64_t* StateHash = nullptr;
+    bool* DeterminismCheckRequest = nullptr;
+    const int* DeterminismCheckResult = nullptr;
 
     int currentMaterialIndex = 0;
     //int* fabricType;
@@ -0,0 +1,96 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+void MappedFile::swap(MappedFile& other) {
+    std::swap(view, other.view);
+    std::swap(length, other.length);
+#ifdef _WIN32
+    std::swap(fileHandle, other.fileHandle);
+    std::swap(mappingHandle, other.mappingHandle);
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mapped) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    view = mapped;
+    length = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (view)
+        UnmapViewOfFile(view);
+    if (mappingHandle)
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+    if (fileHandle)
+        CloseHandle(static_cast<HANDLE>(fileHandle));
+    view = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+    length = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file); // The mapping keeps the file alive
+    if (mapped == MAP_FAILED)
+        return false;
+    view = mapped;
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (view)
+        munmap(view, length);
+    view = nullptr;
+    length = 0;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on first touch and shared with
+// its file cache, so opening a large file is instant and only the parts that are read cost memory.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    void swap(MappedFile& other);
+
+    const unsigned char* data() const { return static_cast<const unsigned char*>(view); }
+    size_t size() const { return length; }
+    bool isOpen() const { return view != nullptr; }
+
+private:
+    void* view = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
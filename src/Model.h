@@ -7,6 +7,9 @@
 
 #include "Mesh.h"
 #include "Shader.h"
+#include "BVH.h"
+#include "SignedDistanceField.h"
+#include "SparseDistanceField.h"
 
 #include <string>
 #include <fstream>
@@ -14,6 +17,7 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <memory>
 using namespace std;
 
 inline unsigned int TextureFromFile(const char *path, const string &directory);
@@ -48,6 +52,54 @@ public:
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
 
+    // all meshes merged into one triangle list (vertex positions only), for collision queries
+    void getCollisionMesh(vector<glm::vec3>& positions, vector<GLuint>& indices) const
+    {
+        positions.clear();
+        indices.clear();
+        for (const Mesh& mesh : meshes)
+        {
+            GLuint base = static_cast<GLuint>(positions.size());
+            for (const Vertex& vertex : mesh.vertices)
+                positions.push_back(vertex.Position);
+            for (unsigned int index : mesh.indices)
+                indices.push_back(base + index);
+        }
+    }
+
+    // SAH BVH over the merged meshes. The model is static, so this is built once at load time.
+    std::unique_ptr<BVH> buildCollisionBVH() const
+    {
+        vector<glm::vec3> positions;
+        vector<GLuint> indices;
+        getCollisionMesh(positions, indices);
+        return std::unique_ptr<BVH>(new BVH(positions, indices, BVHBuilder::SAH));
+    }
+
+    // Signed distance field of the merged meshes (they should be closed). Read from cachePath when it holds
+    // the field of this exact model at this resolution, otherwise built in parallel and written there.
+    std::unique_ptr<SignedDistanceField> buildSignedDistanceField(const string& cachePath, int resolution) const
+    {
+        vector<glm::vec3> positions;
+        vector<GLuint> indices;
+        getCollisionMesh(positions, indices);
+        std::unique_ptr<SignedDistanceField> field(new SignedDistanceField());
+        field->loadOrBuild(cachePath, positions, indices, resolution);
+        return field;
+    }
+
+    // Narrow-band version for fine resolutions, where a dense grid would not fit in memory. The cache
+    // file is memory-mapped when it is loaded.
+    std::unique_ptr<SparseDistanceField> buildSparseDistanceField(const string& cachePath, int resolution) const
+    {
+        vector<glm::vec3> positions;
+        vector<GLuint> indices;
+        getCollisionMesh(positions, indices);
+        std::unique_ptr<SparseDistanceField> field(new SparseDistanceField());
+        field->loadOrBuild(cachePath, positions, indices, resolution);
+        return field;
+    }
+
 private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
@@ -1,106 +1,87 @@
 // face  to face collision detection
 #include "NewCollision.h"
 #include <iostream>
+#include <limits>
+#include <cmath>
+#include <atomic>
 #include "Particle.h"
 #include "Object.h"
 #include "BVH.h"
+#include "Parallel.h"
 
 bool NewCollision::isColliding = false;
 int NewCollision::bvhCollisionChecks = 0;
 int NewCollision::collisionChecks = 0;
 float NewCollision::offset = 0.01f;
+float NewCollision::meshReach = 0.05f;
+bool NewCollision::batchMeshQueries = false;
+std::vector<GLuint> NewCollision::candidateTriangles;
+std::vector<Contact> NewCollision::updatedContacts;
 
 bool NewCollision::checkTriangleObjectIntersection(
     const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3,
     const Object& object, glm::vec3& intersectionPoint, glm::vec3& normal) {
-
-    // Calculate triangle normal first - this is needed for both cube and sphere
-    glm::vec3 edge1 = v2 - v1;
-    glm::vec3 edge2 = v3 - v1;
-    normal = -1.0f * glm::normalize(glm::cross(edge1, edge2));
-
-    if (object.isCube()) {
-        // Get cube bounds
-        glm::vec3 center = object.getCenter();
-        float halfLength = object.getHalfLength() + offset;
-        glm::vec3 cubeMin = center - glm::vec3(halfLength);
-        glm::vec3 cubeMax = center + glm::vec3(halfLength);
-
-        // Calculate triangle bounds
-        glm::vec3 triangleMin = glm::min(glm::min(v1, v2), v3);
-        glm::vec3 triangleMax = glm::max(glm::max(v1, v2), v3);
-
-        // Simple AABB overlap test first
-        if (triangleMax.x < cubeMin.x || triangleMin.x > cubeMax.x ||
-            triangleMax.y < cubeMin.y || triangleMin.y > cubeMax.y ||
-            triangleMax.z < cubeMin.z || triangleMin.z > cubeMax.z) {
-            return false;
-        }
-
-        // If any vertex is inside the cube, we have collision
-        auto isInside = [&](const glm::vec3& p) {
-            return p.x >= cubeMin.x && p.x <= cubeMax.x &&
-                    p.y >= cubeMin.y && p.y <= cubeMax.y &&
-                    p.z >= cubeMin.z && p.z <= cubeMax.z;
-        };
-
-        if (isInside(v1) || isInside(v2) || isInside(v3)) {
-            // Use the center of the triangle as intersection point
-            intersectionPoint = (v1 + v2 + v3) / 3.0f;
-            // std::cout << "Collision detected with triangle vertices: "
-            //                 << "v1(" << v1.x << ", " << v1.y << ", " << v1.z << "), "
-            //                 << "v2(" << v2.x << ", " << v2.y << ", " << v2.z << "), "
-            //                 << "v3(" << v3.x << ", " << v3.y << ", " << v3.z << ")\n";
-            return true;
-        }
-
+    if (!object.isCube() && !object.isSphere())
         return false;
-    }
-    else if (object.isSphere()) {
-        glm::vec3 center = object.getCenter();
-        float radius = object.getHalfLength() + offset;
-
-        // Check if any vertex is inside the sphere
-        auto isInsideSphere = [&](const glm::vec3& p) {
-            return glm::length(p - center) <= radius;
-        };
-
-        if (isInsideSphere(v1) || isInsideSphere(v2) || isInsideSphere(v3)) {
-            intersectionPoint = (v1 + v2 + v3) / 3.0f;
-            // std::cout << "Collision detected with triangle vertices: "
-            //                 << "v1(" << v1.x << ", " << v1.y << ", " << v1.z << "), "
-            //                 << "v2(" << v2.x << ", " << v2.y << ", " << v2.z << "), "
-            //                 << "v3(" << v3.x << ", " << v3.y << ", " << v3.z << ")\n";
-            return true;
-        }
 
-        return false;
+    // The deepest vertex inside the shell: the contact is the shell point it leaves through, and the normal
+    // the shape's outward normal there (not the triangle's, which faces either way)
+    float deepest = 0.0f;
+    for (const glm::vec3* v : { &v1, &v2, &v3 }) {
+        uint32_t feature;
+        glm::vec3 n;
+        float depth = shellDepth(object, offset, *v, feature, n);
+        if (depth > deepest) {
+            deepest = depth;
+            normal = n;
+            intersectionPoint = *v + n * depth;
+        }
     }
-    return false;
+    return deepest > 0.0f;
 }
 
-void NewCollision::traverseBVH(BVHNode* node, const Object& object, std::vector<GLuint>& potentialTriangles) {
-    if (!node) return;
-
-    bool intersects = false;
+void NewCollision::traverseBVH(const BVH& bvh, const Object& object, std::vector<GLuint>& potentialTriangles) {
     if (object.isCube()) {
         glm::vec3 center = object.getCenter();
         float halfLength = object.getHalfLength() + offset;
-        AABB cubeAABB{center - glm::vec3(halfLength), center + glm::vec3(halfLength)};
-        intersects = node->aabb.intersects(cubeAABB);
+        bvh.queryBox(center - glm::vec3(halfLength), center + glm::vec3(halfLength), potentialTriangles);
     } else if (object.isSphere()) {
-        intersects = node->aabb.intersectsSphere(object.getCenter(), object.getHalfLength() + offset);
+        bvh.querySphere(object.getCenter(), object.getHalfLength() + offset, potentialTriangles);
+    } else if (object.isMesh()) {
+        bvh.queryBox(object.getBoundsMin() - glm::vec3(offset), object.getBoundsMax() + glm::vec3(offset), potentialTriangles);
     }
+}
 
-    if (!intersects) return;
+float NewCollision::featureDepth(const Object& object, float thickness, const glm::vec3& p, uint32_t feature, glm::vec3& normal) {
+    if (object.isCube()) {
+        int axis = static_cast<int>(feature >> 1);
+        float side = (feature & 1) ? 1.0f : -1.0f;
+        normal = glm::vec3(0.0f);
+        normal[axis] = side;
+        return object.getHalfLength() + thickness - side * (p[axis] - object.getCenter()[axis]);
+    }
+    glm::vec3 direction = p - object.getCenter();
+    float distance = glm::length(direction);
+    normal = distance > 1e-6f ? direction / distance : glm::vec3(0.0f, 1.0f, 0.0f);
+    return object.getHalfLength() + thickness - distance;
+}
 
-    if (node->isLeaf()) {
-        potentialTriangles.insert(potentialTriangles.end(),
-            node->triangleIndices.begin(), node->triangleIndices.end());
-    } else {
-        traverseBVH(node->left, object, potentialTriangles);
-        traverseBVH(node->right, object, potentialTriangles);
+float NewCollision::shellDepth(const Object& object, float thickness, const glm::vec3& p, uint32_t& feature, glm::vec3& normal) {
+    if (!object.isCube()) {
+        feature = 0;
+        return featureDepth(object, thickness, p, 0, normal);
     }
+    float depth = std::numeric_limits<float>::max();
+    for (uint32_t f = 0; f < 6; ++f) {
+        glm::vec3 n;
+        float d = featureDepth(object, thickness, p, f, n);
+        if (d < depth) {
+            depth = d;
+            feature = f;
+            normal = n;
+        }
+    }
+    return depth;
 }
 
 void NewCollision::resolveCollision(
@@ -108,174 +89,298 @@ void NewCollision::resolveCollision(
     BVH* clothBVH,
     const std::vector<GLuint>& triangleIndices,
     const Object& object,
-    float deltaTime,
-    std::vector<GLuint>& collidingIndices, // Pass by reference
+    ContactCache& contacts,
     float StaticFriction, float KineticFriction
     ) {
 
-    // Add debug print
-    // std::cout << "Starting collision resolution with " << triangleIndices.size() / 3
-    //           << " triangles" << std::endl;
-
     // Validate input
     if (triangleIndices.size() % 3 != 0) {
         return;
     }
 
-    if (!clothBVH || !clothBVH->root) return;
+    if (object.isMesh()) {
+        resolveMeshCollision(particles, nullptr, static_cast<int>(particles.size()), object, offset, meshReach, StaticFriction, KineticFriction);
+        return;
+    }
 
-    clothBVH->refit(); // Update BVH with current positions
+    if (!clothBVH || clothBVH->empty()) return;
 
-    std::vector<GLuint> potentialTriangles;
-    traverseBVH(clothBVH->root, object, potentialTriangles);
+    // The caller refits the BVH once per step (BVH::refit(step)) before this runs
+    candidateTriangles.clear();
+    traverseBVH(*clothBVH, object, candidateTriangles);
+    resolveCollision(particles, candidateTriangles, object, contacts, offset, StaticFriction, KineticFriction);
+}
 
-    for (size_t i = 0; i < potentialTriangles.size(); i += 3) {
-        bvhCollisionChecks++;
-        if (i + 2 >= potentialTriangles.size()) break;
-        GLuint i1 = potentialTriangles[i], i2 = potentialTriangles[i+1], i3 = potentialTriangles[i+2];
-        if (i1 >= particles.size() || i2 >= particles.size() || i3 >= particles.size()) continue;
-
-        Particle& p1 = particles[i1];
-        Particle& p2 = particles[i2];
-        Particle& p3 = particles[i3];
-        glm::vec3 intersectionPoint, normal;
-
-        // Perform detailed collision check for the triangle
-        if (checkTriangleObjectIntersection(
-            p1.getPosition(), p2.getPosition(), p3.getPosition(),
-            object, intersectionPoint, normal)) {
-
-            // Calculate penetration depths
-            float penetrationDepth1 = glm::dot(normal, intersectionPoint - p1.getPosition());
-            float penetrationDepth2 = glm::dot(normal, intersectionPoint - p2.getPosition());
-            float penetrationDepth3 = glm::dot(normal, intersectionPoint - p3.getPosition());
-
-            // Add colliding indices
-            //collidingIndices.push_back(triangleIndices[i]);
-            //collidingIndices.push_back(triangleIndices[i + 1]);
-            //collidingIndices.push_back(triangleIndices[i + 2]);
+void NewCollision::resolveCollision(
+    std::vector<Particle>& particles,
+    const std::vector<GLuint>& potentialTriangles,
+    const Object& object,
+    ContactCache& contacts,
+    float thickness,
+    float StaticFriction, float KineticFriction
+    ) {
+    contacts.beginStep(object, particles.size());
+
+    // Last step's contacts, tested against their own feature without going through the BVH. A particle
+    // has at most one contact, so they can all be resolved at once.
+    const std::vector<Contact>& previous = contacts.previous();
+    updatedContacts.resize(previous.size());
+    Parallel::forEach(static_cast<int>(previous.size()), [&](int i) {
+        Contact contact = previous[i];
+        Particle& particle = particles[contact.particle];
+        glm::vec3 position = particle.getPosition();
+
+        uint32_t closest;
+        glm::vec3 closestNormal;
+        float closestDepth = shellDepth(object, thickness, position, closest, closestNormal);
+        if (closestDepth < -contacts.margin) {
+            updatedContacts[i].age = -1; // Left the shell, the contact ends
+            return;
+        }
 
-            isColliding = true;
+        // The feature only changes when another one is clearly closer, so near a cube edge the normal
+        // doesn't flip back and forth between two faces
+        contact.depth = featureDepth(object, thickness, position, contact.feature, contact.normal);
+        if (closest != contact.feature && closestDepth < contact.depth - contacts.margin) {
+            contact.feature = closest;
+            contact.normal = closestNormal;
+            contact.depth = closestDepth;
+            contact.sticking = false;
+        }
+        contact.age++;
+        contacts.claim(contact.particle);
+        resolveContact(particle, contact, StaticFriction, KineticFriction);
+        updatedContacts[i] = contact;
+    }, 64);
+    for (const Contact& contact : updatedContacts) {
+        if (contact.age >= 0)
+            contacts.add(contact);
+    }
+
+    // New contacts: vertices of the candidate triangles that are inside the shell and not handled above
+    for (size_t i = 0; i + 2 < potentialTriangles.size(); i += 3) {
+        bvhCollisionChecks++;
+        for (int k = 0; k < 3; ++k) {
+            GLuint v = potentialTriangles[i + k];
+            if (v >= particles.size() || !contacts.claim(v))
+                continue;
+            Particle& particle = particles[v];
+            if (particle.isPinned())
+                continue;
 
-            // Resolve collision for each particle
-            resolveParticleCollision(p1, normal, penetrationDepth1, deltaTime, StaticFriction, KineticFriction);
-            resolveParticleCollision(p2, normal, penetrationDepth2, deltaTime, StaticFriction, KineticFriction);
-            resolveParticleCollision(p3, normal, penetrationDepth3, deltaTime, StaticFriction, KineticFriction);
+            Contact contact{};
+            contact.particle = v;
+            float depth = shellDepth(object, thickness, particle.getPosition(), contact.feature, contact.normal);
+            if (depth <= 0.0f)
+                continue;
+            contact.depth = depth;
+            resolveContact(particle, contact, StaticFriction, KineticFriction);
+            contacts.add(contact);
         }
     }
+
+    contacts.endStep();
+    if (contacts.contactCount > 0)
+        isColliding = true;
 }
 
-void NewCollision::resolveCollisionWithOutBVH(
-        std::vector<Particle>& particles,
-        const std::vector<GLuint>& triangleIndices,
-        const Object& object,
-        float deltaTime,
-        std::vector<GLuint>& collidingIndices, // Pass by reference
-        float StaticFriction, float KineticFriction) {
-        // Add debug print
-        // std::cout << "Starting collision resolution with " << triangleIndices.size() / 3
-        //           << " triangles" << std::endl;
+void NewCollision::resolveMeshCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount,
+    const Object& object, float thickness, float reach, float StaticFriction, float KineticFriction) {
+    const BVH* mesh = object.getMeshBVH();
+    if (!mesh || mesh->empty())
+        return;
 
-        // Validate input
-        if (triangleIndices.size() % 3 != 0) {
+    const glm::vec3 reachMin = object.getBoundsMin() - glm::vec3(reach);
+    const glm::vec3 reachMax = object.getBoundsMax() + glm::vec3(reach);
+    std::atomic<bool> anyContact(false);
+
+    // Each block gathers its particles near the mesh, then looks them up one by one or as one batch, a
+    // single pass through the mesh BVH. Blocks only touch their own particles.
+    Parallel::forBlocks(candidateCount, [&](int begin, int end) {
+        glm::vec3 points[BVH::MaxQueryBatch], closest[BVH::MaxQueryBatch];
+        float distance2[BVH::MaxQueryBatch];
+        uint32_t triangle[BVH::MaxQueryBatch];
+        int particleIndex[BVH::MaxQueryBatch];
+        int count = 0;
+        for (int c = begin; c < end; ++c) {
+            const int i = candidates ? static_cast<int>(candidates[c]) : c;
+            glm::vec3 p = particles[i].getPosition();
+            if (particles[i].isPinned() || glm::any(glm::lessThan(p, reachMin)) || glm::any(glm::greaterThan(p, reachMax)))
+                continue;
+            points[count] = p;
+            distance2[count] = reach * reach;
+            particleIndex[count] = i;
+            ++count;
+        }
+        if (count == 0)
             return;
+        if (batchMeshQueries) {
+            mesh->closestPoints(points, count, distance2, closest, triangle);
+        } else {
+            for (int i = 0; i < count; ++i) {
+                if (mesh->closestPoint(points[i], reach, closest[i], triangle[i]))
+                    distance2[i] = glm::dot(closest[i] - points[i], closest[i] - points[i]);
+                else
+                    triangle[i] = UINT32_MAX;
+            }
         }
 
-        // Iterate through triangles
-        for (size_t i = 0; i < triangleIndices.size(); i += 3) {
-            // Bounds check
-            collisionChecks++;
-
-            if (i + 2 >= triangleIndices.size() ||
-                triangleIndices[i] >= particles.size() ||
-                triangleIndices[i + 1] >= particles.size() ||
-                triangleIndices[i + 2] >= particles.size()) {
+        for (int i = 0; i < count; ++i) {
+            if (triangle[i] == UINT32_MAX)
                 continue;
-            }
+            // The pseudonormal of the feature the closest point lies on tells inside from outside (the mesh
+            // winds counter-clockwise); the face normal alone would flip the sign next to sharp edges
+            glm::vec3 pseudonormal = object.meshPseudonormal(triangle[i], closest[i]);
+            glm::vec3 away = points[i] - closest[i];
+            float distance = std::sqrt(distance2[i]);
+            bool inFront = glm::dot(away, pseudonormal) >= 0.0f;
+            float signedDistance = inFront ? distance : -distance;
+            if (signedDistance >= thickness)
+                continue;
+
+            // Out along the line to the closest point, which leaves through the nearest feature from either side
+            Contact contact{};
+            contact.particle = static_cast<uint32_t>(particleIndex[i]);
+            contact.normal = distance > 1e-6f ? (inFront ? away : -away) / distance : pseudonormal;
+            contact.depth = thickness - signedDistance;
+            contact.age = 1; // No bounce, like the distance-field colliders
+            resolveContact(particles[particleIndex[i]], contact, StaticFriction, KineticFriction);
+            anyContact.store(true, std::memory_order_relaxed);
+        }
+    }, BVH::MaxQueryBatch);
+
+    if (anyContact)
+        isColliding = true;
+}
 
-            // Get particles forming this triangle
-            Particle& p1 = particles[triangleIndices[i]];
-            Particle& p2 = particles[triangleIndices[i + 1]];
-            Particle& p3 = particles[triangleIndices[i + 2]];
-
-            glm::vec3 intersectionPoint, normal;
-
-            if (checkTriangleObjectIntersection(
-                p1.getPosition(), p2.getPosition(), p3.getPosition(),
-                object, intersectionPoint, normal)) {
-
-                // Calculate penetration depths
-                float penetrationDepth1 = glm::dot(normal, intersectionPoint - p1.getPosition());
-                float penetrationDepth2 = glm::dot(normal, intersectionPoint - p2.getPosition());
-                float penetrationDepth3 = glm::dot(normal, intersectionPoint - p3.getPosition());
-
-                // isColliding = true;
-                // Push the indices of the colliding triangle
-                //collidingIndices.push_back(triangleIndices[i]);
-                //collidingIndices.push_back(triangleIndices[i + 1]);
-                //collidingIndices.push_back(triangleIndices[i + 2]);
-
-                isColliding = true;
-                // Resolve collision for each particle
-                resolveParticleCollision(p1, normal, penetrationDepth1, deltaTime, StaticFriction, KineticFriction);
-                resolveParticleCollision(p2, normal, penetrationDepth2, deltaTime, StaticFriction, KineticFriction);
-                resolveParticleCollision(p3, normal, penetrationDepth3, deltaTime, StaticFriction, KineticFriction);
+bool NewCollision::sweepShell(const Object& object, const glm::vec3& from, const glm::vec3& to, float thickness, float& t) {
+    const glm::vec3 motion = to - from;
+    if (object.isCube()) {
+        // Slab test against the cube grown by thickness
+        glm::vec3 reach(object.getHalfLength() + thickness);
+        glm::vec3 boxMin = object.getCenter() - reach, boxMax = object.getCenter() + reach;
+        if (glm::all(glm::greaterThanEqual(from, boxMin)) && glm::all(glm::lessThanEqual(from, boxMax)))
+            return false;
+        float enter = 0.0f, exit = 1.0f;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (std::abs(motion[axis]) < 1e-12f) {
+                if (from[axis] < boxMin[axis] || from[axis] > boxMax[axis])
+                    return false;
+                continue;
             }
+            float t0 = (boxMin[axis] - from[axis]) / motion[axis];
+            float t1 = (boxMax[axis] - from[axis]) / motion[axis];
+            enter = std::max(enter, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
         }
+        if (enter > exit)
+            return false;
+        t = enter;
+        return true;
+    }
+    if (object.isSphere()) {
+        // |from + t * motion - center| = radius, smaller root
+        float radius = object.getHalfLength() + thickness;
+        glm::vec3 m = from - object.getCenter();
+        float c = glm::dot(m, m) - radius * radius;
+        if (c <= 0.0f)
+            return false;
+        float a = glm::dot(motion, motion), b = glm::dot(m, motion);
+        float discriminant = b * b - a * c;
+        if (a < 1e-24f || b >= 0.0f || discriminant < 0.0f)
+            return false;
+        float hit = (-b - std::sqrt(discriminant)) / a;
+        if (hit > 1.0f)
+            return false;
+        t = hit;
+        return true;
     }
+    if (object.isMesh()) {
+        // The first triangle crossed must be entered from its front, otherwise from was inside already
+        uint32_t triangle;
+        float hit;
+        if (!object.getMeshBVH()->raycast(from, motion, 1.0f, hit, triangle))
+            return false;
+        if (glm::dot(motion, object.meshNormal(triangle)) >= 0.0f)
+            return false;
+        t = hit;
+        return true;
+    }
+    return false;
+}
 
+void NewCollision::resolveContact(Particle& particle, Contact& contact, float Fs, float Fk) {
+    const float restitution = 0.5f;
+    const glm::vec3& normal = contact.normal;
+
+    glm::vec3 position = particle.getPosition();
+    glm::vec3 velocity = position - particle.getPreviousPosition();
+
+    // Out of the shell, and no more approach speed. Only a new contact bounces: a resting contact that
+    // bounced on every step is what made draped cloth jitter
+    float correction = std::max(contact.depth, 0.0f);
+    position += normal * correction;
+    float normalSpeed = glm::dot(velocity, normal);
+    glm::vec3 tangentVelocity = velocity - normalSpeed * normal;
+    float removed = 0.0f;
+    if (normalSpeed < 0.0f) {
+        float bounce = contact.age == 0 ? -restitution * normalSpeed : 0.0f;
+        removed = bounce - normalSpeed;
+        normalSpeed = bounce;
+    }
 
-void NewCollision::resolveParticleCollision(
-    Particle& particle,
-    const glm::vec3& normal,
-    float penetrationDepth,
-    float deltaTime, float Fs, float Fk) {
+    // Coulomb friction on positions: the tangential motion it may cancel is mu times the normal push of
+    // this step. A sticking contact measures its slip from the anchor it was held at, so the friction
+    // state carries over and the particle doesn't creep a little further every step.
+    float normalPush = correction + removed;
+    glm::vec3 slip = contact.sticking ? position - contact.anchor : tangentVelocity;
+    slip -= glm::dot(slip, normal) * normal;
+    float slipLength = glm::length(slip);
+    if (slipLength <= Fs * normalPush) {
+        position -= slip;
+        tangentVelocity = glm::vec3(0.0f);
+        contact.sticking = true;
+    } else {
+        float cut = std::min(Fk * normalPush, slipLength);
+        position -= slip * (cut / slipLength);
+        float speed = glm::length(tangentVelocity);
+        if (speed > 1e-7f)
+            tangentVelocity *= std::max(0.0f, 1.0f - cut / speed);
+        contact.sticking = false;
+    }
+    contact.anchor = position;
 
-    // std::cout << "Resolving particle collision" << std::endl;
+    particle.setPosition(position);
+    particle.setPreviousPosition(position - (tangentVelocity + normalSpeed * normal));
+}
 
-    const float repulsionStrength = 500.0f;
-    const float restitution = 0.5f;
+void NewCollision::resolveCollisionWithOutBVH(
+        std::vector<Particle>& particles,
+        const std::vector<GLuint>& triangleIndices,
+        const Object& object,
+        float StaticFriction, float KineticFriction) {
+    // Validate input
+    if (triangleIndices.size() % 3 != 0) {
+        return;
+    }
 
-    const float staticFrictionCoeff = Fs;
-    const float kineticFrictionCoeff = Fk;
-
-    // Calculate velocity
-    glm::vec3 velocity = particle.getPosition() - particle.getPreviousPosition();
-
-    // Apply repulsion force
-    glm::vec3 repulsionForce = normal * (repulsionStrength * std::abs(penetrationDepth));
-    particle.applyForce(repulsionForce);
-    particle.update(deltaTime);
-
-    // Apply restitution
-    glm::vec3 velocityNormal = glm::dot(velocity, normal) * normal;
-    //std::cout << "normal: { " << normal.x << ", " << normal.y << ", " << normal.z << "}\n";
-    //std::cout << "velocityNormal: { " << velocity.x << ", " << velocity.y << ", " << velocity.z << "}\n";
-    glm::vec3 velocityTangent = velocityNormal - velocity;
-    glm::vec3 newVelocity = velocityTangent - velocityNormal * restitution;
-
-    // Friction calculation
-    float normalForce = glm::length(repulsionForce);
-    glm::vec3 frictionDirection = glm::length(velocityTangent) > 0.0001f 
-        ? glm::normalize(velocityTangent) 
-        : glm::vec3(0.0f);
-    
-    // Choose between static and kinetic friction
-    float frictionCoeff = glm::length(velocityTangent) < 0.0001f 
-        ? staticFrictionCoeff 
-        : kineticFrictionCoeff;
-    
-    // Calculate friction force
-    glm::vec3 frictionForce = -frictionDirection * (normalForce * frictionCoeff);
-
-    // Apply friction
-    newVelocity += frictionForce / particle.getMass();
-
-    // Update particle
-    particle.setPreviousPosition(particle.getPosition() - newVelocity);
-
-    // Correct position if there's penetration
-    if (penetrationDepth < 0.0f) {
-        particle.setPosition(particle.getPosition() - normal * penetrationDepth);
+    // Position projection only: the step already integrated every particle, a contact just moves it out of
+    // the shell and adjusts its velocity. Each vertex is projected on its own along the shape's normal; one
+    // shared by several triangles is out after the first, so it is never pushed twice.
+    for (size_t i = 0; i + 2 < triangleIndices.size(); i += 3) {
+        collisionChecks++;
+        for (int k = 0; k < 3; ++k) {
+            GLuint v = triangleIndices[i + k];
+            if (v >= particles.size() || particles[v].isPinned())
+                continue;
+            Contact contact{};
+            contact.particle = v;
+            float depth = shellDepth(object, offset, particles[v].getPosition(), contact.feature, contact.normal);
+            if (depth <= 0.0f)
+                continue;
+            contact.depth = depth;
+            resolveContact(particles[v], contact, StaticFriction, KineticFriction);
+            isColliding = true;
+        }
     }
 }
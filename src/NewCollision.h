@@ -5,6 +5,7 @@
 #include "Particle.h"
 #include "Object.h"
 #include "BVH.h"
+#include "ContactCache.h"
 #include <glad/glad.h>
 #include <algorithm>
 
@@ -14,28 +15,64 @@ public:
     static int bvhCollisionChecks;
     static int collisionChecks;
     static float offset;
+    static float meshReach; // How far behind a mesh collider's surface a particle is still pushed back out
+    // Mesh colliders answer a block's particles with one batched BVH traversal (BVH::closestPoints) instead
+    // of one closestPoint each. The batch only pays off where its lane loops vectorize 8 wide (-O3 with
+    // AVX2); at the default -O2 it is slower, so it is off unless turned on for such a build.
+    static bool batchMeshQueries;
+    static std::vector<GLuint> candidateTriangles; // Reused every step, so it stops allocating once grown
+    // Whether a vertex is inside the collision shell; if so, the point the deepest one leaves the shell
+    // through and the shape's outward normal there
     static bool checkTriangleObjectIntersection(
         const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3,
         const Object& object, glm::vec3& intersectionPoint, glm::vec3& normal);
+    // Contacts of the last step are re-tested first, then the BVH candidates are searched for new ones
     static void resolveCollision(
         std::vector<Particle>& particles,
         BVH* clothBVH,
         const std::vector<GLuint>& triangleIndices,
         const Object& object,
-        float deltaTime,
-        std::vector<GLuint>& collidingIndices, // Pass by reference);
+        ContactCache& contacts,
         float StaticFriction, float KineticFriction
     );
+    // Narrowphase only: contacts for the vertices of candidateTriangles (3 vertex indices per triangle), as
+    // found by traverseBVH or by a broadphase. The shell is the object grown by thickness (offset in world
+    // units; a caller working in a scaled collider's rest frame passes it in rest units).
+    static void resolveCollision(
+        std::vector<Particle>& particles,
+        const std::vector<GLuint>& candidateTriangles,
+        const Object& object,
+        ContactCache& contacts,
+        float thickness,
+        float StaticFriction, float KineticFriction
+    );
+    // Mesh colliders: particles near the mesh are batched through its BVH (closest point per particle).
+    // Only particles candidates[0 .. candidateCount), which must be distinct, or all of them when null.
+    // Particles up to reach behind the surface are pushed out to thickness in front of it.
+    static void resolveMeshCollision(
+        std::vector<Particle>& particles,
+        const GLuint* candidates, int candidateCount,
+        const Object& object,
+        float thickness, float reach,
+        float StaticFriction, float KineticFriction
+    );
+    // Brute force, no contact cache: every vertex of triangleIndices inside the shell is projected out
     static void resolveCollisionWithOutBVH(
         std::vector<Particle>& particles,
         const std::vector<GLuint>& triangleIndices,
         const Object& object,
-        float deltaTime,
-        std::vector<GLuint>& collidingIndices, // Pass by reference);
         float StaticFriction, float KineticFriction
     );
+    // Continuous test: where the segment from -> to first enters the object's collision shell (grown by
+    // thickness), as a fraction t of the way. False if from is already inside or the segment misses. Meshes
+    // are entered at their surface.
+    static bool sweepShell(const Object& object, const glm::vec3& from, const glm::vec3& to, float thickness, float& t);
+    // Pushes the particle out along contact.normal by contact.depth, with Coulomb friction (also used by the
+    // mesh colliders, which have no contact cache)
+    static void resolveContact(Particle& particle, Contact& contact, float Fs, float Fk);
+      // Candidate triangles near the object, through the 4-wide tree (appended to potentialTriangles)
       static void traverseBVH(
-          BVHNode* node,
+          const BVH& bvh,
           const Object& object,
           std::vector<GLuint>& potentialTriangles);
     // static void initializeBVH(const std::vector<Particle>& particles, const std::vector<GLuint>& triangleIndices);
@@ -46,11 +83,13 @@ public:
     //     const glm::vec3& normal, const glm::vec3& intersectionPoint);
 
 private:
-    static void resolveParticleCollision(
-        Particle& particle,
-        const glm::vec3& normal,
-        float penetrationDepth,
-        float deltaTime, float Fs, float Fk);
+    static std::vector<Contact> updatedContacts;
+
+    // How far p is inside the collision shell (the object grown by thickness) through one feature
+    static float featureDepth(const Object& object, float thickness, const glm::vec3& p, uint32_t feature, glm::vec3& normal);
+    // Shallowest feature, the one the particle leaves through. Negative once p is outside the shell
+    static float shellDepth(const Object& object, float thickness, const glm::vec3& p, uint32_t& feature, glm::vec3& normal);
+
 
     // static void traverseBVHForCollisions(
     //        BVHNode* node,
@@ -4,8 +4,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
+#include <memory>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include "BVH.h"
 
-enum class ObjectType { Cube, Sphere };
+enum class ObjectType { Cube, Sphere, Mesh };
 
 class Object {
 private:
@@ -15,10 +22,16 @@ private:
     float halfLength; // For object dimensions
     GLuint VAO, VBO, EBO;
     glm::vec3 color;
-    
+    std::unique_ptr<BVH> meshBVH; // Mesh colliders: SAH tree over the triangles, built once in SetupMesh
+    // Angle-weighted pseudonormals of the mesh (Baerentzen and Aanaes): per triangle, per vertex and per
+    // triangle edge, (0, 1), (1, 2), (2, 0). Whatever feature a closest point lies on, the dot product with
+    // its pseudonormal tells inside from outside; a face normal alone gets it wrong next to sharp edges.
+    std::vector<glm::vec3> meshFaceNormals, meshVertexNormals, meshEdgeNormals;
+    glm::vec3 boundsMin, boundsMax;
+    glm::mat4 modelMatrix = glm::mat4(1.0f); // Pose of an animated collider; the geometry stays in rest pose
 
 public:
-    Object() : VAO(0), VBO(0), EBO(0), color(glm::vec3(1.0f, 0.0f, 1.0f)), objectType(ObjectType::Cube) {}
+    Object() : VAO(0), VBO(0), EBO(0), color(glm::vec3(1.0f, 0.0f, 1.0f)), boundsMin(0.0f), boundsMax(0.0f), objectType(ObjectType::Cube) {}
     ObjectType objectType; // To differentiate between object and sphere
 
     ~Object() {
@@ -40,6 +53,9 @@ public:
                    (cubeMin.y <= aabbMax.y && cubeMax.y >= aabbMin.y) &&
                    (cubeMin.z <= aabbMax.z && cubeMax.z >= aabbMin.z);
         }
+        else if (isMesh()) {
+            return glm::all(glm::lessThanEqual(boundsMin, aabbMax)) && glm::all(glm::greaterThanEqual(boundsMax, aabbMin));
+        }
         else if (isSphere()) {
             // Sphere vs AABB intersection check
             glm::vec3 sphereCenter = getCenter();
@@ -219,8 +235,59 @@ public:
     }
 
 
+    // Collider from any triangle mesh, e.g. Model::getCollisionMesh. Triangles should wind counter-clockwise
+    // seen from outside: the collision treats the back of a triangle as inside.
+    void SetupMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& triangleIndices) {
+        objectType = ObjectType::Mesh;
+        vertices.clear();
+        indices.assign(triangleIndices.begin(), triangleIndices.end());
+
+        boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+        for (const glm::vec3& p : positions) {
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+        }
+        center = 0.5f * (boundsMin + boundsMax);
+        halfLength = 0.5f * glm::length(boundsMax - boundsMin); // Bounding sphere radius
+
+        meshBVH.reset(new BVH(positions, triangleIndices, BVHBuilder::SAH));
+        buildPseudonormals(positions, triangleIndices);
+
+        // The vertex pseudonormals shade too
+        vertices.reserve(positions.size() * 6);
+        for (size_t v = 0; v < positions.size(); ++v) {
+            const glm::vec3& n = meshVertexNormals[v];
+            vertices.insert(vertices.end(), { positions[v].x, positions[v].y, positions[v].z, n.x, n.y, n.z });
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        // Position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // Normal attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(0);
+    }
+
+    void setModelMatrix(const glm::mat4& matrix) { modelMatrix = matrix; }
+
     void render(GLuint shaderProgram, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPos, const glm::vec3& viewPos, const glm::vec3& color) {
-        glm::mat4 model = glm::mat4(1.0f);
+        glm::mat4 model = modelMatrix;
 
         glUseProgram(shaderProgram);
         glUniform1i(glGetUniformLocation(shaderProgram, "useTexture"), 0);
@@ -255,6 +322,16 @@ public:
                 point.y >= center.y - halfLength && point.y <= center.y + halfLength &&
                 point.z >= center.z - halfLength && point.z <= center.z + halfLength);
         }
+        else if (objectType == ObjectType::Mesh) {
+            // Inside the bounds and behind the nearest triangle
+            if (!glm::all(glm::lessThanEqual(boundsMin, point)) || !glm::all(glm::lessThanEqual(point, boundsMax)))
+                return false;
+            glm::vec3 closest;
+            uint32_t triangle;
+            if (!meshBVH->closestPoint(point, std::numeric_limits<float>::max(), closest, triangle))
+                return false;
+            return glm::dot(point - closest, meshPseudonormal(triangle, closest)) < 0.0f;
+        }
         else {
             // For a sphere, we check if the point is within the radius
             float distanceSquared = glm::dot(point - center, point - center);
@@ -275,6 +352,70 @@ public:
     }
 
 
+    bool isMesh() const {
+        return objectType == ObjectType::Mesh;
+    }
+
+    const BVH* getMeshBVH() const { return meshBVH.get(); }
+    glm::vec3 getBoundsMin() const { return boundsMin; }
+    glm::vec3 getBoundsMax() const { return boundsMax; }
+
+    // Outward unit normal of a mesh triangle (index into the triangle list given to SetupMesh)
+    glm::vec3 meshNormal(uint32_t triangle) const { return meshFaceNormals[triangle]; }
+
+    // Pseudonormal of the feature of the triangle that point (on the triangle, e.g. from BVH::closestPoint)
+    // lies on: a corner, an edge or the face. Points on a shared edge or corner get the same normal through
+    // any of the triangles around it.
+    glm::vec3 meshPseudonormal(uint32_t triangle, const glm::vec3& point) const {
+        const GLuint* tri = &indices[3 * triangle];
+        const glm::vec3 a = meshBVH->vertex(tri[0]);
+        const glm::vec3 ab = meshBVH->vertex(tri[1]) - a, ac = meshBVH->vertex(tri[2]) - a, ap = point - a;
+        const float d00 = glm::dot(ab, ab), d01 = glm::dot(ab, ac), d11 = glm::dot(ac, ac);
+        const float d20 = glm::dot(ap, ab), d21 = glm::dot(ap, ac);
+        const float denominator = d00 * d11 - d01 * d01;
+        const float epsilon = 1e-4f;
+        if (denominator <= 0.0f) {
+            // Degenerate (a sliver, or a fan at a sphere's pole): it has no face, the point is on one of its
+            // edges or corners, which the triangles around it share
+            int edge = 0;
+            float along = 0.0f, nearest2 = std::numeric_limits<float>::max();
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec3 start = meshBVH->vertex(tri[k]), e = meshBVH->vertex(tri[(k + 1) % 3]) - start;
+                const float length2 = glm::dot(e, e);
+                const float t = length2 > 0.0f ? std::min(std::max(glm::dot(point - start, e) / length2, 0.0f), 1.0f) : 0.0f;
+                const glm::vec3 offset = start + e * t - point;
+                if (glm::dot(offset, offset) < nearest2) {
+                    nearest2 = glm::dot(offset, offset);
+                    edge = k;
+                    along = length2 > 0.0f ? t : 0.0f;
+                }
+            }
+            if (along < epsilon)
+                return meshVertexNormals[tri[edge]];
+            if (along > 1.0f - epsilon)
+                return meshVertexNormals[tri[(edge + 1) % 3]];
+            return meshEdgeNormals[3 * triangle + edge];
+        }
+        // Barycentric coordinates of the point, u for corner 0, v for 1, w for 2
+        const float v = (d11 * d20 - d01 * d21) / denominator;
+        const float w = (d00 * d21 - d01 * d20) / denominator;
+        const float u = 1.0f - v - w;
+        const bool onU = u < epsilon, onV = v < epsilon, onW = w < epsilon; // On the edge opposite that corner
+        if (onV && onW)
+            return meshVertexNormals[tri[0]];
+        if (onU && onW)
+            return meshVertexNormals[tri[1]];
+        if (onU && onV)
+            return meshVertexNormals[tri[2]];
+        if (onW)
+            return meshEdgeNormals[3 * triangle];
+        if (onU)
+            return meshEdgeNormals[3 * triangle + 1];
+        if (onV)
+            return meshEdgeNormals[3 * triangle + 2];
+        return meshFaceNormals[triangle];
+    }
+
     glm::vec3 getCenter() const {
         return center;
     }
@@ -286,4 +427,63 @@ public:
     void setColor(const glm::vec3& newColor) {
         color = newColor;
     }
+
+private:
+    void buildPseudonormals(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& triangleIndices) {
+        const size_t triangleCount = triangleIndices.size() / 3;
+
+        // Vertices at the same position are one vertex here: a loaded model repeats its vertices along UV
+        // seams, and the normals must not see the seam as an open edge
+        std::vector<GLuint> order(positions.size()), weld(positions.size());
+        std::iota(order.begin(), order.end(), 0u);
+        auto before = [&](GLuint a, GLuint b) {
+            const glm::vec3& p = positions[a];
+            const glm::vec3& q = positions[b];
+            return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+        };
+        std::sort(order.begin(), order.end(), before);
+        for (size_t i = 0; i < order.size(); ++i)
+            weld[order[i]] = i > 0 && positions[order[i]] == positions[order[i - 1]] ? weld[order[i - 1]] : order[i];
+
+        meshFaceNormals.assign(triangleCount, glm::vec3(0.0f, 1.0f, 0.0f));
+        std::vector<glm::vec3> vertexSum(positions.size(), glm::vec3(0.0f));
+        std::unordered_map<uint64_t, glm::vec3> edgeSum;
+        auto edgeKey = [&](GLuint a, GLuint b) {
+            a = weld[a];
+            b = weld[b];
+            return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+        };
+        for (size_t t = 0; t < triangleCount; ++t) {
+            const GLuint* tri = &triangleIndices[3 * t];
+            glm::vec3 n = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            float length = glm::length(n);
+            if (length <= 0.0f)
+                continue; // Degenerate, adds nothing to its neighbours
+            n /= length;
+            meshFaceNormals[t] = n;
+            for (int k = 0; k < 3; ++k) {
+                // Each corner adds the face normal times the angle the triangle spans there
+                glm::vec3 e1 = positions[tri[(k + 1) % 3]] - positions[tri[k]];
+                glm::vec3 e2 = positions[tri[(k + 2) % 3]] - positions[tri[k]];
+                float l1 = glm::length(e1), l2 = glm::length(e2);
+                if (l1 > 0.0f && l2 > 0.0f)
+                    vertexSum[weld[tri[k]]] += n * std::acos(std::min(std::max(glm::dot(e1, e2) / (l1 * l2), -1.0f), 1.0f));
+                edgeSum[edgeKey(tri[k], tri[(k + 1) % 3])] += n;
+            }
+        }
+
+        auto unit = [](const glm::vec3& n, const glm::vec3& fallback) {
+            float length = glm::length(n);
+            return length > 1e-12f ? n / length : fallback;
+        };
+        meshVertexNormals.resize(positions.size());
+        for (size_t v = 0; v < positions.size(); ++v)
+            meshVertexNormals[v] = unit(vertexSum[weld[v]], glm::vec3(0.0f, 1.0f, 0.0f));
+        meshEdgeNormals.resize(3 * triangleCount);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            const GLuint* tri = &triangleIndices[3 * t];
+            for (int k = 0; k < 3; ++k)
+                meshEdgeNormals[3 * t + k] = unit(edgeSum[edgeKey(tri[k], tri[(k + 1) % 3])], meshFaceNormals[t]);
+        }
+    }
 };
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Helpers for OpenMP loops whose results must not depend on the thread count.
+// Work is cut into fixed-size blocks (never "one chunk per thread"), and partial
+// results are always combined in block order.
+class Parallel {
+public:
+    static constexpr int BlockSize = 256;
+
+    // Threads the loops run on, 1 without OpenMP. The results are the same for any count.
+    static int threadCount() {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+    static void setThreadCount(int count) {
+#ifdef _OPENMP
+        omp_set_num_threads(count);
+#else
+        (void)count;
+#endif
+    }
+
+    static int blockCount(int n, int blockSize = BlockSize) {
+        return (n + blockSize - 1) / blockSize;
+    }
+
+    // Calls fn(begin, end) once for every block of [0, n)
+    template <typename Fn>
+    static void forBlocks(int n, Fn fn, int blockSize = BlockSize) {
+        const int blocks = blockCount(n, blockSize);
+#pragma omp parallel for schedule(static)
+        for (int b = 0; b < blocks; ++b) {
+            int begin = b * blockSize;
+            int end = std::min(n, begin + blockSize);
+            fn(begin, end);
+        }
+    }
+
+    // Calls fn(i) for every i in [0, n)
+    template <typename Fn>
+    static void forEach(int n, Fn fn, int blockSize = BlockSize) {
+        forBlocks(n, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i)
+                fn(i);
+        }, blockSize);
+    }
+
+    // Ordered reduction: blockFn(begin, end) produces one partial result per block,
+    // then the partials are folded left to right with combine(acc, partial).
+    template <typename T, typename BlockFn, typename Combine>
+    static T reduce(int n, T init, BlockFn blockFn, Combine combine, int blockSize = BlockSize) {
+        const int blocks = blockCount(n, blockSize);
+        std::vector<T> partials(blocks, init);
+#pragma omp parallel for schedule(static)
+        for (int b = 0; b < blocks; ++b) {
+            int begin = b * blockSize;
+            int end = std::min(n, begin + blockSize);
+            partials[b] = blockFn(begin, end);
+        }
+
+        T result = init;
+        for (int b = 0; b < blocks; ++b)
+            result = combine(result, partials[b]);
+        return result;
+    }
+};
@@ -47,6 +47,17 @@ public:
         previousPosition = pos;
     }
 
+    // Moves the particle but keeps its previous position, so the move also changes its velocity
+    void displace(const glm::vec3& delta) {
+        if (!isStatic) {
+            position += delta;
+        }
+    }
+
+    bool isPinned() const {
+        return isStatic;
+    }
+
     glm::vec3 getPosition() const {
         return position;
     }
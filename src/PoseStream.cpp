@@ -0,0 +1,138 @@
+#include "PoseStream.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t boneCount;
+        uint32_t frameCount;
+        float frameRate;
+    };
+    struct BoneRecord {
+        int32_t parent;
+        float offset[3];
+        float length;
+        float radius;
+    };
+    constexpr uint32_t FileVersion = 1;
+    constexpr uint32_t MaxBones = 1024;
+}
+
+bool PoseStream::open(const std::string& path) {
+    file.close();
+    file.clear();
+    frameCount = 0;
+    bones.clear();
+    frames[0].index = frames[1].index = -1;
+
+    file.open(path, std::ios::binary);
+    if (!file)
+        return false;
+    FileHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "POSE", 4) != 0 || header.version != FileVersion ||
+        header.boneCount == 0 || header.boneCount > MaxBones || header.frameCount == 0 || !(header.frameRate > 0.0f))
+        return false;
+
+    std::vector<SkeletonBone> table(header.boneCount);
+    for (uint32_t i = 0; i < header.boneCount; ++i) {
+        BoneRecord record{};
+        file.read(reinterpret_cast<char*>(&record), sizeof(record));
+        if (!file || record.parent >= static_cast<int32_t>(i) || record.parent < -1)
+            return false;
+        table[i].parent = record.parent;
+        table[i].offset = glm::vec3(record.offset[0], record.offset[1], record.offset[2]);
+        table[i].length = record.length;
+        table[i].radius = record.radius;
+    }
+
+    bones.swap(table);
+    framesStart = file.tellg();
+    frameRate = header.frameRate;
+    frameCount = static_cast<int>(header.frameCount);
+    return true;
+}
+
+const PoseStream::Frame* PoseStream::fetch(int index, const Frame* keep) {
+    for (const Frame& frame : frames) {
+        if (frame.index == index)
+            return &frame;
+    }
+    // Replaces the earlier of the two unless that one is still in use
+    Frame& frame = keep == &frames[0] ? frames[1] : keep == &frames[1] ? frames[0] :
+        frames[0].index < frames[1].index ? frames[0] : frames[1];
+    const size_t floats = 3 + 4 * bones.size();
+    record.resize(floats);
+    file.clear();
+    file.seekg(framesStart + static_cast<std::streamoff>(index) * static_cast<std::streamoff>(floats * sizeof(float)));
+    file.read(reinterpret_cast<char*>(record.data()), floats * sizeof(float));
+    if (!file) {
+        frame.index = -1;
+        return nullptr;
+    }
+
+    frame.index = index;
+    frame.root = glm::vec3(record[0], record[1], record[2]);
+    frame.rotations.resize(bones.size());
+    for (size_t b = 0; b < bones.size(); ++b) {
+        const float* q = &record[3 + 4 * b];
+        frame.rotations[b] = glm::normalize(glm::quat(q[0], q[1], q[2], q[3]));
+    }
+    return &frame;
+}
+
+bool PoseStream::sample(float time, glm::vec3& rootTranslation, std::vector<glm::quat>& rotations) {
+    if (!isOpen())
+        return false;
+    float position = std::fmod(time * frameRate, static_cast<float>(frameCount));
+    if (position < 0.0f)
+        position += frameCount;
+    const int first = std::min(static_cast<int>(position), frameCount - 1);
+    const int second = (first + 1) % frameCount;
+    const float t = position - first;
+
+    const Frame* a = fetch(first, nullptr);
+    const Frame* b = a ? fetch(second, a) : nullptr;
+    if (!a || !b)
+        return false;
+    rootTranslation = glm::mix(a->root, b->root, t);
+    rotations.resize(bones.size());
+    for (size_t i = 0; i < bones.size(); ++i)
+        rotations[i] = glm::slerp(a->rotations[i], b->rotations[i], t);
+    return true;
+}
+
+bool PoseStream::write(const std::string& path, const std::vector<SkeletonBone>& bones, float frameRate,
+    const std::vector<glm::vec3>& rootTranslations, const std::vector<glm::quat>& rotations) {
+    if (bones.empty() || rootTranslations.empty() || rotations.size() != rootTranslations.size() * bones.size())
+        return false;
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    FileHeader header{};
+    std::memcpy(header.magic, "POSE", 4);
+    header.version = FileVersion;
+    header.boneCount = static_cast<uint32_t>(bones.size());
+    header.frameCount = static_cast<uint32_t>(rootTranslations.size());
+    header.frameRate = frameRate;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const SkeletonBone& bone : bones) {
+        BoneRecord record{ bone.parent, { bone.offset.x, bone.offset.y, bone.offset.z }, bone.length, bone.radius };
+        file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    for (size_t f = 0; f < rootTranslations.size(); ++f) {
+        const glm::vec3& root = rootTranslations[f];
+        file.write(reinterpret_cast<const char*>(&root.x), 3 * sizeof(float));
+        for (size_t b = 0; b < bones.size(); ++b) {
+            const glm::quat& q = rotations[f * bones.size() + b];
+            const float wxyz[4] = { q.w, q.x, q.y, q.z };
+            file.write(reinterpret_cast<const char*>(wxyz), sizeof(wxyz));
+        }
+    }
+    return static_cast<bool>(file);
+}
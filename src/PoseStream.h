@@ -0,0 +1,57 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+
+// One bone of a skeleton, with the capsule that stands in for the body around it
+struct SkeletonBone {
+    int parent = -1;                   // -1 for the root; a parent always comes before its children
+    glm::vec3 offset = glm::vec3(0.0f); // Joint in the parent's frame (the root's in world space)
+    float length = 0.0f;               // The capsule runs from the joint along the bone's local y
+    float radius = 0.0f;
+};
+
+// Skeleton animation read from a file as it plays: a bone table, then fixed-size frames (root translation,
+// one local rotation per bone) at a fixed rate. Frames are fetched by seeking, two at a time, so a long
+// recording costs no memory and a jump in time costs two reads.
+//
+// File layout (little endian): header { "POSE", version, boneCount, frameCount, frameRate }, boneCount
+// records { int32 parent, float offset[3], float length, float radius }, then frameCount records
+// { float root[3], float rotation[boneCount][4] (w, x, y, z) }.
+class PoseStream {
+public:
+    bool open(const std::string& path);
+    bool isOpen() const { return frameCount > 0; }
+
+    const std::vector<SkeletonBone>& getBones() const { return bones; }
+    int getFrameCount() const { return frameCount; }
+    float getFrameRate() const { return frameRate; }
+    float getDuration() const { return frameCount / frameRate; }
+
+    // Pose at time, looping: linear between the two frames around it (rotations by slerp). False if a frame
+    // could not be read.
+    bool sample(float time, glm::vec3& rootTranslation, std::vector<glm::quat>& rotations);
+
+    // rotations holds frameCount * bones.size() local rotations, frame after frame
+    static bool write(const std::string& path, const std::vector<SkeletonBone>& bones, float frameRate,
+        const std::vector<glm::vec3>& rootTranslations, const std::vector<glm::quat>& rotations);
+
+private:
+    struct Frame {
+        int index = -1;
+        glm::vec3 root = glm::vec3(0.0f);
+        std::vector<glm::quat> rotations;
+    };
+
+    std::ifstream file;
+    std::streamoff framesStart = 0;
+    std::vector<SkeletonBone> bones;
+    int frameCount = 0;
+    float frameRate = 30.0f;
+    Frame frames[2]; // The last two frames read
+    std::vector<float> record;
+
+    const Frame* fetch(int index, const Frame* keep);
+};
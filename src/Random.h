@@ -0,0 +1,56 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <cstdint>
+
+// Counter-based random numbers. Every value is a pure function of (seed, counter),
+// so results don't depend on which thread asks for them or in which order.
+struct CounterRNG {
+    uint64_t seed;
+
+    explicit CounterRNG(uint64_t _seed = 0x9E3779B97F4A7C15ull) : seed(_seed) {}
+
+    // SplitMix64 finalizer applied to the seeded counter
+    static uint64_t mix(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // Independent generator for a separate purpose (wind direction, wind noise, ...)
+    CounterRNG derive(uint64_t purpose) const {
+        return CounterRNG(mix(seed ^ mix(purpose + 0x632BE59BD9B4E019ull)));
+    }
+
+    uint64_t next(uint64_t counter) const {
+        return mix(seed ^ mix(counter));
+    }
+
+    // Two independent streams, e.g. (step, particle index)
+    uint64_t next(uint64_t counter, uint64_t stream) const {
+        return mix(next(counter) ^ mix(stream + 0xD1B54A32D192ED03ull));
+    }
+
+    // Uniform float in [0, 1) from the top 24 bits
+    static float toUnitFloat(uint64_t bits) {
+        return static_cast<float>(bits >> 40) * (1.0f / 16777216.0f);
+    }
+
+    float uniform(uint64_t counter, uint64_t stream = 0) const {
+        return toUnitFloat(next(counter, stream));
+    }
+
+    // Uniform float in [-1, 1)
+    float signedUniform(uint64_t counter, uint64_t stream = 0) const {
+        return uniform(counter, stream) * 2.0f - 1.0f;
+    }
+
+    // Uniformly distributed direction on the unit sphere
+    glm::vec3 unitVector(uint64_t counter) const {
+        float azimuthalAngle = uniform(counter, 0) * 2.0f * glm::pi<float>();
+        float z = signedUniform(counter, 1);
+        float radius = glm::sqrt(glm::max(0.0f, 1.0f - z * z));
+        return glm::vec3(radius * glm::cos(azimuthalAngle), radius * glm::sin(azimuthalAngle), z);
+    }
+};
@@ -0,0 +1,271 @@
+#include "SignedDistanceField.h"
+#include "BVH.h"
+#include "NewCollision.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        int32_t resolution;
+        int32_t nx, ny, nz;
+        float origin[3];
+        float cellSize;
+    };
+    constexpr uint32_t FileVersion = 1;
+}
+
+uint64_t SignedDistanceField::hashMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution) {
+    // FNV-1a over the raw bytes
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    mix(positions.data(), positions.size() * sizeof(glm::vec3));
+    mix(indices.data(), indices.size() * sizeof(GLuint));
+    mix(&resolution, sizeof(resolution));
+    return hash;
+}
+
+void SignedDistanceField::rowCrossings(const BVH& bvh, const std::vector<glm::vec3>& positions, float y, float z, float xMin, float xMax, std::vector<float>& crossings) {
+    std::vector<GLuint> candidates;
+    bvh.queryBox(glm::vec3(xMin, y, z), glm::vec3(xMax, y, z), candidates);
+    crossings.clear();
+    for (size_t i = 0; i < candidates.size(); i += 3) {
+        const glm::vec3& a = positions[candidates[i]];
+        const glm::vec3& b = positions[candidates[i + 1]];
+        const glm::vec3& c = positions[candidates[i + 2]];
+        // Edge functions in the yz plane, each one the weight of the opposite vertex
+        float wc = (b.y - a.y) * (z - a.z) - (b.z - a.z) * (y - a.y);
+        float wa = (c.y - b.y) * (z - b.z) - (c.z - b.z) * (y - b.y);
+        float wb = (a.y - c.y) * (z - c.z) - (a.z - c.z) * (y - c.y);
+        bool inside = (wa >= 0.0f && wb >= 0.0f && wc >= 0.0f) || (wa <= 0.0f && wb <= 0.0f && wc <= 0.0f);
+        float area = wa + wb + wc;
+        if (inside && area != 0.0f)
+            crossings.push_back((wa * a.x + wb * b.x + wc * c.x) / area);
+    }
+    std::sort(crossings.begin(), crossings.end());
+}
+
+void SignedDistanceField::build(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution, int padding) {
+    distances.clear();
+    if (positions.empty() || indices.size() < 3 || resolution < 1)
+        return;
+
+    glm::vec3 meshMin(std::numeric_limits<float>::max());
+    glm::vec3 meshMax(-std::numeric_limits<float>::max());
+    for (const glm::vec3& p : positions) {
+        meshMin = glm::min(meshMin, p);
+        meshMax = glm::max(meshMax, p);
+    }
+    glm::vec3 extent = meshMax - meshMin;
+    float longest = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+    cellSize = longest / resolution;
+    invCellSize = 1.0f / cellSize;
+    origin = meshMin - glm::vec3(padding * cellSize);
+    nx = static_cast<int>(std::ceil(extent.x * invCellSize)) + 2 * padding + 1;
+    ny = static_cast<int>(std::ceil(extent.y * invCellSize)) + 2 * padding + 1;
+    nz = static_cast<int>(std::ceil(extent.z * invCellSize)) + 2 * padding + 1;
+    nx = std::max(nx, 2); ny = std::max(ny, 2); nz = std::max(nz, 2); // A flat mesh still needs two samples to interpolate
+    distances.assign(static_cast<size_t>(nx) * ny * nz, 0.0f);
+    sourceHash = hashMesh(positions, indices, resolution);
+    sourceResolution = resolution;
+
+    BVH bvh(positions, indices, BVHBuilder::SAH);
+    const float farDistance = glm::length(glm::vec3(nx, ny, nz) * cellSize) + longest;
+
+    // One row along x per task: the sign comes from counting where the row's line crosses the mesh, and the
+    // distances along the row bound each other (they differ by at most one cell), which keeps every
+    // nearest-point search short
+    Parallel::forEach(ny * nz, [&](int row) {
+        const int y = row % ny, z = row / ny;
+        const float rowY = origin.y + y * cellSize;
+        const float rowZ = origin.z + z * cellSize;
+
+        // The line is nudged off the samples by a fraction of a cell, so it doesn't run exactly through
+        // the edges and vertices of meshes built on round coordinates (those crossings would count twice)
+        const float lineY = rowY + 1.37e-3f * cellSize;
+        const float lineZ = rowZ + 2.71e-3f * cellSize;
+        std::vector<float> crossings;
+        rowCrossings(bvh, positions, lineY, lineZ, origin.x - cellSize, origin.x + nx * cellSize, crossings);
+
+        size_t nextCrossing = 0;
+        bool insideMesh = false;
+        float bound = farDistance;
+        for (int x = 0; x < nx; ++x) {
+            glm::vec3 p(origin.x + x * cellSize, rowY, rowZ);
+            while (nextCrossing < crossings.size() && crossings[nextCrossing] < p.x) {
+                insideMesh = !insideMesh;
+                ++nextCrossing;
+            }
+            glm::vec3 closest;
+            uint32_t triangle;
+            float distance = bvh.closestPoint(p, bound, closest, triangle) ? glm::length(closest - p) : bound;
+            bound = distance + cellSize * 1.001f;
+            distances[sampleIndex(x, y, z)] = insideMesh ? -distance : distance;
+        }
+    }, 1);
+}
+
+bool SignedDistanceField::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    FileHeader header{};
+    std::memcpy(header.magic, "SDF1", 4);
+    header.version = FileVersion;
+    header.sourceHash = sourceHash;
+    header.resolution = sourceResolution;
+    header.nx = nx; header.ny = ny; header.nz = nz;
+    header.origin[0] = origin.x; header.origin[1] = origin.y; header.origin[2] = origin.z;
+    header.cellSize = cellSize;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(distances.data()), distances.size() * sizeof(float));
+    return static_cast<bool>(file);
+}
+
+bool SignedDistanceField::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    FileHeader header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, "SDF1", 4) != 0 || header.version != FileVersion ||
+        header.nx < 2 || header.ny < 2 || header.nz < 2 || header.cellSize <= 0.0f)
+        return false;
+
+    std::vector<float> samples(static_cast<size_t>(header.nx) * header.ny * header.nz);
+    file.read(reinterpret_cast<char*>(samples.data()), samples.size() * sizeof(float));
+    if (!file)
+        return false;
+
+    distances.swap(samples);
+    nx = header.nx; ny = header.ny; nz = header.nz;
+    origin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+    cellSize = header.cellSize;
+    invCellSize = 1.0f / cellSize;
+    sourceHash = header.sourceHash;
+    sourceResolution = header.resolution;
+    return true;
+}
+
+void SignedDistanceField::loadOrBuild(const std::string& cachePath, const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution) {
+    if (load(cachePath) && sourceHash == hashMesh(positions, indices, resolution) && sourceResolution == resolution)
+        return;
+
+    std::cout << "Building signed distance field (" << resolution << " cells) for " << cachePath << std::endl;
+    build(positions, indices, resolution);
+    if (!save(cachePath))
+        std::cout << "Could not write the distance field cache " << cachePath << std::endl;
+}
+
+// Trilinear interpolation at grid coordinates, clamped into the grid, with the exact gradient of the
+// interpolant (per world unit)
+inline void SignedDistanceField::interpolate(float x, float y, float z, float& distance, float& gx, float& gy, float& gz) const {
+    x = std::min(std::max(x, 0.0f), nx - 1.001f);
+    y = std::min(std::max(y, 0.0f), ny - 1.001f);
+    z = std::min(std::max(z, 0.0f), nz - 1.001f);
+    int i = static_cast<int>(x), j = static_cast<int>(y), k = static_cast<int>(z);
+    float fx = x - i, fy = y - j, fz = z - k;
+
+    const int strideY = nx, strideZ = nx * ny;
+    const float* c = &distances[sampleIndex(i, j, k)];
+    float c000 = c[0], c100 = c[1];
+    float c010 = c[strideY], c110 = c[strideY + 1];
+    float c001 = c[strideZ], c101 = c[strideZ + 1];
+    float c011 = c[strideZ + strideY], c111 = c[strideZ + strideY + 1];
+
+    float c00 = c000 + (c100 - c000) * fx;
+    float c10 = c010 + (c110 - c010) * fx;
+    float c01 = c001 + (c101 - c001) * fx;
+    float c11 = c011 + (c111 - c011) * fx;
+    float c0 = c00 + (c10 - c00) * fy;
+    float c1 = c01 + (c11 - c01) * fy;
+    distance = c0 + (c1 - c0) * fz;
+
+    float dx0 = (c100 - c000) + ((c110 - c010) - (c100 - c000)) * fy;
+    float dx1 = (c101 - c001) + ((c111 - c011) - (c101 - c001)) * fy;
+    gx = (dx0 + (dx1 - dx0) * fz) * invCellSize;
+    gy = ((c10 - c00) + ((c11 - c01) - (c10 - c00)) * fz) * invCellSize;
+    gz = (c1 - c0) * invCellSize;
+}
+
+float SignedDistanceField::sample(const glm::vec3& position, glm::vec3& gradient) const {
+    float distance;
+    sampleBatch(&position.x, &position.y, &position.z, &distance, &gradient.x, &gradient.y, &gradient.z, 1);
+    return distance;
+}
+
+void SignedDistanceField::sampleBatch(const float* px, const float* py, const float* pz,
+    float* distance, float* gx, float* gy, float* gz, int count) const {
+    if (!isReady()) {
+        for (int i = 0; i < count; ++i) {
+            distance[i] = std::numeric_limits<float>::max();
+            gx[i] = gy[i] = gz[i] = 0.0f;
+        }
+        return;
+    }
+    const glm::vec3 gridMax = origin + glm::vec3(nx - 1, ny - 1, nz - 1) * cellSize;
+#pragma omp simd
+    for (int i = 0; i < count; ++i) {
+        // How far outside the grid box the point is. The grid is padded around the mesh, so these points
+        // are never in contact; the offset just keeps the distance growing past the box.
+        float ox = px[i] - std::min(std::max(px[i], origin.x), gridMax.x);
+        float oy = py[i] - std::min(std::max(py[i], origin.y), gridMax.y);
+        float oz = pz[i] - std::min(std::max(pz[i], origin.z), gridMax.z);
+        interpolate((px[i] - origin.x) * invCellSize, (py[i] - origin.y) * invCellSize, (pz[i] - origin.z) * invCellSize,
+            distance[i], gx[i], gy[i], gz[i]);
+        distance[i] += std::sqrt(ox * ox + oy * oy + oz * oz);
+    }
+}
+
+void SignedDistanceField::resolveCollision(std::vector<Particle>& particles, float thickness, float staticFriction, float kineticFriction) const {
+    resolveCollision(particles, nullptr, static_cast<int>(particles.size()), thickness, staticFriction, kineticFriction);
+}
+
+void SignedDistanceField::resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const {
+    if (!isReady())
+        return;
+    Parallel::forBlocks(candidateCount, [&](int begin, int end) {
+        float px[Parallel::BlockSize], py[Parallel::BlockSize], pz[Parallel::BlockSize];
+        float distance[Parallel::BlockSize], gx[Parallel::BlockSize], gy[Parallel::BlockSize], gz[Parallel::BlockSize];
+        const int count = end - begin;
+        for (int i = 0; i < count; ++i) {
+            glm::vec3 p = particles[candidates ? candidates[begin + i] : begin + i].getPosition();
+            px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+        }
+        sampleBatch(px, py, pz, distance, gx, gy, gz, count);
+        pushOut(particles, candidates, begin, count, distance, gx, gy, gz, thickness, staticFriction, kineticFriction);
+    });
+}
+
+void SignedDistanceField::pushOut(std::vector<Particle>& particles, const GLuint* candidates, int begin, int count, const float* distance,
+    const float* gx, const float* gy, const float* gz, float thickness, float staticFriction, float kineticFriction) {
+    for (int i = 0; i < count; ++i) {
+        const uint32_t index = candidates ? candidates[begin + i] : static_cast<uint32_t>(begin + i);
+        Particle& particle = particles[index];
+        if (distance[i] >= thickness || particle.isPinned())
+            continue;
+        glm::vec3 gradient(gx[i], gy[i], gz[i]);
+        float length = glm::length(gradient);
+        if (length < 1e-6f)
+            continue;
+        Contact contact{};
+        contact.particle = index;
+        contact.normal = gradient / length;
+        contact.depth = thickness - distance[i];
+        contact.age = 1; // Resting response: no bounce, and no friction state kept between steps
+        NewCollision::resolveContact(particle, contact, staticFriction, kineticFriction);
+    }
+}
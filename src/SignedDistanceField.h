@@ -0,0 +1,70 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Particle.h"
+
+class BVH;
+
+// Collider for an arbitrary (closed) triangle mesh: signed distances sampled on a regular grid, negative
+// inside. Building it is slow but done once per mesh and resolution, and the result is cached on disk.
+// A query is one trilinear lookup whatever the mesh, and the gradient of the same interpolation gives
+// the normal.
+class SignedDistanceField {
+public:
+    // resolution: cells along the longest side of the mesh bounds, padding: extra cells on every side
+    void build(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution, int padding = 3);
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+    // Uses the cache file if it was built from this exact mesh at this resolution, otherwise builds and
+    // rewrites it
+    void loadOrBuild(const std::string& cachePath, const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution);
+
+    // Signed distance and its gradient at a world position. Outside the grid the distance to the grid box
+    // is added, which never underestimates how far the mesh is.
+    float sample(const glm::vec3& position, glm::vec3& gradient) const;
+    void sampleBatch(const float* px, const float* py, const float* pz,
+        float* distance, float* gx, float* gy, float* gz, int count) const;
+
+    // Pushes particles closer than thickness to the surface back out along the gradient
+    void resolveCollision(std::vector<Particle>& particles, float thickness, float staticFriction, float kineticFriction) const;
+    // Only particles candidates[0 .. candidateCount), which must be distinct
+    void resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const;
+
+    // Sorted x coordinates where the line through (y, z) parallel to x crosses the mesh, between xMin and
+    // xMax. An odd number of crossings before a point means it is inside.
+    static void rowCrossings(const BVH& bvh, const std::vector<glm::vec3>& positions, float y, float z, float xMin, float xMax, std::vector<float>& crossings);
+    // Contact response for one block of sampled particles: particles[candidates[begin + i]] for i < count, or
+    // particles[begin + i] when candidates is null
+    static void pushOut(std::vector<Particle>& particles, const GLuint* candidates, int begin, int count, const float* distance,
+        const float* gx, const float* gy, const float* gz, float thickness, float staticFriction, float kineticFriction);
+    static uint64_t hashMesh(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution);
+
+    bool isReady() const { return !distances.empty(); }
+    // Box of the samples; the field only pushes particles within thickness of it
+    glm::vec3 getBoundsMin() const { return origin; }
+    glm::vec3 getBoundsMax() const { return origin + glm::vec3(nx - 1, ny - 1, nz - 1) * cellSize; }
+    // The same grown by reach, and its middle, as the other colliders have them
+    glm::vec3 getBoundsMin(float reach) const { return getBoundsMin() - glm::vec3(reach); }
+    glm::vec3 getBoundsMax(float reach) const { return getBoundsMax() + glm::vec3(reach); }
+    glm::vec3 getCenter() const { return 0.5f * (getBoundsMin() + getBoundsMax()); }
+    glm::ivec3 getDimensions() const { return glm::ivec3(nx, ny, nz); }
+    float getCellSize() const { return cellSize; }
+
+private:
+    int nx = 0, ny = 0, nz = 0; // Sample counts
+    glm::vec3 origin = glm::vec3(0.0f);
+    float cellSize = 1.0f;
+    float invCellSize = 1.0f;
+    std::vector<float> distances; // x fastest
+
+    // Identifies the mesh and settings the samples came from, checked against the cache file
+    uint64_t sourceHash = 0;
+    int sourceResolution = 0;
+
+    int sampleIndex(int x, int y, int z) const { return (z * ny + y) * nx + x; }
+    void interpolate(float x, float y, float z, float& distance, float& gx, float& gy, float& gz) const;
+};
@@ -0,0 +1,368 @@
+#include "SparseDistanceField.h"
+#include "SignedDistanceField.h"
+#include "BVH.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <limits>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    // 64 bytes, so the table that follows it in the file stays aligned when mapped
+    struct SparseHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        int32_t resolution;
+        int32_t bx, by, bz;
+        uint32_t blockCount;
+        float origin[3];
+        float cellSize;
+        float bandWidth;
+        uint32_t reserved[2];
+    };
+    static_assert(sizeof(SparseHeader) == 64, "SparseHeader must stay 64 bytes");
+    constexpr uint32_t SparseVersion = 2;
+
+    size_t alignTo64(size_t offset) { return (offset + 63) & ~static_cast<size_t>(63); }
+
+    uint32_t packDirection(const glm::vec3& direction) {
+        auto snorm8 = [](float v) { return static_cast<uint32_t>(static_cast<uint8_t>(static_cast<int8_t>(std::lround(v * 127.0f)))); };
+        return snorm8(direction.x) | snorm8(direction.y) << 8 | snorm8(direction.z) << 16;
+    }
+    float unpackComponent(uint32_t packed, int shift) {
+        return static_cast<int8_t>(static_cast<uint8_t>(packed >> shift)) * (1.0f / 127.0f);
+    }
+}
+
+void SparseDistanceField::build(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution, int bandCells) {
+    file.close();
+    ownedTable.clear();
+    ownedEscape.clear();
+    ownedBlocks.clear();
+    table = nullptr;
+    escape = nullptr;
+    blocks = nullptr;
+    blockCount = 0;
+    if (positions.empty() || indices.size() < 3 || resolution < 1)
+        return;
+
+    glm::vec3 meshMin(std::numeric_limits<float>::max());
+    glm::vec3 meshMax(-std::numeric_limits<float>::max());
+    for (const glm::vec3& p : positions) {
+        meshMin = glm::min(meshMin, p);
+        meshMax = glm::max(meshMax, p);
+    }
+    glm::vec3 extent = meshMax - meshMin;
+    float longest = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+    cellSize = longest / resolution;
+    invCellSize = 1.0f / cellSize;
+    bandWidth = bandCells * cellSize;
+
+    // The band has to fit inside the grid, so there are bandCells of padding on every side
+    origin = meshMin - glm::vec3(bandCells * cellSize);
+    auto blocksFor = [&](float length) {
+        int cells = static_cast<int>(std::ceil(length * invCellSize)) + 2 * bandCells;
+        return std::max(1, (cells + BlockCells - 1) / BlockCells);
+    };
+    bx = blocksFor(extent.x);
+    by = blocksFor(extent.y);
+    bz = blocksFor(extent.z);
+    nx = bx * BlockCells + 1;
+    ny = by * BlockCells + 1;
+    nz = bz * BlockCells + 1;
+    sourceHash = SignedDistanceField::hashMesh(positions, indices, resolution);
+    sourceResolution = resolution;
+
+    BVH bvh(positions, indices, BVHBuilder::SAH);
+    const int totalBlocks = static_cast<int>(tableSize());
+    const float gridMinX = origin.x - cellSize;
+
+    // A block is stored when the surface comes within the band of any point in it
+    const float blockRadius = std::sqrt(3.0f) * 0.5f * BlockCells * cellSize;
+    std::vector<uint8_t> inBand(totalBlocks);
+    Parallel::forEach(totalBlocks, [&](int b) {
+        int x = b % bx, y = (b / bx) % by, z = b / (bx * by);
+        glm::vec3 center = origin + (glm::vec3(x, y, z) + 0.5f) * (BlockCells * cellSize);
+        glm::vec3 closest;
+        uint32_t triangle;
+        inBand[b] = bvh.closestPoint(center, blockRadius + bandWidth, closest, triangle) ? 1 : 0;
+    }, 16);
+
+    ownedTable.assign(totalBlocks, TileOutside);
+    for (int b = 0; b < totalBlocks; ++b) {
+        if (inBand[b])
+            ownedTable[b] = blockCount++;
+    }
+    ownedBlocks.assign(static_cast<size_t>(blockCount) * BlockValues, bandWidth);
+    const float sampleReach = 2.0f * blockRadius + bandWidth;
+
+    // Samples of the stored blocks, and the sign of every tile. Signs come from the same crossing count as
+    // the dense field, along a line nudged off the samples.
+    Parallel::forEach(totalBlocks, [&](int b) {
+        int x = b % bx, y = (b / bx) % by, z = b / (bx * by);
+        std::vector<float> crossings;
+        if (!inBand[b]) {
+            glm::vec3 center = origin + (glm::vec3(x, y, z) + 0.5f) * (BlockCells * cellSize);
+            SignedDistanceField::rowCrossings(bvh, positions, center.y + 1.37e-3f * cellSize, center.z + 2.71e-3f * cellSize,
+                gridMinX, center.x, crossings);
+            ownedTable[b] = (crossings.size() & 1) ? TileInside : TileOutside;
+            return;
+        }
+
+        float* values = &ownedBlocks[static_cast<size_t>(ownedTable[b]) * BlockValues];
+        const glm::vec3 blockOrigin = origin + glm::vec3(x, y, z) * (BlockCells * cellSize);
+        for (int k = 0; k < BlockSamples; ++k) {
+            for (int j = 0; j < BlockSamples; ++j) {
+                const float rowY = blockOrigin.y + j * cellSize;
+                const float rowZ = blockOrigin.z + k * cellSize;
+                SignedDistanceField::rowCrossings(bvh, positions, rowY + 1.37e-3f * cellSize, rowZ + 2.71e-3f * cellSize,
+                    gridMinX, blockOrigin.x + BlockSamples * cellSize, crossings);
+                size_t nextCrossing = 0;
+                bool insideMesh = false;
+                for (int i = 0; i < BlockSamples; ++i) {
+                    glm::vec3 p(blockOrigin.x + i * cellSize, rowY, rowZ);
+                    while (nextCrossing < crossings.size() && crossings[nextCrossing] < p.x) {
+                        insideMesh = !insideMesh;
+                        ++nextCrossing;
+                    }
+                    // Exact everywhere in the block, not clamped at the band: a clamped corner of a block that
+                    // reaches past the band would read flat, with no gradient to push a particle out along.
+                    // No sample is further from the surface than sampleReach.
+                    glm::vec3 closest;
+                    uint32_t triangle;
+                    float distance = bvh.closestPoint(p, sampleReach, closest, triangle) ? glm::length(closest - p) : sampleReach;
+                    values[(k * BlockSamples + j) * BlockSamples + i] = insideMesh ? -distance : distance;
+                }
+            }
+        }
+    }, 1);
+
+    // Every inside tile gets the direction to the stored block nearest to it. A breadth-first pass from the
+    // stored blocks through the inside tiles hands each tile the source of the neighbour that reached it
+    // first; the band closes the inside off from the outside, so it reaches all of them.
+    std::vector<int> nearest(totalBlocks, -1);
+    std::vector<int> queue;
+    for (int b = 0; b < totalBlocks; ++b) {
+        if (inBand[b]) {
+            nearest[b] = b;
+            queue.push_back(b);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const int b = queue[head];
+        const int x = b % bx, y = (b / bx) % by, z = b / (bx * by);
+        const int neighbours[6][3] = { {x - 1, y, z}, {x + 1, y, z}, {x, y - 1, z}, {x, y + 1, z}, {x, y, z - 1}, {x, y, z + 1} };
+        for (const int* n : neighbours) {
+            if (n[0] < 0 || n[1] < 0 || n[2] < 0 || n[0] >= bx || n[1] >= by || n[2] >= bz)
+                continue;
+            const int neighbour = blockIndex(n[0], n[1], n[2]);
+            if (ownedTable[neighbour] == TileInside && nearest[neighbour] < 0) {
+                nearest[neighbour] = nearest[b];
+                queue.push_back(neighbour);
+            }
+        }
+    }
+    ownedEscape.assign(totalBlocks, 0);
+    auto blockCenter = [&](int b) { return glm::vec3(b % bx, (b / bx) % by, b / (bx * by)) + 0.5f; };
+    const glm::vec3 gridCenter = 0.5f * glm::vec3(bx, by, bz);
+    for (int b = 0; b < totalBlocks; ++b) {
+        if (ownedTable[b] != TileInside)
+            continue;
+        // A tile the pass missed (a hole in the band) falls back to pointing away from the middle of the grid
+        glm::vec3 direction = nearest[b] >= 0 ? blockCenter(nearest[b]) - blockCenter(b) : blockCenter(b) - gridCenter;
+        if (glm::dot(direction, direction) < 1e-12f)
+            direction = glm::vec3(0.0f, 1.0f, 0.0f);
+        ownedEscape[b] = packDirection(glm::normalize(direction));
+    }
+
+    table = ownedTable.data();
+    escape = ownedEscape.data();
+    blocks = ownedBlocks.data();
+}
+
+bool SparseDistanceField::save(const std::string& path) const {
+    if (!isReady())
+        return false;
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    SparseHeader header{};
+    std::memcpy(header.magic, "SDFS", 4);
+    header.version = SparseVersion;
+    header.sourceHash = sourceHash;
+    header.resolution = sourceResolution;
+    header.bx = bx; header.by = by; header.bz = bz;
+    header.blockCount = blockCount;
+    header.origin[0] = origin.x; header.origin[1] = origin.y; header.origin[2] = origin.z;
+    header.cellSize = cellSize;
+    header.bandWidth = bandWidth;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    size_t tableBytes = tableSize() * sizeof(uint32_t);
+    out.write(reinterpret_cast<const char*>(table), tableBytes);
+    out.write(reinterpret_cast<const char*>(escape), tableBytes);
+    static const char zeros[64] = {};
+    out.write(zeros, alignTo64(sizeof(header) + 2 * tableBytes) - (sizeof(header) + 2 * tableBytes));
+    out.write(reinterpret_cast<const char*>(blocks), static_cast<size_t>(blockCount) * BlockValues * sizeof(float));
+    return static_cast<bool>(out);
+}
+
+bool SparseDistanceField::load(const std::string& path) {
+    MappedFile mapped;
+    if (!mapped.open(path) || mapped.size() < sizeof(SparseHeader))
+        return false;
+    SparseHeader header;
+    std::memcpy(&header, mapped.data(), sizeof(header));
+    if (std::memcmp(header.magic, "SDFS", 4) != 0 || header.version != SparseVersion ||
+        header.bx < 1 || header.by < 1 || header.bz < 1 || header.cellSize <= 0.0f)
+        return false;
+
+    // In two steps, so nonsense block counts cannot overflow the size check
+    size_t tableEntries = static_cast<size_t>(header.bx) * header.by;
+    if (tableEntries > mapped.size() / static_cast<size_t>(header.bz))
+        return false;
+    tableEntries *= header.bz;
+    size_t tableBytes = tableEntries * sizeof(uint32_t);
+    size_t blocksOffset = alignTo64(sizeof(header) + 2 * tableBytes);
+    if (mapped.size() < blocksOffset + static_cast<size_t>(header.blockCount) * BlockValues * sizeof(float))
+        return false;
+
+    // sampleBatch indexes the blocks with the table entries unchecked, so a damaged table is rejected here
+    const uint32_t* entries = reinterpret_cast<const uint32_t*>(mapped.data() + sizeof(header));
+    for (size_t b = 0; b < tableEntries; ++b) {
+        if (entries[b] != TileOutside && entries[b] != TileInside && entries[b] >= header.blockCount)
+            return false;
+    }
+
+    // Only now is this field replaced
+    ownedTable.clear();
+    ownedEscape.clear();
+    ownedBlocks.clear();
+    ownedTable.shrink_to_fit();
+    ownedEscape.shrink_to_fit();
+    ownedBlocks.shrink_to_fit();
+    file.swap(mapped); // The old mapping, if any, is released with mapped
+
+    bx = header.bx; by = header.by; bz = header.bz;
+    nx = bx * BlockCells + 1;
+    ny = by * BlockCells + 1;
+    nz = bz * BlockCells + 1;
+    blockCount = header.blockCount;
+    origin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+    cellSize = header.cellSize;
+    invCellSize = 1.0f / cellSize;
+    bandWidth = header.bandWidth;
+    sourceHash = header.sourceHash;
+    sourceResolution = header.resolution;
+    table = reinterpret_cast<const uint32_t*>(file.data() + sizeof(header));
+    escape = reinterpret_cast<const uint32_t*>(file.data() + sizeof(header) + tableBytes);
+    blocks = reinterpret_cast<const float*>(file.data() + blocksOffset);
+    return true;
+}
+
+void SparseDistanceField::loadOrBuild(const std::string& cachePath, const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution) {
+    if (load(cachePath) && sourceHash == SignedDistanceField::hashMesh(positions, indices, resolution) && sourceResolution == resolution)
+        return;
+
+    std::cout << "Building sparse distance field (" << resolution << " cells) for " << cachePath << std::endl;
+    build(positions, indices, resolution);
+    if (!save(cachePath))
+        std::cout << "Could not write the distance field cache " << cachePath << std::endl;
+}
+
+float SparseDistanceField::sample(const glm::vec3& position, glm::vec3& gradient) const {
+    float distance;
+    sampleBatch(&position.x, &position.y, &position.z, &distance, &gradient.x, &gradient.y, &gradient.z, 1);
+    return distance;
+}
+
+void SparseDistanceField::sampleBatch(const float* px, const float* py, const float* pz,
+    float* distance, float* gx, float* gy, float* gz, int count) const {
+    if (!isReady()) {
+        for (int i = 0; i < count; ++i) {
+            distance[i] = std::numeric_limits<float>::max();
+            gx[i] = gy[i] = gz[i] = 0.0f;
+        }
+        return;
+    }
+
+    const glm::vec3 gridMax = origin + glm::vec3(nx - 1, ny - 1, nz - 1) * cellSize;
+    int cachedBlock = -1;
+    uint32_t cachedEntry = TileOutside;
+    for (int i = 0; i < count; ++i) {
+        float ox = px[i] - std::min(std::max(px[i], origin.x), gridMax.x);
+        float oy = py[i] - std::min(std::max(py[i], origin.y), gridMax.y);
+        float oz = pz[i] - std::min(std::max(pz[i], origin.z), gridMax.z);
+        float outside = std::sqrt(ox * ox + oy * oy + oz * oz);
+
+        float x = std::min(std::max((px[i] - origin.x) * invCellSize, 0.0f), nx - 1.001f);
+        float y = std::min(std::max((py[i] - origin.y) * invCellSize, 0.0f), ny - 1.001f);
+        float z = std::min(std::max((pz[i] - origin.z) * invCellSize, 0.0f), nz - 1.001f);
+        int cx = static_cast<int>(x), cy = static_cast<int>(y), cz = static_cast<int>(z);
+
+        int block = blockIndex(cx / BlockCells, cy / BlockCells, cz / BlockCells);
+        if (block != cachedBlock) {
+            cachedBlock = block;
+            cachedEntry = table[block];
+        }
+        if (cachedEntry == TileOutside) {
+            distance[i] = bandWidth + outside;
+            gx[i] = gy[i] = gz[i] = 0.0f;
+            continue;
+        }
+        if (cachedEntry == TileInside) {
+            const uint32_t direction = escape[block];
+            distance[i] = -bandWidth + outside;
+            gx[i] = unpackComponent(direction, 0);
+            gy[i] = unpackComponent(direction, 8);
+            gz[i] = unpackComponent(direction, 16);
+            continue;
+        }
+
+        int lx = cx % BlockCells, ly = cy % BlockCells, lz = cz % BlockCells;
+        float fx = x - cx, fy = y - cy, fz = z - cz;
+        const int strideY = BlockSamples, strideZ = BlockSamples * BlockSamples;
+        const float* c = blocks + static_cast<size_t>(cachedEntry) * BlockValues + (lz * BlockSamples + ly) * BlockSamples + lx;
+        float c000 = c[0], c100 = c[1];
+        float c010 = c[strideY], c110 = c[strideY + 1];
+        float c001 = c[strideZ], c101 = c[strideZ + 1];
+        float c011 = c[strideZ + strideY], c111 = c[strideZ + strideY + 1];
+
+        float c00 = c000 + (c100 - c000) * fx;
+        float c10 = c010 + (c110 - c010) * fx;
+        float c01 = c001 + (c101 - c001) * fx;
+        float c11 = c011 + (c111 - c011) * fx;
+        float c0 = c00 + (c10 - c00) * fy;
+        float c1 = c01 + (c11 - c01) * fy;
+        distance[i] = c0 + (c1 - c0) * fz + outside;
+
+        float dx0 = (c100 - c000) + ((c110 - c010) - (c100 - c000)) * fy;
+        float dx1 = (c101 - c001) + ((c111 - c011) - (c101 - c001)) * fy;
+        gx[i] = (dx0 + (dx1 - dx0) * fz) * invCellSize;
+        gy[i] = ((c10 - c00) + ((c11 - c01) - (c10 - c00)) * fz) * invCellSize;
+        gz[i] = (c1 - c0) * invCellSize;
+    }
+}
+
+void SparseDistanceField::resolveCollision(std::vector<Particle>& particles, float thickness, float staticFriction, float kineticFriction) const {
+    resolveCollision(particles, nullptr, static_cast<int>(particles.size()), thickness, staticFriction, kineticFriction);
+}
+
+void SparseDistanceField::resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const {
+    if (!isReady())
+        return;
+    Parallel::forBlocks(candidateCount, [&](int begin, int end) {
+        float px[Parallel::BlockSize], py[Parallel::BlockSize], pz[Parallel::BlockSize];
+        float distance[Parallel::BlockSize], gx[Parallel::BlockSize], gy[Parallel::BlockSize], gz[Parallel::BlockSize];
+        const int count = end - begin;
+        for (int i = 0; i < count; ++i) {
+            glm::vec3 p = particles[candidates ? candidates[begin + i] : begin + i].getPosition();
+            px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+        }
+        sampleBatch(px, py, pz, distance, gx, gy, gz, count);
+        SignedDistanceField::pushOut(particles, candidates, begin, count, distance, gx, gy, gz, thickness, staticFriction, kineticFriction);
+    });
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Particle.h"
+#include "MappedFile.h"
+
+// Narrow-band signed distance field in two levels, in the style of VDB: a coarse table over blocks of
+// 8x8x8 cells, and sample data only for the blocks within bandCells of the surface. Every other block is
+// a tile, just "inside" or "outside", where the distance reads as -band or +band. Blocks carry one extra
+// layer of samples (9x9x9), so a trilinear lookup never needs a neighbouring block. An inside tile also
+// keeps the direction to the nearest stored block as its gradient, so a particle that ends up deep inside
+// is still pushed towards the surface until it reaches the band.
+//
+// The cache file has the same layout as memory and is mapped rather than read, so a field of any size
+// opens at once and only the blocks the cloth actually touches are paged in.
+class SparseDistanceField {
+public:
+    static constexpr int BlockCells = 8;
+    static constexpr int BlockSamples = BlockCells + 1;
+    static constexpr int BlockValues = BlockSamples * BlockSamples * BlockSamples;
+    static constexpr uint32_t TileOutside = 0xFFFFFFFFu;
+    static constexpr uint32_t TileInside = 0xFFFFFFFEu;
+
+    SparseDistanceField() = default;
+    SparseDistanceField(const SparseDistanceField&) = delete;
+    SparseDistanceField& operator=(const SparseDistanceField&) = delete;
+
+    // resolution: cells along the longest side of the mesh bounds. Distances are exact in every stored
+    // block, which covers at least bandCells cells on either side of the surface.
+    void build(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution, int bandCells = 3);
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path); // Maps the file, no copy
+    void loadOrBuild(const std::string& cachePath, const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, int resolution);
+
+    float sample(const glm::vec3& position, glm::vec3& gradient) const;
+    // Consecutive points usually fall in the same block (neighbouring particles), so the block looked up
+    // last is kept and the table is only read again when a point leaves it
+    void sampleBatch(const float* px, const float* py, const float* pz,
+        float* distance, float* gx, float* gy, float* gz, int count) const;
+
+    void resolveCollision(std::vector<Particle>& particles, float thickness, float staticFriction, float kineticFriction) const;
+    void resolveCollision(std::vector<Particle>& particles, const GLuint* candidates, int candidateCount, float thickness, float staticFriction, float kineticFriction) const;
+
+    bool isReady() const { return table != nullptr; }
+    glm::vec3 getBoundsMin() const { return origin; }
+    glm::vec3 getBoundsMax() const { return origin + glm::vec3(nx - 1, ny - 1, nz - 1) * cellSize; }
+    glm::vec3 getBoundsMin(float reach) const { return getBoundsMin() - glm::vec3(reach); }
+    glm::vec3 getBoundsMax(float reach) const { return getBoundsMax() + glm::vec3(reach); }
+    glm::vec3 getCenter() const { return 0.5f * (getBoundsMin() + getBoundsMax()); }
+    int getBlockCount() const { return static_cast<int>(blockCount); }
+    float getBandWidth() const { return bandWidth; }
+    size_t memoryBytes() const { return 2 * tableSize() * sizeof(uint32_t) + static_cast<size_t>(blockCount) * BlockValues * sizeof(float); }
+    size_t denseBytes() const { return static_cast<size_t>(nx) * ny * nz * sizeof(float); } // Same samples as one dense grid
+
+private:
+    int nx = 0, ny = 0, nz = 0; // Samples, (blocks * BlockCells + 1) per axis
+    int bx = 0, by = 0, bz = 0; // Blocks
+    uint32_t blockCount = 0;
+    glm::vec3 origin = glm::vec3(0.0f);
+    float cellSize = 1.0f;
+    float invCellSize = 1.0f;
+    float bandWidth = 0.0f;
+    uint64_t sourceHash = 0;
+    int sourceResolution = 0;
+
+    // Both point either into the owned vectors (after build) or into the mapped file (after load)
+    const uint32_t* table = nullptr; // Block index or tile, per block, x fastest
+    const uint32_t* escape = nullptr; // Per block, direction out of an inside tile (snorm8 x, y, z), 0 otherwise
+    const float* blocks = nullptr;   // BlockValues per stored block, x fastest
+    std::vector<uint32_t> ownedTable;
+    std::vector<uint32_t> ownedEscape;
+    std::vector<float> ownedBlocks;
+    MappedFile file;
+
+    size_t tableSize() const { return static_cast<size_t>(bx) * by * bz; }
+    int blockIndex(int x, int y, int z) const { return (z * by + y) * bx + x; }
+};
@@ -0,0 +1,62 @@
+#include "SpatialHash.h"
+#include "Parallel.h"
+#include <algorithm>
+
+void SpatialHash::build(const std::vector<Particle>& particles, float cellSize) {
+    const int particleCount = static_cast<int>(particles.size());
+    invCellSize = 1.0f / cellSize;
+
+    // Table with at least twice as many buckets as particles, power of two for masking
+    uint32_t tableSize = 64;
+    while (tableSize < 2u * static_cast<uint32_t>(particleCount))
+        tableSize <<= 1;
+    tableMask = tableSize - 1;
+
+    particleBucket.resize(particleCount);
+    sortedParticles.resize(particleCount);
+    cellStart.assign(tableSize + 1, 0);
+    cellCursor.resize(tableSize);
+
+    // 1. Bucket of every particle and bucket sizes
+    Parallel::forEach(particleCount, [&](int i) {
+        uint32_t bucket = hashCell(cellCoord(particles[i].getPosition()));
+        particleBucket[i] = bucket;
+#pragma omp atomic
+        cellStart[bucket + 1]++;
+    });
+
+    // 2. Prefix sum over the bucket sizes: every block scans locally, then adds the total of the blocks before it
+    const int bucketCount = static_cast<int>(tableSize);
+    const int scanBlock = 4096;
+    std::vector<int> blockTotal(Parallel::blockCount(bucketCount, scanBlock) + 1, 0);
+    Parallel::forBlocks(bucketCount, [&](int begin, int end) {
+        for (int b = begin + 1; b < end; ++b)
+            cellStart[b + 1] += cellStart[b];
+        blockTotal[begin / scanBlock + 1] = cellStart[end];
+    }, scanBlock);
+    for (size_t b = 1; b < blockTotal.size(); ++b)
+        blockTotal[b] += blockTotal[b - 1];
+    Parallel::forBlocks(bucketCount, [&](int begin, int end) {
+        int offset = blockTotal[begin / scanBlock];
+        for (int b = begin; b < end; ++b)
+            cellStart[b + 1] += offset;
+    }, scanBlock);
+    Parallel::forEach(bucketCount, [&](int b) {
+        cellCursor[b] = cellStart[b];
+    });
+
+    // 3. Scatter into the buckets
+    Parallel::forEach(particleCount, [&](int i) {
+        int slot;
+#pragma omp atomic capture
+        slot = cellCursor[particleBucket[i]]++;
+        sortedParticles[slot] = i;
+    });
+
+    // 4. The atomic scatter leaves buckets in thread order; sorting the (small) buckets makes
+    //    the layout identical for any thread count
+    Parallel::forEach(bucketCount, [&](int b) {
+        if (cellStart[b + 1] - cellStart[b] > 1)
+            std::sort(sortedParticles.begin() + cellStart[b], sortedParticles.begin() + cellStart[b + 1]);
+    });
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "Particle.h"
+
+// Uniform grid hashed into a table, rebuilt every step with a counting sort.
+// Cells hold particle indices, neighbour queries visit the 27 cells around a point.
+class SpatialHash {
+public:
+    // Rebuilds the table for the current particle positions. cellSize should be at least the query radius.
+    void build(const std::vector<Particle>& particles, float cellSize);
+
+    // Calls fn(j) for every particle j stored in the 27 cells around position (plus whatever shares their buckets)
+    template <typename Fn>
+    void forEachNeighbor(const glm::vec3& position, Fn fn) const {
+        glm::ivec3 base = cellCoord(position);
+        uint32_t visited[27];
+        int visitedCount = 0;
+        for (int dz = -1; dz <= 1; ++dz)
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx) {
+                    uint32_t bucket = hashCell(base + glm::ivec3(dx, dy, dz));
+                    // Two cells can hash to the same bucket, which must only be visited once
+                    bool seen = false;
+                    for (int v = 0; v < visitedCount; ++v)
+                        seen |= visited[v] == bucket;
+                    if (seen)
+                        continue;
+                    visited[visitedCount++] = bucket;
+                    for (int k = cellStart[bucket]; k < cellStart[bucket + 1]; ++k)
+                        fn(sortedParticles[k]);
+                }
+    }
+
+    int getTableSize() const { return static_cast<int>(tableMask + 1); }
+
+private:
+    float invCellSize = 1.0f;
+    uint32_t tableMask = 0;
+    std::vector<uint32_t> particleBucket; // Bucket of every particle
+    std::vector<int> cellStart;           // Bucket b holds sortedParticles[cellStart[b] .. cellStart[b + 1])
+    std::vector<int> cellCursor;
+    std::vector<int> sortedParticles;
+
+    glm::ivec3 cellCoord(const glm::vec3& position) const {
+        return glm::ivec3(glm::floor(position * invCellSize));
+    }
+
+    // Teschner et al. hash of the integer cell coordinates
+    uint32_t hashCell(const glm::ivec3& c) const {
+        uint32_t h = (static_cast<uint32_t>(c.x) * 73856093u) ^ (static_cast<uint32_t>(c.y) * 19349663u) ^ (static_cast<uint32_t>(c.z) * 83492791u);
+        return h & tableMask;
+    }
+};
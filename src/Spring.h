@@ -20,20 +20,29 @@ public:
     Spring(float _k, float _length, Particle* _p1, Particle* _p2)
         : k(_k), restLength(_length), p1(_p1), p2(_p2), color(glm::vec3(1.0f, 1.0f, 1.0f)) {}
 
-    // Applies Hooke's Law to update forces between the particles
-    void update() {
+    // Hooke's law force acting on p2 (p1 receives the opposite force)
+    glm::vec3 computeForce() const {
         glm::vec3 vector = p2->getPosition() - p1->getPosition();
         float currentLength = glm::length(vector);
         glm::vec3 direction = glm::normalize(vector);
 
         // Hooke's law: F = -k * (currentLength - restLength)
-        glm::vec3 force = -k * (currentLength - restLength) * direction;
+        return -k * (currentLength - restLength) * direction;
+    }
+
+    // Applies Hooke's Law to update forces between the particles
+    void update() {
+        glm::vec3 force = computeForce();
 
         // Application of forces to the particles
         p2->applyForce(force);
         p1->applyForce(-force);  // Force opposite to p1
     }
 
+    Particle* getP1() const { return p1; }
+    Particle* getP2() const { return p2; }
+    float getRestLength() const { return restLength; }
+
     // Rendering of the spring as a line between two particles
     void render(GLuint shaderProgram, const glm::mat4& model,const glm::mat4& view, const glm::mat4& projection) {
         // Uses the shader program
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+
+// Stack for the iterative tree traversals. The first Inline entries live in a fixed array, so a query on
+// any ordinary tree never allocates; past that it carries on in a vector instead of dropping subtrees. A
+// refit-only or LBVH tree over a crumpled cloth (many coincident Morton codes) can get far deeper than a
+// balanced one, and a traversal that silently skips a subtree misses contacts with no sign of it.
+template <typename T, int Inline>
+class TraversalStack {
+public:
+    bool empty() const { return count == 0; }
+
+    void push(const T& value) {
+        if (count < Inline)
+            fixed[count] = value;
+        else
+            overflow.push_back(value);
+        ++count;
+    }
+
+    T pop() {
+        --count;
+        if (count < Inline)
+            return fixed[count];
+        T value = overflow.back();
+        overflow.pop_back();
+        return value;
+    }
+
+private:
+    T fixed[Inline];
+    std::vector<T> overflow;
+    int count = 0;
+};
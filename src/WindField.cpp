@@ -0,0 +1,164 @@
+#include "WindField.h"
+#include "Parallel.h"
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+
+void WindField::build(uint64_t seed, int res, float domainSize) {
+    resolution = res;
+    mask = res - 1;
+    invCellSize = res / domainSize;
+    const int cellCount = res * res * res;
+
+    // Vector potential as a sum of a few random Fourier modes with integer wave numbers,
+    // which makes it exactly periodic over the grid
+    struct Mode {
+        glm::vec3 k;
+        glm::vec3 amplitude;
+        glm::vec3 phase;
+    };
+    const int modeCount = 12;
+    CounterRNG rng(seed);
+    std::vector<Mode> modes(modeCount);
+    uint64_t counter = 0;
+    for (int m = 0; m < modeCount; ++m) {
+        // Wave numbers in [-3, 3], skipping the constant mode
+        glm::vec3 k(0.0f);
+        while (k == glm::vec3(0.0f)) {
+            k = glm::floor(glm::vec3(rng.uniform(counter, 0), rng.uniform(counter, 1), rng.uniform(counter, 2)) * 7.0f) - 3.0f;
+            ++counter;
+        }
+        modes[m].k = k * (2.0f * glm::pi<float>() / res);
+        modes[m].amplitude = glm::vec3(rng.signedUniform(counter, 3), rng.signedUniform(counter, 4), rng.signedUniform(counter, 5)) / glm::length(k);
+        modes[m].phase = glm::vec3(rng.uniform(counter, 6), rng.uniform(counter, 7), rng.uniform(counter, 8)) * 2.0f * glm::pi<float>();
+    }
+
+    std::vector<glm::vec3> potential(cellCount);
+    Parallel::forEach(cellCount, [&](int c) {
+        glm::vec3 g(c % res, (c / res) % res, c / (res * res));
+        glm::vec3 psi(0.0f);
+        for (const Mode& mode : modes) {
+            float kx = glm::dot(mode.k, g);
+            psi += mode.amplitude * glm::sin(glm::vec3(kx) + mode.phase);
+        }
+        potential[c] = psi;
+    });
+
+    // Velocity = curl of the potential (central differences), so the field is divergence free
+    gridX.assign(cellCount, 0.0f);
+    gridY.assign(cellCount, 0.0f);
+    gridZ.assign(cellCount, 0.0f);
+    Parallel::forEach(cellCount, [&](int c) {
+        int x = c % res, y = (c / res) % res, z = c / (res * res);
+        glm::vec3 dx = (potential[cell(x + 1, y, z)] - potential[cell(x - 1, y, z)]) * 0.5f;
+        glm::vec3 dy = (potential[cell(x, y + 1, z)] - potential[cell(x, y - 1, z)]) * 0.5f;
+        glm::vec3 dz = (potential[cell(x, y, z + 1)] - potential[cell(x, y, z - 1)]) * 0.5f;
+        gridX[c] = dy.z - dz.y;
+        gridY[c] = dz.x - dx.z;
+        gridZ[c] = dx.y - dy.x;
+    });
+
+    // Normalize to unit RMS speed so turbulence is the actual velocity scale
+    double energy = Parallel::reduce(cellCount, 0.0, [&](int begin, int end) {
+        double sum = 0.0;
+        for (int c = begin; c < end; ++c)
+            sum += gridX[c] * gridX[c] + gridY[c] * gridY[c] + gridZ[c] * gridZ[c];
+        return sum;
+    }, [](double a, double b) { return a + b; });
+    float scale = energy > 0.0 ? static_cast<float>(1.0 / std::sqrt(energy / cellCount)) : 0.0f;
+    Parallel::forEach(cellCount, [&](int c) {
+        gridX[c] *= scale;
+        gridY[c] *= scale;
+        gridZ[c] *= scale;
+    });
+}
+
+void WindField::reset(uint64_t seed) {
+    CounterRNG rng(seed);
+    directionRNG = rng.derive(1);
+    gustRNG = rng.derive(2);
+    time = 0.0f;
+    changeTimer = 0.0f;
+    changeCount = 0;
+    offset = glm::vec3(0.0f);
+    direction = directionRNG.unitVector(changeCount++); // Initial random wind direction
+}
+
+void WindField::update(float dt) {
+    time += dt;
+
+    // Scroll the grid, wrapped to one period to keep the offset small
+    if (resolution > 0) {
+        float period = resolution / invCellSize;
+        offset = glm::mod(offset + scrollVelocity * dt, glm::vec3(period));
+    }
+
+    // Update to the wind direction periodically
+    changeTimer += dt;
+    if (changeTimer >= changeInterval) {
+        direction = directionRNG.unitVector(changeCount++);
+        changeTimer = 0.0f;
+    }
+}
+
+// Trilinear lookup in the periodic grid at a world position
+inline void WindField::sampleGrid(float px, float py, float pz, float& outX, float& outY, float& outZ) const {
+    const int res = resolution;
+    const int m = mask;
+
+    // Grid coordinates of the scrolled position
+    float gx = (px + offset.x) * invCellSize;
+    float gy = (py + offset.y) * invCellSize;
+    float gz = (pz + offset.z) * invCellSize;
+    float fx = std::floor(gx), fy = std::floor(gy), fz = std::floor(gz);
+    float tx = gx - fx, ty = gy - fy, tz = gz - fz;
+    int x0 = static_cast<int>(fx) & m, y0 = static_cast<int>(fy) & m, z0 = static_cast<int>(fz) & m;
+    int x1 = (x0 + 1) & m, y1 = (y0 + 1) & m, z1 = (z0 + 1) & m;
+
+    int c000 = (z0 * res + y0) * res + x0, c100 = (z0 * res + y0) * res + x1;
+    int c010 = (z0 * res + y1) * res + x0, c110 = (z0 * res + y1) * res + x1;
+    int c001 = (z1 * res + y0) * res + x0, c101 = (z1 * res + y0) * res + x1;
+    int c011 = (z1 * res + y1) * res + x0, c111 = (z1 * res + y1) * res + x1;
+
+    float w000 = (1 - tx) * (1 - ty) * (1 - tz), w100 = tx * (1 - ty) * (1 - tz);
+    float w010 = (1 - tx) * ty * (1 - tz), w110 = tx * ty * (1 - tz);
+    float w001 = (1 - tx) * (1 - ty) * tz, w101 = tx * (1 - ty) * tz;
+    float w011 = (1 - tx) * ty * tz, w111 = tx * ty * tz;
+
+    const float* vx = gridX.data();
+    const float* vy = gridY.data();
+    const float* vz = gridZ.data();
+    outX = w000 * vx[c000] + w100 * vx[c100] + w010 * vx[c010] + w110 * vx[c110]
+         + w001 * vx[c001] + w101 * vx[c101] + w011 * vx[c011] + w111 * vx[c111];
+    outY = w000 * vy[c000] + w100 * vy[c100] + w010 * vy[c010] + w110 * vy[c110]
+         + w001 * vy[c001] + w101 * vy[c101] + w011 * vy[c011] + w111 * vy[c111];
+    outZ = w000 * vz[c000] + w100 * vz[c100] + w010 * vz[c010] + w110 * vz[c110]
+         + w001 * vz[c001] + w101 * vz[c101] + w011 * vz[c011] + w111 * vz[c111];
+}
+
+glm::vec3 WindField::sampleTurbulence(const glm::vec3& position) const {
+    if (resolution == 0)
+        return glm::vec3(0.0f);
+    glm::vec3 velocity;
+    sampleGrid(position.x, position.y, position.z, velocity.x, velocity.y, velocity.z);
+    return velocity * turbulence;
+}
+
+void WindField::sampleBatch(const float* px, const float* py, const float* pz,
+    float* wx, float* wy, float* wz, int count, uint64_t step, uint64_t firstIndex) const {
+    const glm::vec3 dir = direction;
+    const bool hasGrid = resolution > 0;
+
+#pragma omp simd
+    for (int i = 0; i < count; ++i) {
+        float tX = 0.0f, tY = 0.0f, tZ = 0.0f;
+        if (hasGrid)
+            sampleGrid(px[i], py[i], pz[i], tX, tY, tZ);
+
+        // Gust strength between strength - gustStrength and strength + gustStrength
+        float gust = strength + gustRNG.signedUniform(step, firstIndex + i) * gustStrength;
+
+        wx[i] = dir.x * gust + tX * turbulence;
+        wy[i] = dir.y * gust + tY * turbulence;
+        wz[i] = dir.z * gust + tZ * turbulence;
+    }
+}
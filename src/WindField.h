@@ -0,0 +1,54 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "Random.h"
+
+// Wind made of a mean direction that changes every few tenths of a second, per-particle gusts,
+// and a turbulent part read from a precomputed periodic curl-noise grid.
+// The grid is built once and animated by scrolling it through the scene.
+class WindField {
+public:
+    float strength = 0.02f;       // Base wind strength
+    float gustStrength = 0.1f;    // Gusts vary the strength by up to this amount
+    float turbulence = 0.1f;      // Scale of the curl-noise velocity
+    float changeInterval = 0.5f;  // Time in seconds to change wind direction
+    glm::vec3 scrollVelocity = glm::vec3(0.3f, 0.1f, 0.2f);
+
+    // Builds the periodic noise grid (resolution must be a power of two)
+    void build(uint64_t seed, int resolution = 32, float domainSize = 2.0f);
+
+    // Restarts time and the direction/gust streams
+    void reset(uint64_t seed);
+
+    // Advances time, scrolls the grid and changes the mean direction when due
+    void update(float dt);
+
+    // Turbulent wind at a world position (trilinear, periodic)
+    glm::vec3 sampleTurbulence(const glm::vec3& position) const;
+
+    // Full wind force for count particles stored as separate x/y/z arrays.
+    // Gusts are keyed by (step, firstIndex + i) so any split into batches gives the same result.
+    void sampleBatch(const float* px, const float* py, const float* pz,
+        float* wx, float* wy, float* wz, int count, uint64_t step, uint64_t firstIndex) const;
+
+    glm::vec3 getDirection() const { return direction; }
+    bool isBuilt() const { return !gridX.empty(); }
+
+private:
+    int resolution = 0;
+    int mask = 0;
+    float invCellSize = 1.0f;
+    std::vector<float> gridX, gridY, gridZ;
+
+    float time = 0.0f;
+    float changeTimer = 0.0f;
+    uint64_t changeCount = 0;
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 direction = glm::vec3(1.0f, 0.0f, 0.0f);
+    CounterRNG directionRNG;
+    CounterRNG gustRNG;
+
+    void sampleGrid(float px, float py, float pz, float& outX, float& outY, float& outZ) const;
+    int cell(int x, int y, int z) const { return ((z & mask) * resolution + (y & mask)) * resolution + (x & mask); }
+};